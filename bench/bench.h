@@ -0,0 +1,117 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*
+    Minimal micro-benchmark harness
+
+    Every case is run 'repetitions' times with a fixed number of iterations per run so that
+    results are reproducible from one release to the next. Cases that can only run once
+    (e.g. static registration, which mutates global layouts) report a single repetition.
+*/
+
+namespace bench {
+
+struct result {
+    std::string name;
+    size_t      iterations;
+    size_t      repetitions;
+    double      median_ns; // per iteration
+    double      min_ns;    // per iteration
+    double      max_ns;    // per iteration
+};
+
+inline auto results() -> std::vector<result>& {
+    static std::vector<result> ret;
+    return ret;
+}
+
+inline auto filter() -> std::string& {
+    static std::string ret;
+    return ret;
+}
+
+inline auto enabled(const std::string& _name) -> bool {
+    return filter().empty() || _name.find(filter()) != std::string::npos;
+}
+
+// prevent the optimizer from discarding the measured work
+
+inline auto sink() -> volatile uint64_t& {
+    static volatile uint64_t ret = 0;
+    return ret;
+}
+
+template<typename T>
+void keep(const T& _value) {
+    sink() = sink() + *reinterpret_cast<const volatile unsigned char*>(&_value);
+}
+
+inline auto now_ns() -> int64_t {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+inline void record(const std::string& _name, size_t _iterations, std::vector<double> _samples) {
+    std::sort(_samples.begin(), _samples.end());
+    results().push_back(result{
+        _name, _iterations, _samples.size(),
+        _samples[_samples.size() / 2], _samples.front(), _samples.back()
+    });
+}
+
+// repeatable case: '_body' is invoked '_iterations' times per repetition
+
+template<typename F>
+void run(const std::string& _name, size_t _iterations, size_t _repetitions, F&& _body) {
+    if (!enabled(_name)) {
+        return;
+    }
+    std::vector<double> samples;
+    for (auto r = 0u; r < _repetitions; ++r) {
+        const auto start = now_ns();
+        for (auto i = 0u; i < _iterations; ++i) {
+            _body();
+        }
+        samples.push_back(static_cast<double>(now_ns() - start) / static_cast<double>(_iterations));
+    }
+    record(_name, _iterations, std::move(samples));
+}
+
+// one-shot case: '_body' does '_count' units of work exactly once (always run, as other cases may depend on it)
+
+template<typename F>
+void run_once(const std::string& _name, size_t _count, F&& _body) {
+    const auto start = now_ns();
+    _body();
+    const auto elapsed = now_ns() - start;
+    if (enabled(_name)) {
+        record(_name, _count, { static_cast<double>(elapsed) / static_cast<double>(_count) });
+    }
+}
+
+inline auto to_json() -> std::string {
+    std::stringstream out;
+    out << "{\n  \"benchmarks\" : \n  [\n";
+    for (auto i = 0u; i < results().size(); ++i) {
+        auto& r = results()[i];
+        out << "    { "
+            << "\"name\" : \"" << r.name << "\", "
+            << "\"iterations\" : " << r.iterations << ", "
+            << "\"repetitions\" : " << r.repetitions << ", "
+            << "\"median_ns\" : " << r.median_ns << ", "
+            << "\"min_ns\" : " << r.min_ns << ", "
+            << "\"max_ns\" : " << r.max_ns
+            << " }" << (i + 1 < results().size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    return out.str();
+}
+
+} // namespace bench
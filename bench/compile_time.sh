@@ -0,0 +1,69 @@
+#!/usr/bin/env bash
+#
+#   Compile-time benchmark
+#
+#   Generates translation units that register a growing number of classes and arrays of a
+#   growing size, compiles each of them once and prints the build times as JSON.
+#
+#   usage: bench/compile_time.sh [compiler flags...]   (CXX selects the compiler; g++ by default)
+#
+
+set -euo pipefail
+
+root="$(cd "$(dirname "$0")/.." && pwd)"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+
+cxx="${CXX:-g++}"
+flags=("-std=c++17" "-O2" "-I$root/include" "$@")
+
+# $1: name, $2: file to compile
+
+measure() {
+    local start end
+    start=$(date +%s%N)
+    if "$cxx" "${flags[@]}" -c "$2" -o "$work/out.o" 2> "$work/errors.txt"; then
+        end=$(date +%s%N)
+        printf '    { "name" : "%s", "compile_ms" : %d, "object_bytes" : %d }' "$1" $(( (end - start) / 1000000 )) "$(wc -c < "$work/out.o")"
+    else
+        printf '    { "name" : "%s", "failed" : true }' "$1"
+    fi
+}
+
+# $1: number of classes with 8 fields each
+
+types_unit() {
+    echo '#include "map_layout.h"'
+    for ((i = 0; i < $1; ++i)); do
+        echo "struct t$i { int a; float b; double c; char d; short e; long f; bool g; unsigned h; };"
+        for f in a b c d e f g h; do
+            echo "ML_GLOBAL_REGISTER_FIELD(t$i, $f);"
+        done
+    done
+}
+
+# $1: array size
+
+array_unit() {
+    echo '#include <array>'
+    echo '#include "map_layout.h"'
+    echo "struct arrays { std::array<int, $1> a; std::pair<float, int> b[$1]; };"
+    echo 'ML_GLOBAL_REGISTER_FIELD(arrays, a);'
+    echo 'ML_GLOBAL_REGISTER_FIELD(arrays, b);'
+}
+
+echo '{'
+echo '  "benchmarks" :'
+echo '  ['
+sep=""
+for n in 1 16 64; do
+    types_unit "$n" > "$work/types_$n.cpp"
+    printf '%s' "$sep"; measure "compile/types:$n/fields:8" "$work/types_$n.cpp"; sep=$',\n'
+done
+for n in 16 256 1024; do
+    array_unit "$n" > "$work/array_$n.cpp"
+    printf '%s' "$sep"; measure "compile/array/size:$n" "$work/array_$n.cpp"
+done
+echo
+echo '  ]'
+echo '}'
@@ -0,0 +1,55 @@
+#!/usr/bin/env bash
+#
+#   Synthetic type corpus
+#
+#   Generates a corpus of registered types (corpus/main.cpp), builds it with the corpus driver
+#   and runs it: every layout is checked against the compiler's offsetof/sizeof and the
+#   totals (registration time, layout memory, field index build time) are printed as JSON
+#   along with the build time. Exits with an error if any layout is wrong.
+#
+#   usage: bench/corpus.sh [types] [seed] [compiler flags...]   (CXX selects the compiler; g++ by default)
+#
+
+set -euo pipefail
+
+root="$(cd "$(dirname "$0")/.." && pwd)"
+work="$(mktemp -d)"
+trap 'rm -rf "$work"' EXIT
+
+types="${1:-1000}"
+seed="${2:-1}"
+shift $(( $# < 2 ? $# : 2 ))
+
+cxx="${CXX:-g++}"
+flags=("-std=c++17" "-O1" "-fno-exceptions" "-DML_ENABLE_STATS=1" "-I$root/include" "-I$root/corpus/driver" "-I$work" "$@")
+
+"$cxx" -std=c++17 -O2 "$root/corpus/main.cpp" -o "$work/generator"
+"$work/generator" "$work" "$types" "$seed" 100 > /dev/null
+
+# the units are independent, build them in batches of parallel jobs
+
+batch="$(nproc 2> /dev/null || echo 4)"
+sources=("$work"/corpus_*.cpp "$root/corpus/driver/driver.cpp")
+start=$(date +%s%N)
+for ((i = 0; i < ${#sources[@]}; i += batch)); do
+    pids=()
+    for src in "${sources[@]:i:batch}"; do
+        "$cxx" "${flags[@]}" -c "$src" -o "$work/$(basename "$src").o" &
+        pids+=($!)
+    done
+    for pid in "${pids[@]}"; do
+        wait "$pid"
+    done
+done
+"$cxx" "$work"/*.o -o "$work/driver" -pthread
+end=$(date +%s%N)
+
+status=0
+"$work/driver" > "$work/result.json" || status=$?
+
+echo '{'
+echo "  \"build_ms\" : $(( (end - start) / 1000000 )),"
+printf '  "corpus" : '
+sed '2,$s/^/  /' "$work/result.json"
+echo '}'
+exit "$status"
@@ -0,0 +1,746 @@
+#include <iostream>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "map_layout.h"
+#include "map_layout_serializer.h"
+#include "map_layout_iovec.h"
+#include "map_layout_swizzle.h"
+#include "map_layout_parallel.h"
+#include "map_layout_columnar.h"
+#include "map_layout_dirty.h"
+#include "map_layout_index.h"
+#include "map_layout_ring.h"
+#include "map_layout_projection.h"
+#include "map_layout_filter.h"
+#include "map_layout_sort.h"
+#include "map_layout_aggregate.h"
+#include "map_layout_access.h"
+#include "map_layout_atomic.h"
+#include "map_layout_profile.h"
+#include "map_layout_perf.h"
+#include "tojson.h"
+#include "bench.h"
+#include "types.h"
+
+using namespace std;
+using namespace qcstudio::map_layout;
+
+/*
+    Number of distinct classes registered per registration case
+*/
+
+constexpr auto num_classes = size_t{16};
+
+namespace bench {
+
+/*
+    Registration (one-shot; reported per registered field)
+*/
+
+template<size_t ...K> void register_all_flat4 (index_sequence<K...>) { (register_flat4 <K>(), ...); }
+template<size_t ...K> void register_all_flat16(index_sequence<K...>) { (register_flat16<K>(), ...); }
+template<size_t ...K> void register_all_flat64(index_sequence<K...>) { (register_flat64<K>(), ...); }
+template<size_t ...K> void register_all_bulk64(index_sequence<K...>) { (register_bulk64<K>(), ...); }
+template<size_t ...K> void register_all_bits16(index_sequence<K...>) { (register_bits16<K>(), ...); }
+
+template<size_t ...K> void touch_all_flat64(index_sequence<K...>) { (keep(get_layout<flat64<K>>()), ...); }
+
+template<size_t D, size_t ...K> void register_all_nested (index_sequence<K...>) { (register_nested <D, K>(), ...); }
+template<size_t N, size_t ...K> void register_all_arrayed(index_sequence<K...>) { (register_arrayed<N, K>(), ...); }
+
+void registration() {
+    const auto classes = make_index_sequence<num_classes>{};
+    const auto suffix  = "/classes:" + to_string(num_classes);
+
+    run_once("register/flat/fields:4"  + suffix, num_classes *  4, [&] { register_all_flat4 (classes); });
+    run_once("register/flat/fields:16" + suffix, num_classes * 16, [&] { register_all_flat16(classes); });
+    run_once("register/flat/fields:64" + suffix, num_classes * 64, [&] { register_all_flat64(classes); });
+    run_once("first_get_layout/flat/fields:64" + suffix, num_classes * 64, [&] { touch_all_flat64(classes); }); // builds lazy layouts
+    run_once("register_bulk/flat/fields:64" + suffix, num_classes * 64, [&] { register_all_bulk64(classes); });
+    run_once("register/bitfield/fields:16" + suffix, num_classes * 16, [&] { register_all_bits16(classes); });
+
+    run_once("register/nested/depth:1"  + suffix, num_classes, [&] { register_all_nested< 1>(classes); });
+    run_once("register/nested/depth:4"  + suffix, num_classes, [&] { register_all_nested< 4>(classes); });
+    run_once("register/nested/depth:16" + suffix, num_classes, [&] { register_all_nested<16>(classes); });
+
+    run_once("register/array/size:16"  + suffix, num_classes, [&] { register_all_arrayed< 16>(classes); });
+    run_once("register/array/size:256" + suffix, num_classes, [&] { register_all_arrayed<256>(classes); });
+
+    run_once("register/dynamic/fields:5", 5, [&] { register_message(); });
+    run_once("register/graph/fields:3", 3, [&] { register_node(); });
+    run_once("register/series/fields:5", 5, [&] { register_tick(); });
+    run_once("register/status/fields:3", 3, [&] { register_status(); });
+}
+
+/*
+    Layout access
+*/
+
+template<typename T>
+void access(const string& _name) {
+    run("get_layout/" + _name, 1000000, 9, [] {
+        keep(get_layout<T>());
+    });
+    run("traverse/" + _name, 10000, 9, [] {
+        auto bits = size_t{0};
+        for (auto& [ name, info ] : get_layout<T>().fields) {
+            bits += info.item.ranges.back() - info.item.ranges.front();
+        }
+        keep(bits);
+    });
+}
+
+void lookup() {
+    access<flat4 <0>>("flat/fields:4");
+    access<flat16<0>>("flat/fields:16");
+    access<flat64<0>>("flat/fields:64");
+    access<bits16<0>>("bitfield/fields:16");
+    access<nested<16, 0>>("nested/depth:16");
+}
+
+/*
+    JSON export
+*/
+
+template<typename T>
+void export_json(const string& _name) {
+    run("to_json/" + _name, 1000, 9, [] {
+        keep(::to_json(get_layout<T>()).size());
+    });
+}
+
+void json() {
+    export_json<flat4 <0>>("flat/fields:4");
+    export_json<flat64<0>>("flat/fields:64");
+    export_json<bits16<0>>("bitfield/fields:16");
+    export_json<nested<16, 0>>("nested/depth:16");
+    export_json<arrayed<256, 0>>("array/size:256");
+}
+
+/*
+    Serialization
+*/
+
+template<typename T>
+void serialization(const string& _name, const T& _obj) {
+    auto buffer = vector<uint8_t>{};
+    run("serialize/" + _name, 100000, 9, [&] {
+        buffer.clear();
+        serialize(_obj, buffer);
+        keep(buffer.size());
+    });
+    auto obj = T{};
+    run("deserialize/" + _name, 100000, 9, [&] {
+        keep(deserialize(buffer.data(), buffer.size(), obj));
+    });
+}
+
+template<typename T>
+void bulk_serialization(const string& _name, const T& _obj, size_t _count) {
+    auto objs   = vector<T>(_count, _obj);
+    auto buffer = vector<uint8_t>{};
+    auto pool   = thread_pool{};
+    const auto suffix = "/records:" + to_string(_count);
+
+    run("bulk_serialize/" + _name + suffix, 10, 9, [&] {
+        buffer.clear();
+        for (auto& obj : objs) {
+            serialize(obj, buffer);
+        }
+        keep(buffer.size());
+    });
+    run("parallel_serialize/" + _name + suffix + "/threads:" + to_string(pool.size()), 10, 9, [&] {
+        buffer.clear();
+        parallel_serialize(pool, objs.data(), objs.size(), buffer);
+        keep(buffer.size());
+    });
+}
+
+void serializers() {
+    serialization("flat/fields:16", flat16<0>{});
+    serialization("flat/fields:64", flat64<0>{});
+    serialization("dynamic/samples:16", message{ 1, 2.0, vector<float>(16, 3.0f), "record", 4 });
+    serialization("dynamic/samples:1024", message{ 1, 2.0, vector<float>(1024, 3.0f), "record", 4 });
+    bulk_serialization("flat/fields:64", flat64<0>{}, 65536);
+    bulk_serialization("dynamic/samples:16", message{ 1, 2.0, vector<float>(16, 3.0f), "record", 4 }, 65536);
+}
+
+/*
+    Gather lists
+*/
+
+template<typename T>
+void gather(const string& _name, size_t _count) {
+    auto objs = vector<T>(_count);
+    auto iovs = vector<iovec>(_count * 64);
+    run("to_iovecs/" + _name + "/objects:" + to_string(_count), 10000, 9, [&] {
+        keep(to_iovecs(objs.data(), objs.size(), iovs.data(), iovs.size()));
+    });
+}
+
+void iovecs() {
+    gather<flat16<0>>("flat/fields:16", 1);
+    gather<flat16<0>>("flat/fields:16", 64);
+    gather<flat64<0>>("flat/fields:64", 64);
+}
+
+/*
+    Offset to field lookup
+*/
+
+template<typename T>
+void offset_lookup(const string& _name, size_t _count) {
+    auto& index  = get_field_index<T>();
+    auto  bits   = vector<size_t>(_count);
+    auto  state  = uint64_t{88172645463325252ull};
+    for (auto& bit : bits) {
+        state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+        bit = state % (sizeof(T) * CHAR_BIT);
+    }
+    const auto suffix = "/" + _name + "/lookups:" + to_string(_count);
+
+    run("field_at/index" + suffix, 10, 9, [&] {
+        auto found = size_t{0};
+        for (auto bit : bits) {
+            found += index.field_at(bit) != nullptr;
+        }
+        keep(found);
+    });
+    run("field_at/linear" + suffix, 10, 9, [&] {
+        auto found = size_t{0};
+        for (auto bit : bits) {
+            for (auto& leaf : index.leaves()) {
+                if (bit >= leaf.first_bit && bit <= leaf.last_bit) {
+                    ++found;
+                    break;
+                }
+            }
+        }
+        keep(found);
+    });
+}
+
+void offsets() {
+    offset_lookup<flat16<0>>("flat/fields:16", 65536);
+    offset_lookup<flat64<0>>("flat/fields:64", 65536);
+    offset_lookup<arrayed<256, 0>>("array/size:256", 65536);
+}
+
+/*
+    Inter-process exchange (both ends in one thread, so that only the transfer is measured)
+*/
+
+void exchange(size_t _batch) {
+    auto in  = vector<tick>(_batch, tick{ 1600000000000, 100.25, 300, true, 2 });
+    auto out = vector<tick>(_batch);
+    const auto suffix = "/series/batch:" + to_string(_batch);
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0) {
+        run("ipc/socketpair" + suffix, 100, 9, [&] {
+            for (auto& record : in) {
+                keep(write(fds[0], &record, sizeof(record)));
+            }
+            for (auto& record : out) {
+                keep(read(fds[1], &record, sizeof(record)));
+            }
+        });
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    for (auto mode : { ring_mode::spsc, ring_mode::mpmc }) {
+        auto producer = shm_ring<tick>::create(nullptr, _batch, mode);
+        auto consumer = shm_ring<tick>::attach_fd(producer.fd());
+        run(string("ipc/shm_ring/") + (mode == ring_mode::spsc ? "spsc" : "mpmc") + suffix, 100, 9, [&] {
+            for (auto& record : in) {
+                keep(producer.try_push(record));
+            }
+            for (auto& record : out) {
+                keep(consumer.try_pop(record));
+            }
+        });
+    }
+}
+
+void ipc() {
+    exchange(256);
+}
+
+/*
+    Field projection (two fields out of 64)
+*/
+
+void projections(size_t _count) {
+    auto records = vector<flat64<0>>(_count);
+    for (auto i = 0u; i < _count; ++i) {
+        records[i].f0 = static_cast<int>(i);
+        records[i].f5 = i;
+    }
+    auto f0 = vector<int>(_count);
+    auto f5 = vector<uint64_t>(_count);
+    const auto suffix = "/flat/fields:64/records:" + to_string(_count);
+
+    run("project/record_copy" + suffix, 10, 9, [&] {
+        for (auto i = 0u; i < _count; ++i) {
+            auto record = records[i];
+            f0[i] = record.f0;
+            f5[i] = record.f5;
+        }
+        keep(f0.back() + f5.back());
+    });
+
+    auto proj = project(records.data(), records.size(), { "f0", "f5" });
+    uint8_t* out[] = { reinterpret_cast<uint8_t*>(f0.data()), reinterpret_cast<uint8_t*>(f5.data()) };
+    run("project/gather" + suffix, 10, 9, [&] {
+        proj.gather(0, _count, out);
+        keep(f0.back() + f5.back());
+    });
+}
+
+void projectors() {
+    projections(65536);
+}
+
+/*
+    Predicate pushdown (two fields of raw tick records)
+*/
+
+void predicates(size_t _count) {
+    auto ticks = vector<tick>(_count);
+    for (auto i = 0u; i < _count; ++i) {
+        ticks[i] = tick{ 1600000000000 + i * 250, 100.0 + (i * 7919 % 64) * 0.25, static_cast<int32_t>(100 * (1 + i * 31 % 5)), i % 2 == 0, static_cast<uint8_t>(i % 3) };
+    }
+    auto buffer = vector<uint8_t>(_count * sizeof(tick));
+    memcpy(buffer.data(), ticks.data(), buffer.size());
+    const auto suffix = "/series/records:" + to_string(_count);
+
+    auto matches = vector<size_t>{};
+    run("filter/record_copy" + suffix, 10, 9, [&] {
+        matches.clear();
+        for (auto i = 0u; i < _count; ++i) {
+            tick record;
+            memcpy(&record, buffer.data() + i * sizeof(tick), sizeof(tick));
+            if (record.quantity > 300 && record.price < 110.0) {
+                matches.push_back(i);
+            }
+        }
+        keep(matches.size());
+    });
+
+    auto serialized = vector<uint8_t>{};
+    for (auto& t : ticks) {
+        serialize(t, serialized);
+    }
+    run("filter/deserialize" + suffix, 10, 9, [&] {
+        matches.clear();
+        auto record = tick{};
+        for (auto pos = size_t{0}, i = size_t{0}; pos < serialized.size(); ++i) {
+            pos += deserialize(serialized.data() + pos, serialized.size() - pos, record);
+            if (record.quantity > 300 && record.price < 110.0) {
+                matches.push_back(i);
+            }
+        }
+        keep(matches.size());
+    });
+
+    const auto pred = field("quantity") > 300 && field("price") < 110.0;
+    run("filter/bitmap" + suffix, 10, 9, [&] {
+        keep(qcstudio::map_layout::filter<tick>(buffer.data(), _count, pred).count());
+    });
+    run("filter/indices" + suffix, 10, 9, [&] {
+        keep(qcstudio::map_layout::filter<tick>(buffer.data(), _count, pred).indices().size());
+    });
+}
+
+void pushdowns() {
+    predicates(1 << 20);
+}
+
+/*
+    Radix sort (two keys of tick records; every iteration sorts a fresh copy)
+*/
+
+void sorting(size_t _count) {
+    auto ticks = vector<tick>(_count);
+    auto state = uint64_t{88172645463325252ull};
+    for (auto i = 0u; i < _count; ++i) {
+        state ^= state << 13; state ^= state >> 7; state ^= state << 17;
+        ticks[i] = tick{ 1600000000000 + i * 250, 100.0 + static_cast<double>(state % 4096) * 0.25, static_cast<int32_t>(state % 1000), (state & 1) != 0, static_cast<uint8_t>(state % 3) };
+    }
+    auto work = vector<tick>(_count);
+    auto order = vector<size_t>{};
+    const auto suffix = "/series/records:" + to_string(_count);
+
+    run("sort/std_sort" + suffix, 1, 9, [&] {
+        work = ticks;
+        sort(work.begin(), work.end(), [](auto& _a, auto& _b) { return _a.venue != _b.venue ? _a.venue < _b.venue : _a.price < _b.price; });
+        keep(work[0].time);
+    });
+    run("sort/sort_by" + suffix, 1, 9, [&] {
+        work = ticks;
+        keep(sort_by(work, { "venue", "price" }));
+    });
+    run("sort/sort_order" + suffix, 1, 9, [&] {
+        work = ticks;
+        keep(sort_order(work.data(), work.size(), { "venue", "price" }, order));
+    });
+}
+
+void sorters() {
+    sorting(1 << 20);
+}
+
+/*
+    Aggregations (sum/min/max of one field of tick records)
+*/
+
+template<typename V>
+void aggregation(const vector<tick>& _ticks, V tick::* _member, const char* _field, thread_pool& _pool) {
+    const auto suffix = string{_field} + "/series/records:" + to_string(_ticks.size());
+
+    run("aggregate/loop/" + suffix, 10, 9, [&] {
+        auto sum = V{0};
+        auto lo  = numeric_limits<V>::max();
+        auto hi  = numeric_limits<V>::lowest();
+        for (auto& t : _ticks) {
+            sum += t.*_member;
+            lo   = min(lo, t.*_member);
+            hi   = max(hi, t.*_member);
+        }
+        keep(sum + lo + hi);
+    });
+    run("aggregate/field/" + suffix, 10, 9, [&] {
+        keep(aggregate(_ticks.data(), _ticks.size(), _field).count);
+    });
+    run("aggregate/field/" + suffix + "/threads:" + to_string(_pool.size()), 10, 9, [&] {
+        keep(aggregate(_pool, _ticks.data(), _ticks.size(), _field).count);
+    });
+}
+
+void aggregations(size_t _count) {
+    auto ticks = vector<tick>(_count);
+    for (auto i = 0u; i < _count; ++i) {
+        ticks[i] = tick{ 1600000000000 + i * 250, 100.0 + (i * 7919 % 64) * 0.25, static_cast<int32_t>(100 * (1 + i * 31 % 5)), i % 2 == 0, static_cast<uint8_t>(i % 3) };
+    }
+    auto pool = thread_pool{};
+    aggregation(ticks, &tick::quantity, "quantity", pool);
+    aggregation(ticks, &tick::price, "price", pool);
+}
+
+void aggregators() {
+    aggregations(1 << 20);
+}
+
+/*
+    Runtime field access (a field of tick records chosen by name, read through a handle)
+*/
+
+void accessing(size_t _count) {
+    auto ticks = vector<tick>(_count);
+    for (auto i = 0u; i < _count; ++i) {
+        ticks[i] = tick{ 1600000000000 + i * 250, 100.0 + (i * 7919 % 64) * 0.25, static_cast<int32_t>(100 * (1 + i * 31 % 5)), i % 2 == 0, static_cast<uint8_t>(i % 3) };
+    }
+    const auto suffix = "/price/records:" + to_string(_count);
+
+    run("access/member" + suffix, 10, 9, [&] {
+        auto sum = 0.0;
+        for (auto& t : ticks) {
+            sum += t.price;
+        }
+        keep(sum);
+    });
+    run("access/type_switch" + suffix, 10, 9, [&] { // what a bridge without layouts does: a tag and an offset per column
+        volatile auto tag = 3; // known only at runtime
+        const auto type   = static_cast<int>(tag);
+        const auto offset = offsetof(tick, price);
+        auto sum = 0.0;
+        for (auto& t : ticks) {
+            const auto src = reinterpret_cast<const char*>(&t) + offset;
+            switch (type) {
+                case 0:  { int32_t v; memcpy(&v, src, 4); sum += v; break; }
+                case 1:  { int64_t v; memcpy(&v, src, 8); sum += static_cast<double>(v); break; }
+                case 2:  { float   v; memcpy(&v, src, 4); sum += v; break; }
+                default: { double  v; memcpy(&v, src, 8); sum += v; break; }
+            }
+        }
+        keep(sum);
+    });
+    run("access/field_ref/read" + suffix, 10, 9, [&] {
+        const auto price = make_field_ref<tick>("price");
+        auto sum = 0.0;
+        for (auto& t : ticks) {
+            sum += price.read<double>(&t);
+        }
+        keep(sum);
+    });
+    run("access/field_ref/get" + suffix, 10, 9, [&] {
+        const auto price = make_field_ref<tick>("price");
+        auto sum = 0.0;
+        for (auto& t : ticks) {
+            auto v = 0.0;
+            price.get(&t, v);
+            sum += v;
+        }
+        keep(sum);
+    });
+    run("access/field_ref/set" + suffix, 10, 9, [&] {
+        const auto quantity = make_field_ref<tick>("quantity");
+        auto i = int32_t{0};
+        for (auto& t : ticks) {
+            quantity.set(&t, ++i & 1023);
+        }
+        keep(ticks.back().quantity);
+    });
+    run("access/get_field/price/records:" + to_string(_count / 64), 10, 9, [&] { // resolves the name on every record
+        auto sum = 0.0;
+        for (auto i = 0u; i < _count; i += 64) {
+            auto v = 0.0;
+            get_field(ticks[i], "price", v);
+            sum += v;
+        }
+        keep(sum);
+    });
+}
+
+void accessors() {
+    accessing(1 << 20);
+}
+
+/*
+    Value-range profiling (every field of tick records)
+*/
+
+void profiling(size_t _count) {
+    auto ticks = vector<tick>(_count);
+    for (auto i = 0u; i < _count; ++i) {
+        ticks[i] = tick{ 1600000000000 + i * 250, 100.0 + (i * 7919 % 64) * 0.25, static_cast<int32_t>(100 * (1 + i * 31 % 5)), i % 2 == 0, static_cast<uint8_t>(i % 3) };
+    }
+    auto pool = thread_pool{};
+    const auto suffix = "/series/records:" + to_string(_count);
+
+    run("profile_ranges" + suffix, 10, 9, [&] {
+        keep(profile_ranges(ticks.data(), ticks.size()).typed_bytes);
+    });
+    run("profile_ranges" + suffix + "/threads:" + to_string(pool.size()), 10, 9, [&] {
+        keep(profile_ranges(pool, ticks.data(), ticks.size()).typed_bytes);
+    });
+}
+
+void profilers() {
+    profiling(1 << 20);
+}
+
+/*
+    Memory access attribution (perf script lines of samples over tick records)
+*/
+
+void attribution(size_t _samples) {
+    auto ticks = vector<tick>(1 << 16);
+    auto lines = string{};
+    for (auto i = size_t{0}; i < _samples; ++i) {
+        const auto addr = reinterpret_cast<uintptr_t>(ticks.data()) + (i * 7919) % (ticks.size() * sizeof(tick));
+        auto line = stringstream{};
+        line << "  " << hex << addr << dec << "  " << 20 + i % 200 << "  68100142 |OP LOAD|LVL " << (i % 3 ? "L1 hit" : "L3 hit") << "|SNP None|TLB L1 or L2 hit|LCK No\n";
+        lines += line.str();
+    }
+
+    run("perf/add_perf_script/series/samples:" + to_string(_samples), 10, 9, [&] {
+        auto profile = access_profile{};
+        profile.add_region<tick>(reinterpret_cast<uintptr_t>(ticks.data()), ticks.size());
+        auto in = stringstream{lines};
+        keep(profile.add_perf_script(in));
+    });
+}
+
+void attributions() {
+    attribution(1 << 16);
+}
+
+/*
+    Shared bit-fields (every thread updates its own bit-field of the same status word)
+*/
+
+void contention(size_t _updates) {
+    auto pool   = thread_pool{4};
+    auto shared = status{};
+    auto lock   = mutex{};
+    const auto suffix = "/updates:" + to_string(_updates) + "/threads:" + to_string(pool.size());
+
+    run("shared_bits/mutex" + suffix, 10, 9, [&] {
+        pool.run(pool.size(), [&](size_t _task) {
+            for (auto i = 0u; i < _updates / pool.size(); ++i) {
+                auto guard = lock_guard<mutex>{lock};
+                switch (_task % 3) {
+                    case 0:  shared.state   = i & 15;             break;
+                    case 1:  shared.retries = shared.retries + 1; break;
+                    default: shared.flags   = shared.flags | (1u << (i & 15)); break;
+                }
+            }
+        });
+        keep(shared.retries);
+    });
+    run("shared_bits/atomic_bits" + suffix, 10, 9, [&] {
+        const auto fields = array<atomic_bits, 3>{ make_atomic_bits<status>("state"), make_atomic_bits<status>("retries"), make_atomic_bits<status>("flags") };
+        pool.run(pool.size(), [&](size_t _task) {
+            const auto& field = fields[_task % 3];
+            for (auto i = 0u; i < _updates / pool.size(); ++i) {
+                switch (_task % 3) {
+                    case 0: {
+                        field.store(&shared, i & 15);
+                        break;
+                    }
+                    case 1: {
+                        auto expected = field.load(&shared);
+                        while (!field.compare_exchange(&shared, expected, expected + 1)) {
+                        }
+                        break;
+                    }
+                    default: {
+                        field.fetch_or(&shared, 1u << (i & 15));
+                        break;
+                    }
+                }
+            }
+        });
+        keep(shared.retries);
+    });
+}
+
+void contenders() {
+    contention(1 << 20);
+}
+
+/*
+    Columnar compression
+*/
+
+void columnar(size_t _count) {
+    auto ticks = vector<tick>(_count);
+    for (auto i = 0u; i < _count; ++i) {
+        ticks[i] = tick{ 1600000000000 + i * 250 + i % 7, 100.0 + (i % 64) * 0.25, static_cast<int32_t>(100 * (1 + i % 5)), (i / 32) % 2 == 0, static_cast<uint8_t>(i % 3) };
+    }
+    const auto suffix = "/series/records:" + to_string(_count);
+
+    auto buffer = vector<uint8_t>{};
+    run("compress" + suffix, 10, 9, [&] {
+        buffer.clear();
+        compress(ticks.data(), ticks.size(), buffer);
+        keep(buffer.size());
+    });
+    auto out = vector<tick>{};
+    run("decompress" + suffix, 10, 9, [&] {
+        keep(decompress(buffer.data(), buffer.size(), out));
+    });
+}
+
+void compressors() {
+    columnar(65536);
+}
+
+/*
+    Incremental snapshots
+*/
+
+void snapshots(size_t _rows, size_t _every) {
+    auto table  = vector<flat16<0>>(_rows);
+    auto dirty  = dirty_bitmap<flat16<0>>{ _rows };
+    auto buffer = vector<uint8_t>{};
+    const auto suffix = "/flat/fields:16/rows:" + to_string(_rows) + "/dirty_every:" + to_string(_every);
+
+    run("snapshot" + suffix, 100, 9, [&] {
+        for (auto row = size_t{0}; row < _rows; row += _every) {
+            ++table[row].f0;
+            dirty.mark(row, &flat16<0>::f0);
+        }
+        buffer.clear();
+        write_snapshot(table.data(), dirty, buffer);
+        keep(buffer.size());
+    });
+}
+
+void incrementals() {
+    snapshots(65536, 100);
+    snapshots(65536, 1);
+}
+
+/*
+    Pointer swizzling
+*/
+
+void swizzling(size_t _count) {
+    auto nodes = vector<node>(_count);
+    for (auto i = 0u; i < _count; ++i) {
+        nodes[i] = node{ i, i + 1 < _count ? &nodes[i + 1] : nullptr, { &nodes[i / 2], &nodes[(i * 7) % _count] } };
+    }
+    const auto suffix = "/nodes:" + to_string(_count);
+    auto begin = nodes.data(), end = nodes.data() + _count;
+
+    run("swizzle/round_trip/graph" + suffix, 1000, 9, [&] {
+        keep(swizzle(begin, _count, begin, end));
+        unswizzle(begin, _count);
+    });
+
+    swizzle(begin, _count, begin, end);
+    run("swizzle/relative_walk/graph" + suffix, 1000, 9, [&] {
+        auto sum = uint64_t{0};
+        for (const node* n = begin; n; n = relative(n->next)) {
+            sum += relative(n->children[1])->key;
+        }
+        keep(sum);
+    });
+}
+
+void swizzlers() {
+    swizzling(1024);
+    swizzling(65536);
+}
+
+} // namespace bench
+
+/*
+    Usage: bench [filter] [output.json]
+
+    Runs every case whose name contains 'filter' (all of them by default) and writes the
+    results as JSON to 'output.json' or to the standard output.
+*/
+
+int main(int _argc, char* _argv[]) {
+    if (_argc > 1) {
+        bench::filter() = _argv[1];
+    }
+
+    bench::registration(); // must run first; it populates the layouts used by the rest
+    bench::lookup();
+    bench::json();
+    bench::serializers();
+    bench::iovecs();
+    bench::offsets();
+    bench::ipc();
+    bench::projectors();
+    bench::pushdowns();
+    bench::sorters();
+    bench::aggregators();
+    bench::accessors();
+    bench::attributions();
+    bench::contenders();
+    bench::profilers();
+    bench::swizzlers();
+    bench::compressors();
+    bench::incrementals();
+
+    if (_argc > 2) {
+        ofstream(_argv[2]) << bench::to_json();
+    } else {
+        cout << bench::to_json();
+    }
+    return 0;
+}
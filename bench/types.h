@@ -0,0 +1,142 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "map_layout.h"
+
+/*
+    Synthetic types of growing size and nesting depth
+
+    Every type takes an extra 'K' parameter so that many distinct classes (and hence many
+    distinct layouts) can be instantiated and registered from the same definition.
+*/
+
+#define BENCH_REP_4(M)  M(0)  M(1)  M(2)  M(3)
+#define BENCH_REP_16(M) BENCH_REP_4(M)  M(4)  M(5)  M(6)  M(7)  M(8)  M(9)  M(10) M(11) M(12) M(13) M(14) M(15)
+#define BENCH_REP_64(M) BENCH_REP_16(M) M(16) M(17) M(18) M(19) M(20) M(21) M(22) M(23) M(24) M(25) M(26) M(27) M(28) M(29) M(30) M(31) \
+                                        M(32) M(33) M(34) M(35) M(36) M(37) M(38) M(39) M(40) M(41) M(42) M(43) M(44) M(45) M(46) M(47) \
+                                        M(48) M(49) M(50) M(51) M(52) M(53) M(54) M(55) M(56) M(57) M(58) M(59) M(60) M(61) M(62) M(63)
+
+#define BENCH_NAMES_64  f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15, \
+                        f16, f17, f18, f19, f20, f21, f22, f23, f24, f25, f26, f27, f28, f29, f30, f31, \
+                        f32, f33, f34, f35, f36, f37, f38, f39, f40, f41, f42, f43, f44, f45, f46, f47, \
+                        f48, f49, f50, f51, f52, f53, f54, f55, f56, f57, f58, f59, f60, f61, f62, f63
+
+#define BENCH_DECL(_i)     pick_t<_i> f##_i;
+#define BENCH_DECL_BIT(_i) unsigned f##_i : (_i % 7) + 1;
+#define BENCH_REG(_i)      ML_REGISTER_FIELD(self, f##_i);
+#define BENCH_REG_BIT(_i)  ML_REGISTER_BITFIELD(self, f##_i);
+
+namespace bench {
+
+template<size_t I> using pick_t = std::tuple_element_t<I % 6, std::tuple<int, float, double, char, short, uint64_t>>;
+
+// flat classes with 4, 16 and 64 arithmetic fields
+
+template<size_t K> struct flat4  { BENCH_REP_4 (BENCH_DECL) };
+template<size_t K> struct flat16 { BENCH_REP_16(BENCH_DECL) };
+template<size_t K> struct flat64 { BENCH_REP_64(BENCH_DECL) };
+
+template<size_t K> void register_flat4 () { using self = flat4 <K>; BENCH_REP_4 (BENCH_REG) }
+template<size_t K> void register_flat16() { using self = flat16<K>; BENCH_REP_16(BENCH_REG) }
+template<size_t K> void register_flat64() { using self = flat64<K>; BENCH_REP_64(BENCH_REG) }
+
+// same as flat64 but registered with a single bulk macro
+
+template<size_t K> struct bulk64 { BENCH_REP_64(BENCH_DECL) };
+
+template<size_t K> void register_bulk64() { using self = bulk64<K>; ML_REGISTER_FIELDS(self, BENCH_NAMES_64); }
+
+// 16 packed bit-fields of widths 1..7
+
+template<size_t K> struct bits16 { BENCH_REP_16(BENCH_DECL_BIT) };
+
+template<size_t K> void register_bits16() { using self = bits16<K>; BENCH_REP_16(BENCH_REG_BIT) }
+
+// nesting: nest_t<D> is pair<pair<...pair<int, int>..., int>, int> of depth D
+
+template<size_t D> struct nest         { using type = std::pair<typename nest<D - 1>::type, int>; };
+template<>         struct nest<0>      { using type = int; };
+template<size_t D> using  nest_t       = typename nest<D>::type;
+
+template<size_t D, size_t K> struct nested { nest_t<D> v; };
+
+template<size_t D, size_t K> void register_nested() { using self = nested<D, K>; ML_REGISTER_FIELD(self, v); }
+
+// arrays of growing size
+
+template<size_t N, size_t K> struct arrayed { std::array<int, N> v; };
+
+template<size_t N, size_t K> void register_arrayed() { using self = arrayed<N, K>; ML_REGISTER_FIELD(self, v); }
+
+// variable-length and tagged members
+
+struct message {
+    int                id;
+    double             value;
+    std::vector<float> samples;
+    std::string        name;
+    std::optional<int> extra;
+};
+
+inline void register_message() {
+    ML_REGISTER_FIELD(message, id);
+    ML_REGISTER_FIELD(message, value);
+    ML_REGISTER_FIELD(message, samples);
+    ML_REGISTER_FIELD(message, name);
+    ML_REGISTER_FIELD(message, extra);
+}
+
+// time series sample
+
+struct tick {
+    int64_t  time;
+    double   price;
+    int32_t  quantity;
+    bool     buy;
+    uint8_t  venue;
+};
+
+inline void register_tick() {
+    ML_REGISTER_FIELD(tick, time);
+    ML_REGISTER_FIELD(tick, price);
+    ML_REGISTER_FIELD(tick, quantity);
+    ML_REGISTER_FIELD(tick, buy);
+    ML_REGISTER_FIELD(tick, venue);
+}
+
+// status word shared between threads
+
+struct status {
+    uint32_t state   : 4;
+    uint32_t retries : 12;
+    uint32_t flags   : 16;
+};
+
+inline void register_status() {
+    ML_REGISTER_BITFIELD(status, state);
+    ML_REGISTER_BITFIELD(status, retries);
+    ML_REGISTER_BITFIELD(status, flags);
+}
+
+// graph nodes linked by pointers
+
+struct node {
+    uint64_t key;
+    node*    next;
+    node*    children[2];
+};
+
+inline void register_node() {
+    ML_REGISTER_FIELD(node, key);
+    ML_REGISTER_FIELD(node, next);
+    ML_REGISTER_FIELD(node, children);
+}
+
+} // namespace bench
@@ -0,0 +1,62 @@
+#include <iostream>
+#include <fstream>
+#include <array>
+#include <utility>
+
+#include "map_layout.h"
+#include "map_layout_codegen.h"
+
+using namespace std;
+using namespace qcstudio::map_layout;
+
+/*
+    Code generation driver
+
+    Link (or include) the registered types and list them below; the generated header is
+    written to the file given as the first argument or to the standard output.
+*/
+
+struct quote_t {
+    int64_t  time;
+    double   bid, ask;
+    uint32_t bid_size, ask_size;
+    unsigned venue : 5;
+    unsigned side  : 1;
+    bool     last;
+};
+
+struct position {
+    pair<int, int>  cell;
+    array<float, 3> velocity;
+    quote_t         quote;
+};
+
+ML_GLOBAL_REGISTER_FIELD(quote_t, time);
+ML_GLOBAL_REGISTER_FIELD(quote_t, bid);
+ML_GLOBAL_REGISTER_FIELD(quote_t, ask);
+ML_GLOBAL_REGISTER_FIELD(quote_t, bid_size);
+ML_GLOBAL_REGISTER_FIELD(quote_t, ask_size);
+ML_GLOBAL_REGISTER_BITFIELD(quote_t, venue);
+ML_GLOBAL_REGISTER_BITFIELD(quote_t, side);
+ML_GLOBAL_REGISTER_FIELD(quote_t, last);
+
+ML_GLOBAL_REGISTER_FIELD(position, cell);
+ML_GLOBAL_REGISTER_FIELD(position, velocity);
+ML_GLOBAL_REGISTER_FIELD(position, quote);
+
+static void generate(ostream& _out) {
+    generate_prologue(_out, "generated");
+    generate_class<quote_t >(_out, "quote_t");
+    generate_class<position>(_out, "position");
+    generate_epilogue(_out, "generated");
+}
+
+int main(int _argc, char* _argv[]) {
+    if (_argc > 1) {
+        ofstream out(_argv[1]);
+        generate(out);
+    } else {
+        generate(cout);
+    }
+    return 0;
+}
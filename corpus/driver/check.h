@@ -0,0 +1,207 @@
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "map_layout.h"
+
+/*
+    Ground truth checks of generated layouts
+
+    For every generated type the corpus emits a 'check_cN' function that describes each
+    registered leaf from the compiler's point of view: the address of the member inside a
+    probe instance (offsetof for plain members), its sizeof and type, the bits that change
+    when a bit-field is set to all ones and the class id it was given. 'end' compares them
+    with the layout computed by the library, leaf by leaf.
+*/
+
+namespace corpus {
+using namespace std;
+using namespace qcstudio::map_layout;
+
+class checker {
+public:
+    template<typename T> void begin(const char* _name, uint32_t _id);
+    template<typename T, typename V> void leaf  (const char* _field, const char* _path, const T& _probe, const V& _member);
+    template<typename T, typename V> void nested(const char* _field, const char* _path, const T& _probe, const V& _member, uint32_t _id);
+    template<typename T, typename F> void bits  (const char* _field, F _set);
+    void end();
+
+    auto types () const -> size_t { return num_types;  }
+    auto fields() const -> size_t { return num_fields; }
+    auto leaves() const -> size_t { return num_leaves; }
+    auto errors() const -> size_t { return num_errors; }
+    auto bytes () const -> size_t { return num_bytes;  }
+
+    void report(ostream& _out, size_t _max) const;
+
+private:
+    struct expected {
+        item_category category;
+        size_t        first, last;
+        uint64_t      id;       // class id of nested classes
+        uint8_t       encoding; // size, sign and bool/real flags of arithmetic values (0WZZZYXX without W)
+        bool          matched;
+    };
+
+    template<typename V> static auto encoding_of() -> uint8_t;
+
+    void add(const char* _field, const char* _path, const expected& _leaf);
+    void flatten(const string& _key, const item_t& _item);
+    void fail(const string& _what);
+
+    const class_layout*     layout = nullptr;
+    string                  name;
+    uint32_t                id     = 0;
+    size_t                  size   = 0;
+    map<string, expected>   leaves_of;
+    vector<string>          messages;
+    size_t                  num_types = 0, num_fields = 0, num_leaves = 0, num_errors = 0, num_bytes = 0;
+};
+
+template<typename V>
+auto checker::encoding_of() -> uint8_t {
+    auto log2 = uint8_t{0};
+    while ((size_t{1} << log2) < sizeof(V)) {
+        ++log2;
+    }
+    const auto kind = is_same<V, bool>::value ? 0b00 : is_floating_point<V>::value ? 0b11 : 0b10; // chars are checked as integers
+    return static_cast<uint8_t>((log2 << 3) | (is_unsigned<V>::value ? 0b100 : 0) | kind);
+}
+
+template<typename T>
+void checker::begin(const char* _name, uint32_t _id) {
+    layout = &get_layout<T>();
+    name   = _name;
+    id     = _id;
+    size   = sizeof(T);
+    leaves_of.clear();
+    ++num_types;
+    for (auto& [file, line, error] : get_type_errors<T>()) {
+        fail("registration error at " + string{file} + "(" + to_string(line) + "): " + error);
+    }
+}
+
+template<typename T, typename V>
+void checker::leaf(const char* _field, const char* _path, const T& _probe, const V& _member) {
+    const auto offset = static_cast<size_t>(reinterpret_cast<const char*>(&_member) - reinterpret_cast<const char*>(&_probe));
+    auto leaf = expected{ is_pointer<V>::value ? item_category::pointer : item_category::arithmetic, offset * CHAR_BIT, (offset + sizeof(V)) * CHAR_BIT - 1, 0, 0, false };
+    if constexpr (is_arithmetic<V>::value) {
+        leaf.encoding = encoding_of<V>();
+    }
+    add(_field, _path, leaf);
+}
+
+template<typename T, typename V>
+void checker::nested(const char* _field, const char* _path, const T& _probe, const V& _member, uint32_t _id) {
+    const auto offset = static_cast<size_t>(reinterpret_cast<const char*>(&_member) - reinterpret_cast<const char*>(&_probe));
+    add(_field, _path, { item_category::klass, offset * CHAR_BIT, (offset + sizeof(V)) * CHAR_BIT - 1, _id, 0, false });
+}
+
+template<typename T, typename F>
+void checker::bits(const char* _field, F _set) {
+    auto probe = make_unique<T>();
+    auto bytes = reinterpret_cast<const unsigned char*>(probe.get());
+    memset(static_cast<void*>(probe.get()), 0, sizeof(T));
+    _set(*probe);
+
+    auto first = ~size_t{0}, last = size_t{0}, count = size_t{0};
+    for (auto bit = size_t{0}; bit < sizeof(T) * CHAR_BIT; ++bit) {
+        if (bytes[bit / CHAR_BIT] & (1u << (bit % CHAR_BIT))) {
+            first = min(first, bit);
+            last  = bit;
+            ++count;
+        }
+    }
+    if (!count || count != last - first + 1) {
+        fail(string{_field} + ": the bit-field does not map to a single run of bits");
+        return;
+    }
+    add(_field, "", { item_category::bitfield, first, last, 0, 0, false });
+}
+
+inline void checker::add(const char* _field, const char* _path, const expected& _leaf) {
+    leaves_of[string{_field} + _path] = _leaf;
+}
+
+inline void checker::fail(const string& _what) {
+    ++num_errors;
+    messages.push_back(name + ": " + _what);
+}
+
+inline void checker::flatten(const string& _key, const item_t& _item) {
+    if (_item.category == item_category::container) {
+        for (auto i = 0u; i < _item.data.container.count; ++i) {
+            flatten(_key + "[" + to_string(i) + "]", _item.data.container.items[i]);
+        }
+        return;
+    }
+
+    ++num_leaves;
+    auto it = leaves_of.find(_key);
+    if (it == leaves_of.end()) {
+        fail(_key + ": unexpected leaf");
+        return;
+    }
+    auto& leaf = it->second;
+    leaf.matched = true;
+    if (_item.category != leaf.category) {
+        fail(_key + ": category " + to_string(_item.category) + " instead of " + to_string(leaf.category));
+        return;
+    }
+    if (_item.ranges.size() != 2 || _item.ranges.front() != leaf.first || _item.ranges.back() != leaf.last) {
+        fail(_key + ": bits [" + to_string(_item.ranges.front()) + ", " + to_string(_item.ranges.back()) + "] instead of [" + to_string(leaf.first) + ", " + to_string(leaf.last) + "]");
+    }
+    if (leaf.category == item_category::arithmetic) {
+        const auto encoding = _item.data.encoded_arithmetic;
+        const auto kind     = encoding & 0b11;
+        const auto integer  = (leaf.encoding & 0b11) == 0b10 && kind == 0b01; // character types
+        if ((encoding & 0b111100) != (leaf.encoding & 0b111100) || (kind != (leaf.encoding & 0b11) && !integer)) {
+            fail(_key + ": arithmetic encoding " + to_string(encoding) + " instead of " + to_string(leaf.encoding));
+        }
+    }
+    if (leaf.category == item_category::klass && _item.data.klass.id != leaf.id) {
+        fail(_key + ": class id " + to_string(_item.data.klass.id) + " instead of " + to_string(leaf.id));
+    }
+}
+
+inline void checker::end() {
+    if (!layout->fields.empty() && layout->id != id) { // ids are stored along the first registered field
+        fail("class id " + to_string(layout->id) + " instead of " + to_string(id));
+    }
+    for (auto& [field, info] : layout->fields) {
+        ++num_fields;
+        flatten(field, info.item);
+    }
+
+    auto first = ~size_t{0}, last = size_t{0};
+    for (auto& [key, leaf] : leaves_of) {
+        if (!leaf.matched) {
+            fail(key + ": missing leaf");
+        }
+        first = min(first, leaf.first);
+        last  = max(last, leaf.last);
+    }
+    if (!leaves_of.empty() && (layout->firstbit != first || layout->lastbit != last || last >= size * CHAR_BIT)) {
+        fail("bounds [" + to_string(layout->firstbit) + ", " + to_string(layout->lastbit) + "] instead of [" + to_string(first) + ", " + to_string(last) + "] (sizeof " + to_string(size) + ")");
+    }
+    num_bytes += layout_bytes(*layout);
+}
+
+inline void checker::report(ostream& _out, size_t _max) const {
+    for (auto i = size_t{0}; i < messages.size() && i < _max; ++i) {
+        _out << messages[i] << "\n";
+    }
+    if (messages.size() > _max) {
+        _out << "... " << (messages.size() - _max) << " more\n";
+    }
+}
+
+} // namespace corpus
@@ -0,0 +1,53 @@
+#include <chrono>
+#include <iostream>
+
+#include "map_layout.h"
+#include "check.h"
+
+using namespace std;
+using namespace qcstudio::map_layout;
+
+/*
+    Corpus driver
+
+    Built together with the units written by the corpus generator, which define 'check_corpus'
+    and the types it verifies. Every layout is compared with the compiler's ground truth; the
+    mismatches go to the standard error and a summary is written as JSON to the standard
+    output. Returns 1 if any layout is wrong.
+*/
+
+void check_corpus(corpus::checker& _checker);
+void index_corpus();
+
+int main() {
+    using clock = chrono::steady_clock;
+    const auto ns = [](clock::duration _d) { return static_cast<long long>(chrono::duration_cast<chrono::nanoseconds>(_d).count()); };
+
+    auto checker = corpus::checker{};
+    const auto start   = clock::now();
+    check_corpus(checker);
+    const auto checked = clock::now();
+    index_corpus();
+    const auto indexed = clock::now();
+
+    auto registration_ns = uint64_t{0};
+    auto allocations     = size_t{0};
+    for (auto& stats : registry_stats()) {
+        registration_ns += stats.registration_ns;
+        allocations     += stats.allocations;
+    }
+
+    checker.report(cerr, 50);
+    cout << "{\n"
+         << "  \"types\" : "           << checker.types()  << ",\n"
+         << "  \"fields\" : "          << checker.fields() << ",\n"
+         << "  \"leaves\" : "          << checker.leaves() << ",\n"
+         << "  \"errors\" : "          << checker.errors() << ",\n"
+         << "  \"layout_bytes\" : "    << checker.bytes()  << ",\n"
+         << "  \"registration_ns\" : " << registration_ns  << ",\n" // 0 unless built with ML_ENABLE_STATS=1
+         << "  \"allocations\" : "     << allocations      << ",\n"
+         << "  \"check_ns\" : "        << ns(checked - start)   << ",\n"
+         << "  \"field_index_ns\" : "  << ns(indexed - checked) << "\n"
+         << "}\n";
+    return checker.errors() ? 1 : 0;
+}
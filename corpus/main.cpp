@@ -0,0 +1,435 @@
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+    Synthetic type corpus generator
+
+    Usage: corpus <output dir> [types = 2000] [seed = 1] [types per unit = 250]
+
+    Writes 'corpus_K.h' / 'corpus_K.cpp' pairs with the generated types and their
+    registrations and 'corpus_all.cpp' which runs them all; build them together with
+    'driver/driver.cpp' to verify every computed layout against the compiler (see
+    bench/corpus.sh). Types vary in:
+
+    - number of fields (1 to 200), nesting depth of pair/tuple/array members (0 to 3) and
+      size of arrays, including C arrays
+    - density of bit-fields (runs of them, with zero-width separators now and then)
+    - unions, whose members are registered one by one ("u3.a1")
+    - nested classes (earlier types), pointers and class ids (ML_REGISTER_CLASSID)
+    - registration macros: one per field (with and without user data) or bulk
+
+    The output only depends on the arguments.
+*/
+
+struct node {
+    enum kind_t { scalar, pointer, nested, pair_of, tuple_of, array_of } kind;
+    string       type;      // spelling of scalars, pointers and nested classes
+    uint32_t     id = 0;    // class id of nested classes
+    size_t       count = 0; // array size
+    vector<node> items;
+    size_t       bytes = 8; // upper bound of the size (every leaf taken as 8 aligned bytes)
+};
+
+struct member {
+    enum form_t { plain, c_array, bitfield, separator, union_of } form;
+    string         name;
+    node           type;                      // plain and c_array
+    size_t         count = 0;                 // c_array
+    string         bits_type;                 // bitfield
+    uint32_t       width = 0;
+    vector<string> alternatives;              // union member types, named a0, a1...
+    bool           registered = true;
+};
+
+struct klass {
+    string         name;
+    uint32_t       id = 0;
+    bool           bulk = false;
+    vector<member> members;
+    size_t         bytes = 0; // upper bound of the size
+};
+
+// nesting multiplies sizes; these bounds keep every class far from the 512 MB limit of the
+// layouts and the number of leaves (and the build time) reasonable
+
+constexpr auto max_nested_bytes = size_t{512};
+constexpr auto max_class_bytes  = size_t{16384};
+
+class generator {
+public:
+    explicit generator(uint32_t _seed) : rng(_seed) {}
+
+    void make(size_t _count);
+
+    void write_header(ostream& _out, size_t _first, size_t _last, size_t _unit);
+    void write_unit  (ostream& _out, size_t _first, size_t _last, size_t _unit);
+
+private:
+    // uniform integer in [0, _n) independent of the standard library implementation
+    auto pick(size_t _n) -> size_t { return static_cast<size_t>(rng() % _n); }
+    auto chance(uint32_t _percent) -> bool { return pick(100) < _percent; }
+
+    auto make_class(size_t _idx) -> klass;
+    auto make_node(size_t _depth) -> node;
+    auto spell(const node& _node) -> string;
+    void leaves(ostream& _out, const string& _field, const string& _path, const string& _expr, const node& _node);
+
+    mt19937       rng;
+    vector<klass> types; // the ones made so far can be nested in the next ones
+};
+
+static const char* scalars[] = {
+    "bool", "char", "int8_t", "uint8_t", "int16_t", "uint16_t", "int32_t", "uint32_t", "int64_t", "uint64_t",
+    "float", "double", "char16_t", "char32_t", "wchar_t", "long", "unsigned short"
+};
+
+static const char* pointees[] = { "int", "double", "char", "const char", "void" };
+
+static const pair<const char*, uint32_t> bit_types[] = { // underlying type and maximum width
+    { "uint8_t", 8 }, { "uint16_t", 16 }, { "uint32_t", 32 }, { "int32_t", 32 }, { "int16_t", 16 }, { "unsigned", 32 }, { "bool", 1 }
+};
+
+auto generator::make_node(size_t _depth) -> node {
+    const auto roll = pick(100);
+    if (_depth > 0 && roll < 30) {
+        auto ret = node{};
+        switch (pick(3)) {
+            case 0: {
+                ret.kind  = node::pair_of;
+                ret.items = { make_node(_depth - 1), make_node(_depth - 1) };
+                ret.bytes = ret.items[0].bytes + ret.items[1].bytes;
+                break;
+            }
+            case 1: {
+                ret.kind  = node::tuple_of;
+                ret.bytes = 0;
+                for (auto i = pick(4) + 1; i > 0; --i) {
+                    ret.items.push_back(make_node(_depth - 1));
+                    ret.bytes += ret.items.back().bytes;
+                }
+                break;
+            }
+            default: {
+                ret.kind  = node::array_of;
+                ret.count = pick(6) + 1;
+                ret.items = { make_node(_depth - 1) };
+                ret.bytes = ret.count * ret.items[0].bytes;
+                break;
+            }
+        }
+        return ret;
+    }
+    if (roll < 38 && !types.empty()) {
+        const auto& other = types[types.size() - 1 - pick(min(types.size(), size_t{64}))];
+        if (other.bytes <= max_nested_bytes) {
+            return { node::nested, other.name, other.id, 0, {}, other.bytes };
+        }
+    }
+    if (roll < 44) {
+        const auto pointee = chance(30) && !types.empty() ? types[pick(types.size())].name : string{pointees[pick(size(pointees))]};
+        return { node::pointer, pointee + "*", 0, 0, {}, 8 };
+    }
+    return { node::scalar, scalars[pick(size(scalars))], 0, 0, {}, 8 };
+}
+
+auto generator::spell(const node& _node) -> string {
+    switch (_node.kind) {
+        case node::pair_of: {
+            return "std::pair<" + spell(_node.items[0]) + ", " + spell(_node.items[1]) + ">";
+        }
+        case node::tuple_of: {
+            auto ret = string{"std::tuple<"};
+            for (auto i = 0u; i < _node.items.size(); ++i) {
+                ret += (i ? ", " : "") + spell(_node.items[i]);
+            }
+            return ret + ">";
+        }
+        case node::array_of: {
+            return "std::array<" + spell(_node.items[0]) + ", " + to_string(_node.count) + ">";
+        }
+        default: {
+            return _node.type;
+        }
+    }
+}
+
+void generator::make(size_t _count) {
+    types.reserve(_count);
+    while (types.size() < _count) {
+        types.push_back(make_class(types.size()));
+    }
+}
+
+auto generator::make_class(size_t _idx) -> klass {
+    auto ret = klass{};
+    ret.name = "c" + to_string(_idx);
+    ret.id   = chance(30) ? 0x20000000u + static_cast<uint32_t>(_idx) : 0;
+    ret.bulk = chance(40);
+
+    // field counts are skewed towards small types with a long tail
+
+    const auto bucket = pick(100);
+    const auto fields = bucket < 40 ? pick(6) + 1 : bucket < 75 ? pick(14) + 7 : bucket < 95 ? pick(44) + 21 : pick(136) + 65;
+    const auto depth  = pick(4);
+    const auto bits   = array<uint32_t, 4>{ 0, 10, 30, 70 }[pick(4)]; // percentage of bit-field runs
+
+    for (auto i = size_t{0}; ret.members.size() < fields && ret.bytes < max_class_bytes; ++i) {
+        auto m = member{};
+        m.name       = "f" + to_string(i);
+        m.registered = !chance(8);
+        if (chance(bits)) {
+            for (auto run = pick(5) + 1; run > 0 && ret.members.size() < fields; --run) {
+                if (chance(5)) {
+                    ret.members.push_back({ member::separator, "", {}, 0, "unsigned", 0, {}, false });
+                }
+                const auto& [type, max_width] = bit_types[pick(size(bit_types))];
+                m.form      = member::bitfield;
+                m.bits_type = type;
+                m.width     = static_cast<uint32_t>(pick(max_width) + 1);
+                ret.members.push_back(m);
+                ret.bytes   += 8;
+                m.name       = "f" + to_string(++i);
+                m.registered = !chance(8);
+            }
+            continue;
+        }
+        if (chance(5)) {
+            m.form = member::union_of;
+            m.name = "u" + to_string(i);
+            for (auto n = pick(3) + 2; n > 0; --n) {
+                m.alternatives.push_back(scalars[pick(size(scalars))]);
+            }
+        } else if (chance(10)) {
+            m.form  = member::c_array;
+            m.count = pick(8) + 1;
+            m.type  = make_node(depth > 0 ? depth - 1 : 0);
+        } else {
+            m.form = member::plain;
+            m.type = make_node(depth);
+        }
+        const auto bytes = m.form == member::union_of ? 8 : m.form == member::c_array ? m.count * m.type.bytes : m.type.bytes;
+        if (bytes > max_class_bytes) {
+            m.form = member::plain;
+            m.type = { node::scalar, "double", 0, 0, {}, 8 };
+        }
+        ret.bytes += min(bytes, max_class_bytes);
+        ret.members.push_back(m);
+    }
+    return ret;
+}
+
+void generator::write_header(ostream& _out, size_t _first, size_t _last, size_t _unit) {
+    _out << "#pragma once\n\n";
+    _out << "#include <array>\n#include <cstdint>\n#include <tuple>\n#include <utility>\n\n";
+    _out << (_unit ? "#include \"corpus_" + to_string(_unit - 1) + ".h\"\n\n" : "#include \"map_layout.h\"\n\n");
+
+    for (auto i = _first; i < _last; ++i) {
+        auto& k = types[i];
+        _out << "struct " << k.name << " {\n";
+        for (auto& m : k.members) {
+            switch (m.form) {
+                case member::plain:     _out << "    " << spell(m.type) << " " << m.name << ";\n";                          break;
+                case member::c_array:   _out << "    " << spell(m.type) << " " << m.name << "[" << m.count << "];\n";       break;
+                case member::bitfield:  _out << "    " << m.bits_type << " " << m.name << " : " << m.width << ";\n";        break;
+                case member::separator: _out << "    unsigned : 0;\n";                                                      break;
+                case member::union_of: {
+                    _out << "    union {";
+                    for (auto a = 0u; a < m.alternatives.size(); ++a) {
+                        _out << " " << m.alternatives[a] << " a" << a << ";";
+                    }
+                    _out << " } " << m.name << ";\n";
+                    break;
+                }
+            }
+        }
+        _out << "};\n";
+        if (k.id) {
+            _out << "ML_REGISTER_CLASSID(" << k.name << ", 0x" << hex << k.id << dec << ");\n";
+        }
+        _out << "\n";
+    }
+}
+
+void generator::leaves(ostream& _out, const string& _field, const string& _path, const string& _expr, const node& _node) {
+    switch (_node.kind) {
+        case node::pair_of: {
+            leaves(_out, _field, _path + "[0]", _expr + ".first",  _node.items[0]);
+            leaves(_out, _field, _path + "[1]", _expr + ".second", _node.items[1]);
+            break;
+        }
+        case node::tuple_of: {
+            for (auto i = 0u; i < _node.items.size(); ++i) {
+                leaves(_out, _field, _path + "[" + to_string(i) + "]", "std::get<" + to_string(i) + ">(" + _expr + ")", _node.items[i]);
+            }
+            break;
+        }
+        case node::array_of: {
+            for (auto i = 0u; i < _node.count; ++i) {
+                leaves(_out, _field, _path + "[" + to_string(i) + "]", _expr + "[" + to_string(i) + "]", _node.items[0]);
+            }
+            break;
+        }
+        case node::nested: {
+            _out << "    _c.nested(\"" << _field << "\", \"" << _path << "\", p, " << _expr << ", 0x" << hex << _node.id << dec << ");\n";
+            break;
+        }
+        default: {
+            _out << "    _c.leaf(\"" << _field << "\", \"" << _path << "\", p, " << _expr << ");\n";
+            break;
+        }
+    }
+}
+
+void generator::write_unit(ostream& _out, size_t _first, size_t _last, size_t _unit) {
+    _out << "#include \"corpus_" << _unit << ".h\"\n#include \"map_layout_index.h\"\n#include \"check.h\"\n\n";
+
+    // registrations
+
+    for (auto i = _first; i < _last; ++i) {
+        auto& k = types[i];
+        auto fields = vector<string>{}, bitfields = vector<string>{};
+        for (auto& m : k.members) {
+            if (!m.registered) {
+                continue;
+            }
+            if (m.form == member::union_of) {
+                for (auto a = 0u; a < m.alternatives.size(); ++a) {
+                    fields.push_back(m.name + ".a" + to_string(a));
+                }
+            } else if (m.form == member::bitfield) {
+                bitfields.push_back(m.name);
+            } else if (m.form != member::separator) {
+                fields.push_back(m.name);
+            }
+        }
+        for (auto& [names, macro] : { make_pair(&fields, string{"FIELD"}), make_pair(&bitfields, string{"BITFIELD"}) }) {
+            if (names->empty()) {
+                continue;
+            }
+            if (k.bulk) {
+                _out << "ML_GLOBAL_REGISTER_" << macro << "S(" << k.name;
+                for (auto& n : *names) {
+                    _out << ", " << n;
+                }
+                _out << ");\n";
+            } else {
+                for (auto& n : *names) {
+                    _out << "ML_GLOBAL_REGISTER_" << macro << "(" << k.name << ", " << n << (chance(10) ? ", " + to_string(pick(1000)) : "") << ");\n";
+                }
+            }
+        }
+        _out << "\n";
+    }
+
+    // ground truth
+
+    for (auto i = _first; i < _last; ++i) {
+        auto& k = types[i];
+        auto body = ostringstream{};
+        for (auto& m : k.members) {
+            if (!m.registered) {
+                continue;
+            }
+            switch (m.form) {
+                case member::plain: {
+                    leaves(body, m.name, "", "p." + m.name, m.type);
+                    break;
+                }
+                case member::c_array: {
+                    for (auto e = 0u; e < m.count; ++e) {
+                        leaves(body, m.name, "[" + to_string(e) + "]", "p." + m.name + "[" + to_string(e) + "]", m.type);
+                    }
+                    break;
+                }
+                case member::bitfield: {
+                    const auto set = m.bits_type == "bool" ? string{"true"} : "~_o." + m.name;
+                    body << "    _c.bits<" << k.name << ">(\"" << m.name << "\", [](" << k.name << "& _o) { _o." << m.name << " = " << set << "; });\n";
+                    break;
+                }
+                case member::union_of: {
+                    for (auto a = 0u; a < m.alternatives.size(); ++a) {
+                        const auto name = m.name + ".a" + to_string(a);
+                        body << "    _c.leaf(\"" << name << "\", \"\", p, p." << name << ");\n";
+                    }
+                    break;
+                }
+                default: {
+                    break;
+                }
+            }
+        }
+        _out << "static void check_" << k.name << "(corpus::checker& _c) {\n";
+        if (body.str().find(", p, ") != string::npos) {
+            _out << "    static const " << k.name << " p{};\n";
+        }
+        _out << "    _c.begin<" << k.name << ">(\"" << k.name << "\", 0x" << hex << k.id << dec << ");\n";
+        _out << body.str();
+        _out << "    _c.end();\n}\n\n";
+    }
+
+    _out << "void check_corpus_" << _unit << "(corpus::checker& _c) {\n";
+    for (auto i = _first; i < _last; ++i) {
+        _out << "    check_" << types[i].name << "(_c);\n";
+    }
+    _out << "}\n\n";
+
+    _out << "void index_corpus_" << _unit << "() {\n";
+    for (auto i = _first; i < _last; ++i) {
+        _out << "    qcstudio::map_layout::get_field_index<" << types[i].name << ">();\n";
+    }
+    _out << "}\n";
+}
+
+int main(int _argc, char* _argv[]) {
+    if (_argc < 2) {
+        cerr << "usage: corpus <output dir> [types = 2000] [seed = 1] [types per unit = 250]\n";
+        return 1;
+    }
+    const auto dir      = string{_argv[1]} + "/";
+    const auto count    = static_cast<size_t>(_argc > 2 ? strtoull(_argv[2], nullptr, 10) : 2000);
+    const auto seed     = static_cast<uint32_t>(_argc > 3 ? strtoul(_argv[3], nullptr, 10) : 1);
+    const auto per_unit = static_cast<size_t>(_argc > 4 ? max(strtoull(_argv[4], nullptr, 10), 1ull) : 250);
+
+    auto gen = generator{seed};
+    gen.make(count);
+
+    const auto units = (count + per_unit - 1) / per_unit;
+    for (auto u = size_t{0}; u < units; ++u) {
+        const auto first = u * per_unit, last = min(first + per_unit, count);
+        auto header = ofstream(dir + "corpus_" + to_string(u) + ".h");
+        auto unit   = ofstream(dir + "corpus_" + to_string(u) + ".cpp");
+        gen.write_header(header, first, last, u);
+        gen.write_unit  (unit,   first, last, u);
+        if (!header || !unit) {
+            cerr << "cannot write to " << dir << "\n";
+            return 1;
+        }
+    }
+
+    auto all = ofstream(dir + "corpus_all.cpp");
+    all << "#include \"check.h\"\n\n";
+    for (auto u = size_t{0}; u < units; ++u) {
+        all << "void check_corpus_" << u << "(corpus::checker& _c);\nvoid index_corpus_" << u << "();\n";
+    }
+    all << "\nvoid check_corpus(corpus::checker& _c) {\n";
+    for (auto u = size_t{0}; u < units; ++u) {
+        all << "    check_corpus_" << u << "(_c);\n";
+    }
+    all << "}\n\nvoid index_corpus() {\n";
+    for (auto u = size_t{0}; u < units; ++u) {
+        all << "    index_corpus_" << u << "();\n";
+    }
+    all << "}\n";
+
+    cout << count << " types in " << units << " units written to " << dir << "\n";
+    return all ? 0 : 1;
+}
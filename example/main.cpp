@@ -7,8 +7,12 @@
 #include <array>
 #include <tuple>
 #include <utility>
+#include <string>
+#include <optional>
+#include <variant>
 
 #include "map_layout.h"
+#include "map_layout_serializer.h"
 #include "tojson.h"
 
 using namespace std;
@@ -196,6 +200,19 @@ struct all_mixed {
 
 ML_REGISTER_CLASSID(all_mixed, 0xABAC0);
 
+/*
+    With variable-length and tagged members
+*/
+
+struct with_dynamic {
+    int a;
+    vector<float> b;
+    string c;
+    optional<double> d;
+    variant<int, string> e;
+    pair<short, vector<string>> f;
+};
+
 /*
     GLOBAL registration
 */
@@ -295,6 +312,13 @@ ML_GLOBAL_REGISTER_FIELD(all_mixed, k);
 ML_GLOBAL_REGISTER_FIELD(all_mixed, l);
 ML_GLOBAL_REGISTER_FIELD(all_mixed, m);
 
+ML_GLOBAL_REGISTER_FIELD(with_dynamic, a);
+ML_GLOBAL_REGISTER_FIELD(with_dynamic, b);
+ML_GLOBAL_REGISTER_FIELD(with_dynamic, c);
+ML_GLOBAL_REGISTER_FIELD(with_dynamic, d);
+ML_GLOBAL_REGISTER_FIELD(with_dynamic, e);
+ML_GLOBAL_REGISTER_FIELD(with_dynamic, f);
+
 /*
     Invoke the registry from within a function
 */
@@ -328,6 +352,7 @@ int main () {
         ,all_mixed
         ,anonymous_struct
         ,identified_struct
+        ,with_dynamic
     >();
 
     for (auto& [file, line, err] : gather_all_errors<
@@ -346,9 +371,27 @@ int main () {
         ,all_mixed
         ,anonymous_struct
         ,identified_struct
+        ,with_dynamic
     >()) {
         cout << file << "(" << line << "): " << err << "\n";
     }
 
+    /*
+        Serialize an object with variable-length members and read it back
+    */
+
+    auto src = with_dynamic{ 1, { 2.0f, 3.0f }, "four", 5.0, string{"six"}, { 7, { "eight", "nine" } } };
+    auto buffer = vector<uint8_t>{};
+    serialize(src, buffer);
+
+    auto dst = with_dynamic{};
+    auto consumed = deserialize(buffer.data(), buffer.size(), dst);
+    auto same = consumed == buffer.size() && dst.a == src.a && dst.b == src.b && dst.c == src.c && dst.d == src.d && dst.e == src.e && dst.f == src.f;
+    cout << "with_dynamic round trip: " << buffer.size() << " bytes, " << (same ? "ok" : "FAILED") << "\n";
+
+#if ML_ENABLE_STATS
+    dump_registry_stats(cerr);
+#endif
+
     return 0;
 }
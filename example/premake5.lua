@@ -37,7 +37,7 @@ workspace "example"
     filter { "platforms:*64"                 } architecture "x86_64"
     filter { "system:macosx", "action:gmake" } toolset "clang"
     filter { "system:windows", "action:vs*"  } buildoptions { "/W3", "/EHsc" }
-    filter { "system:linux"                  } links "pthread"
+    filter { "system:linux"                  } links { "pthread", "rt" }
     filter { "toolset:clang or toolset:gcc"  } buildoptions { "-Wall", "-Wextra", "-fno-exceptions", "-msse4.2" }
     filter { }
 
@@ -50,6 +50,32 @@ project "example"
 
     files { "*.cpp", "*.h", "../include/*.h" }
 
+project "bench"
+    kind "ConsoleApp"
+
+    includedirs { "../include", "." }
+    targetdir ".out/%{prj.name}/%{cfg.platform}/%{cfg.buildcfg}"
+    objdir ".tmp/%{prj.name}"
+
+    files { "../bench/*.cpp", "../bench/*.h", "tojson.cpp", "tojson.h", "../include/*.h" }
+
+project "codegen"
+    kind "ConsoleApp"
+
+    includedirs { "../include" }
+    targetdir ".out/%{prj.name}/%{cfg.platform}/%{cfg.buildcfg}"
+    objdir ".tmp/%{prj.name}"
+
+    files { "../codegen/*.cpp", "../codegen/*.h", "../include/*.h" }
+
+project "corpus"
+    kind "ConsoleApp"
+
+    targetdir ".out/%{prj.name}/%{cfg.platform}/%{cfg.buildcfg}"
+    objdir ".tmp/%{prj.name}"
+
+    files { "../corpus/*.cpp" }
+
 -- Handle Dropbox annoying sync of temporary folders
 
 if os.target() == "windows" then
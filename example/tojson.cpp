@@ -11,6 +11,8 @@ auto to_string(item_category _category) -> const char* {
         case pointer:    return "pointer";
         case klass:      return "klass";
         case container:  return "container";
+        case dynamic:    return "dynamic";
+        case tagged:     return "tagged";
     }
     return "unknown";
 }
@@ -85,13 +87,21 @@ auto to_json(const qcstudio::map_layout::item_t& _item) -> std::string {
             break;
         }
         case item_category::klass: {
-            out << quote("id") << " : " << _item.data.id << ", " << cr();
+            out << quote("id") << " : " << _item.data.klass.id << ", " << cr();
             break;
         }
         case item_category::container: {
             out << quote("num_items") << " : " << _item.data.container.count << ", " << cr();
             break;
         }
+        case item_category::dynamic: {
+            out << quote("element_bytes") << " : " << _item.data.dynamic.ops->elem_size << ", " << cr();
+            break;
+        }
+        case item_category::tagged: {
+            out << quote("num_alternatives") << " : " << _item.data.tagged.ops->count << ", " << cr();
+            break;
+        }
     }
 
     const auto nranges = _item.ranges.size();
@@ -128,6 +138,35 @@ auto to_json(const qcstudio::map_layout::item_t& _item) -> std::string {
         }
         out << cr()-- << "]";
     }
+
+    if (_item.category == item_category::dynamic) {
+        out << ", " << cr();
+        out << quote("element") << " : " << cr();
+        out << "{" << cr()++;
+        out << to_json(*_item.data.dynamic.elem);
+        out << cr()-- << "}";
+    }
+
+    if (_item.category == item_category::tagged) {
+        out << ", " << cr();
+        out << quote("alternatives") << " : " << cr();
+        out << "[" << cr()++;
+        for (auto i = 0u; i < _item.data.tagged.ops->count; ++i) {
+            out << "{" << cr()++;
+            out << to_json(_item.data.tagged.items[i]);
+            out << cr()-- << "}";
+            if (i != _item.data.tagged.ops->count - 1) {
+                out << ", " << cr();
+            }
+        }
+        out << cr()-- << "]";
+    }
+    return out.str();
+}
+
+static auto to_hex(uint64_t _value) -> string {
+    stringstream out;
+    out << "0x" << hex << _value;
     return out.str();
 }
 
@@ -138,6 +177,7 @@ auto to_json(const qcstudio::map_layout::class_layout& _layout) -> std::string {
         out << quote(_layout.name) << " : " << cr();
         out << "{" << cr()++;
             out << quote("id") << " : " << dec << _layout.id << ", " << cr();
+            out << quote("fingerprint") << " : " << quote(to_hex(layout_fingerprint(_layout))) << ", " << cr();
             out << quote("fields") << " : " << cr();
             out << "{" << cr()++;
             {
@@ -52,35 +52,24 @@ auto quote(const T& _data) -> std::string {
 
 auto to_json(const qcstudio::map_layout::class_layout& _layout) -> std::string;
 
-template<typename ...TS> struct type_iterator;
+inline void append_json(std::stringstream& _out, const qcstudio::map_layout::class_layout& _layout, bool _more) {
+    if (!_layout.name.empty()) {
+        _out << to_json(_layout);
+        if (_more) {
+            _out << ", " << cr();
+        }
+    }
+}
+
 template<typename ...TS>
 auto to_json() -> std::string {
     std::stringstream out;
     out << "{" << cr()++;
     out << quote("classes") << " : " << cr();
     out << "[" << cr()++;
-    type_iterator<TS...>()(out);
+    auto left = sizeof...(TS);
+    (append_json(out, qcstudio::map_layout::get_layout<TS>(), --left > 0), ...);
     out << cr()-- << "]";
     out << cr()-- << "}\n";
     return out.str();
 }
-
-template<>
-struct type_iterator<> {
-    void operator()(std::stringstream&) {
-    }
-};
-
-template<typename T, typename ...TS>
-struct type_iterator<T, TS...> {
-    void operator()(std::stringstream& _out) {
-        auto& layout = qcstudio::map_layout::get_layout<T>();
-        if (!layout.name.empty()) {
-            _out << to_json(layout);
-            if (sizeof...(TS)) {
-                _out << ", " << cr();
-            }
-        }
-        type_iterator<TS...>()(_out);
-    }
-};
@@ -35,6 +35,27 @@
 #include <functional>
 #include <cstring>
 #include <regex>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <optional>
+#include <variant>
+
+/*
+    Registry instrumentation is opt-in: define ML_ENABLE_STATS as 1 before including this header
+*/
+
+#ifndef ML_ENABLE_STATS
+#define ML_ENABLE_STATS 0
+#endif
+
+/*
+    Lazy registration is opt-in: define ML_LAZY_REGISTRATION as 1 before including this header
+*/
+
+#ifndef ML_LAZY_REGISTRATION
+#define ML_LAZY_REGISTRATION 0
+#endif
 
 namespace qcstudio {
 namespace map_layout {
@@ -45,7 +66,7 @@ using namespace std;
 */
 
 enum item_category {
-    undefined, arithmetic, bitfield, pointer, klass, container
+    undefined, arithmetic, bitfield, pointer, klass, container, dynamic, tagged
 };
 
 struct item_t;
@@ -54,20 +75,191 @@ struct container_t {
     item_t* items;
 };
 
+/*
+    Variable-length members (std::vector, std::string, ...)
+
+    The member itself is a fixed-size handle; its elements live in an out-of-line buffer that
+    is reached through 'view' and (re)allocated through 'resize'. 'elem' describes the layout
+    of a single element with ranges relative to the start of that element.
+*/
+
+struct dynamic_ops {
+    size_t elem_size;
+    auto (*view)  (const void* _field)            -> pair<const void*, size_t>; // buffer and element count
+    auto (*resize)(void* _field, size_t _count)  -> void*;                     // returns the new buffer
+};
+
+struct dynamic_t {
+    item_t*            elem;
+    const dynamic_ops* ops;
+};
+
+/*
+    Tagged members (std::optional, std::variant, ...)
+
+    At most one of 'count' alternatives is active at a time; 'index' returns which one (or
+    'tagged_npos' if none), 'get'/'emplace' give access to it and 'reset' deactivates it. The
+    layout of every alternative is described by 'items' with ranges relative to its start.
+*/
+
+constexpr auto tagged_npos = numeric_limits<size_t>::max();
+
+struct tagged_ops {
+    size_t                     count;
+    const size_t*              sizes;
+    auto (*index)(const void* _field) -> size_t;
+    auto (* const* get)(const void* _field) -> const void*;
+    auto (* const* emplace)(void* _field) -> void*;
+    void (*reset)(void* _field);
+};
+
+struct tagged_t {
+    item_t*           items;
+    const tagged_ops* ops;
+};
+
+/*
+    Nested classes
+
+    'id' is the class id as retrieved from 'id_of' and 'layout' returns the layout of the
+    nested class (its 'get_layout'), with ranges relative to the start of the member. It is
+    what lets fingerprints, serialization and pointer swizzling follow nested classes.
+*/
+
+struct class_layout;
+
+struct klass_t {
+    uint64_t id;
+    auto   (*layout)() -> const class_layout&;
+};
+
+/*
+    'range_list' holds the flattened [first, last] bit pairs of an item
+
+    Bit offsets are 32-bit wide (classes up to 512 MB) and up to two ranges, which covers
+    almost every item, are stored inline. Beyond that the values move to a heap block whose
+    pointer shares the inline storage and whose capacity is the next power of two.
+*/
+
+using bit_offset = uint32_t;
+
+class range_list {
+public:
+    static constexpr uint32_t inline_capacity = 4;
+
+    range_list() = default;
+    range_list(const range_list& _other) {
+        assign(_other);
+    }
+    range_list(range_list&& _other) noexcept {
+        count = _other.count;
+        memcpy(words, _other.words, sizeof(words));
+        _other.count = 0;
+    }
+    auto operator=(const range_list& _other) -> range_list& {
+        if (this != &_other) {
+            release();
+            assign(_other);
+        }
+        return *this;
+    }
+    ~range_list() {
+        release();
+    }
+
+    auto size()     const -> size_t            { return count;                        }
+    auto empty()    const -> bool              { return count == 0;                   }
+    auto capacity() const -> size_t            { return capacity_for(count);          }
+    auto data()           -> bit_offset*       { return is_inline() ? words : heap(); }
+    auto data()     const -> const bit_offset* { return is_inline() ? words : heap(); }
+    auto begin()          -> bit_offset*       { return data();                       }
+    auto begin()    const -> const bit_offset* { return data();                       }
+    auto end()            -> bit_offset*       { return data() + count;               }
+    auto end()      const -> const bit_offset* { return data() + count;               }
+    auto front()          -> bit_offset&       { return data()[0];                    }
+    auto front()    const -> bit_offset        { return data()[0];                    }
+    auto back()           -> bit_offset&       { return data()[count - 1];            }
+    auto back()     const -> bit_offset        { return data()[count - 1];            }
+
+    auto operator[](size_t _idx)       -> bit_offset& { return data()[_idx]; }
+    auto operator[](size_t _idx) const -> bit_offset  { return data()[_idx]; }
+
+    void push_back(bit_offset _value) {
+        if (count == capacity_for(count)) {
+            auto block = new bit_offset[capacity_for(count + 1)];
+            memcpy(block, data(), count * sizeof(bit_offset));
+            release();
+            memcpy(words, &block, sizeof(block));
+            block[count++] = _value;
+            return;
+        }
+        data()[count++] = _value;
+    }
+
+private:
+    static auto capacity_for(uint32_t _count) -> uint32_t {
+        auto ret = inline_capacity;
+        while (ret < _count) {
+            ret <<= 1;
+        }
+        return ret;
+    }
+
+    auto is_inline() const -> bool {
+        return count <= inline_capacity;
+    }
+
+    auto heap() const -> bit_offset* {
+        bit_offset* ret;
+        memcpy(&ret, words, sizeof(ret));
+        return ret;
+    }
+
+    void assign(const range_list& _other) {
+        count = _other.count;
+        if (is_inline()) {
+            memcpy(words, _other.words, sizeof(words));
+        } else {
+            auto block = new bit_offset[capacity_for(count)];
+            memcpy(block, _other.heap(), count * sizeof(bit_offset));
+            memcpy(words, &block, sizeof(block));
+        }
+    }
+
+    void release() {
+        if (!is_inline()) {
+            delete[] heap();
+        }
+    }
+
+    static_assert(sizeof(bit_offset*) <= sizeof(bit_offset) * inline_capacity, "heap pointer must fit in the inline storage");
+
+    uint32_t   count = 0;
+    bit_offset words[inline_capacity] = {};
+};
+
 struct item_t {
-    item_category category = item_category::undefined;
     union {
         uint8_t     encoded_arithmetic; // 0WZZZYXX (XX: bool/char/integer/real; Y: signed/unsigned; ZZZ: 1/2/4/8/16; W: char|wchar_t / char*_t)
-        uint64_t    id;                 // class id as retrieved from 'id_of'
+        klass_t     klass;              // class id and layout (for nested classes)
         container_t container;          // num items (for indexable types)
+        dynamic_t   dynamic;            // element layout and buffer accessors (for variable-length types)
+        tagged_t    tagged;             // alternatives' layouts and accessors (for optional-like and variant-like types)
     } data;
-    vector<size_t> ranges;
+    range_list    ranges;               // note: declared after 'data' and before 'category' so that the three pack tightly
+    item_category category = item_category::undefined;
     item_t() = default;
     item_t(const item_t& _other) = default;
     ~item_t() {
         if (category == item_category::container && data.container.items) {
             delete[] data.container.items;
             data.container.items = nullptr;
+        } else if (category == item_category::dynamic && data.dynamic.elem) {
+            delete data.dynamic.elem;
+            data.dynamic.elem = nullptr;
+        } else if (category == item_category::tagged && data.tagged.items) {
+            delete[] data.tagged.items;
+            data.tagged.items = nullptr;
         }
     }
 };
@@ -82,6 +274,7 @@ struct class_layout {
     uint32_t                       id = 0;
     size_t                         firstbit, lastbit;
     map<const char*, field_info_t> fields;
+    bool                           trivially_copyable = true; // of the class itself, registered or not
 };
 
 /*
@@ -94,28 +287,57 @@ template<typename T>     auto get_layout()        -> const class_layout&;
 template<typename T>     auto get_type_errors()   -> const vector<error_entry>&; // file/line/error message
 template<typename ...TS> auto gather_all_errors() -> vector<error_entry>;
 
-template<typename ...TS> struct err_iterator;
 template<typename ...TS> auto gather_all_errors() -> vector<error_entry> {
     vector<error_entry> ret;
-    err_iterator<TS...>()(ret);
+    (ret.insert(ret.end(), get_type_errors<TS>().begin(), get_type_errors<TS>().end()), ...);
     return ret;
 }
 
-template<>
-struct err_iterator<> {
-    void operator()(vector<error_entry>&) {
-    }
-};
+/*
+    Registry instrumentation
 
-template<typename T, typename ...TS>
-struct err_iterator<T, TS...> {
-    void operator()(vector<error_entry>& _out) {
-        auto& errs = get_type_errors<T>();
-        std::copy(errs.begin(), errs.end(), std::back_inserter(_out));
-        err_iterator<TS...>()(_out);
-    }
+    When ML_ENABLE_STATS is 1, every registered class keeps track of the wall time spent in
+    its registration functions, the heap allocations made by the library for its layout and
+    the number of errors reported for it. 'registry_stats' returns a snapshot of all of them
+    (empty when ML_ENABLE_STATS is 0) and 'dump_registry_stats' prints it sorted by time.
+
+    'layout_bytes' estimates the heap and inline memory held by a layout and can be used
+    regardless of ML_ENABLE_STATS.
+*/
+
+struct class_stats {
+    const class_layout* layout          = nullptr;
+    uint64_t            registration_ns = 0;
+    size_t              allocations     = 0;
+    size_t              errors          = 0;
+    size_t              bytes           = 0;    // as returned by 'layout_bytes'
 };
 
+inline auto layout_bytes(const class_layout& _layout) -> size_t;
+inline auto registry_stats() -> vector<class_stats>;
+inline void dump_registry_stats(ostream& _out);
+
+/*
+    Layout fingerprint
+
+    'layout_fingerprint' is a 64-bit structural hash (FNV-1a) of a layout: the class id and,
+    for every field in name order, its name and its items recursively (category, arithmetic
+    encoding, nested class id and fingerprint, element and alternative sizes and bit ranges). Class names
+    and user data are not part of it. Values are hashed in a fixed byte order so the same
+    layout yields the same fingerprint on every platform.
+
+    'layout_fingerprint<T>()' is computed once and cached, so it must not be called before
+    all the fields of T are registered. Layouts are only known at run time, so there is no
+    constexpr version; 'fingerprint_bytes' is constexpr and hashes compile-time data (e.g.
+    a format tag) with the same function.
+*/
+
+constexpr auto fingerprint_seed = uint64_t{0xCBF29CE484222325};
+
+constexpr auto fingerprint_bytes(const char* _data, size_t _size, uint64_t _hash = fingerprint_seed) -> uint64_t;
+inline    auto layout_fingerprint(const class_layout& _layout) -> uint64_t;
+template<typename T> auto layout_fingerprint() -> uint64_t;
+
 /*
     == PUBLIC macros' interface ==========
 */
@@ -143,12 +365,32 @@ struct err_iterator<T, TS...> {
 #define ML_REGISTER_CLASSID(_class, _id, ...)                   ML_IMPL_REGISTER_CLASSID(ML_WRAP(_class), _id, __VA_ARGS__)
 #define ML_REGISTER_CLASSID_CODITIONAL(_class, _cond, _id, ...) ML_IMPL_REGISTER_CLASSID_CODITIONAL(ML_WRAP(_class), ML_WRAP(_cond), _id, __VA_ARGS__)
 
+/*
+    ML_[GLOBAL_]REGISTER_[BIT]FIELDS(_class_, _field1_, _field2_, ...)
+    ML_[GLOBAL_]REGISTER_[BIT]FIELDS_WITH_DATA(_class_, (_field1_, _user_data1_), (_field2_, _user_data2_), ...)
+
+    Bulk versions of the macros above: all the fields (up to 365) are registered by a single
+    static initializer (a single lazy descriptor with ML_LAZY_REGISTRATION), which keeps
+    binary size and start-up work down for classes with many fields.
+*/
+
+#define ML_REGISTER_FIELDS(_class, ...)                         ML_IMPL_BULK  (ML_WRAP(_class), ML_IMPL_BULK_F,   __VA_ARGS__)
+#define ML_REGISTER_BITFIELDS(_class, ...)                      ML_IMPL_BULK  (ML_WRAP(_class), ML_IMPL_BULK_BF,  __VA_ARGS__)
+#define ML_REGISTER_FIELDS_WITH_DATA(_class, ...)               ML_IMPL_BULK  (ML_WRAP(_class), ML_IMPL_BULK_FD,  __VA_ARGS__)
+#define ML_REGISTER_BITFIELDS_WITH_DATA(_class, ...)            ML_IMPL_BULK  (ML_WRAP(_class), ML_IMPL_BULK_BFD, __VA_ARGS__)
+#define ML_GLOBAL_REGISTER_FIELDS(_class, ...)                  ML_IMPL_GBULK (ML_WRAP(_class), ML_IMPL_BULK_F,   __VA_ARGS__)
+#define ML_GLOBAL_REGISTER_BITFIELDS(_class, ...)               ML_IMPL_GBULK (ML_WRAP(_class), ML_IMPL_BULK_BF,  __VA_ARGS__)
+#define ML_GLOBAL_REGISTER_FIELDS_WITH_DATA(_class, ...)        ML_IMPL_GBULK (ML_WRAP(_class), ML_IMPL_BULK_FD,  __VA_ARGS__)
+#define ML_GLOBAL_REGISTER_BITFIELDS_WITH_DATA(_class, ...)     ML_IMPL_GBULK (ML_WRAP(_class), ML_IMPL_BULK_BFD, __VA_ARGS__)
+
 /*
     == Extensibility ==========
 
     We can extend it...
-    (i)  by declaring certain types as indexable (std::pair, std::tuple, etc.)
-    (ii) by specifying ids for certain classes
+    (i)   by declaring certain types as indexable (std::pair, std::tuple, etc.)
+    (ii)  by declaring certain types as variable-length (std::vector, std::string, etc.)
+    (iii) by declaring certain types as tagged (std::optional, std::variant, etc.)
+    (iv)  by specifying ids for certain classes
 */
 
 /*
@@ -205,6 +447,81 @@ auto container_elem(T const (&_item)[N]) -> decltype(auto) {
     return _item[I];
 }
 
+/*
+    Define what is a variable-length type via 'is_dynamic' and 'dynamic_traits'
+
+    dynamic_traits<T> must provide 'elem_type' and the static functions 'data' (const and
+    non-const), 'size' and 'resize'. Elements are expected to be contiguous in memory.
+*/
+
+template<typename T> struct is_dynamic : false_type { };
+template<typename T> struct dynamic_traits;
+
+// built-in std::vector specializations (std::vector<bool> is not contiguous)
+
+template<typename T, typename A> struct is_dynamic<vector<T, A>>    : true_type  { };
+template<typename A>             struct is_dynamic<vector<bool, A>> : false_type { };
+
+template<typename T, typename A>
+struct dynamic_traits<vector<T, A>> {
+    using elem_type = T;
+    static auto data  (const vector<T, A>& _v) -> const T* { return _v.data(); }
+    static auto data  (vector<T, A>& _v)       -> T*       { return _v.data(); }
+    static auto size  (const vector<T, A>& _v) -> size_t   { return _v.size(); }
+    static void resize(vector<T, A>& _v, size_t _count)    { _v.resize(_count); }
+};
+
+// built-in std::basic_string specializations
+
+template<typename C, typename T, typename A> struct is_dynamic<basic_string<C, T, A>> : true_type { };
+
+template<typename C, typename T, typename A>
+struct dynamic_traits<basic_string<C, T, A>> {
+    using elem_type = C;
+    static auto data  (const basic_string<C, T, A>& _s) -> const C* { return _s.data(); }
+    static auto data  (basic_string<C, T, A>& _s)       -> C*       { return _s.data(); }
+    static auto size  (const basic_string<C, T, A>& _s) -> size_t   { return _s.size(); }
+    static void resize(basic_string<C, T, A>& _s, size_t _count)    { _s.resize(_count); }
+};
+
+/*
+    Define what is a tagged type via 'is_tagged' and 'tagged_traits'
+
+    tagged_traits<T> must provide 'count', the 'alternative<I>' alias and the static functions
+    'index' (tagged_npos if none is active), 'get<I>', 'emplace<I>' and 'reset'.
+*/
+
+template<typename T> struct is_tagged : false_type { };
+template<typename T> struct tagged_traits;
+
+// built-in std::optional specializations
+
+template<typename T> struct is_tagged<optional<T>> : true_type { };
+
+template<typename T>
+struct tagged_traits<optional<T>> {
+    static constexpr size_t count = 1;
+    template<size_t I> using alternative = T;
+    static auto index(const optional<T>& _o) -> size_t { return _o.has_value() ? 0 : tagged_npos; }
+    template<size_t I> static auto get    (const optional<T>& _o) -> const T& { return *_o; }
+    template<size_t I> static auto emplace(optional<T>& _o)       -> T&       { return _o.emplace(); }
+    static void reset(optional<T>& _o) { _o.reset(); }
+};
+
+// built-in std::variant specializations (a variant cannot be emptied so 'reset' does nothing)
+
+template<typename ...TYPES> struct is_tagged<variant<TYPES...>> : true_type { };
+
+template<typename ...TYPES>
+struct tagged_traits<variant<TYPES...>> {
+    static constexpr size_t count = sizeof...(TYPES);
+    template<size_t I> using alternative = variant_alternative_t<I, variant<TYPES...>>;
+    static auto index(const variant<TYPES...>& _v) -> size_t { return _v.valueless_by_exception() ? tagged_npos : _v.index(); }
+    template<size_t I> static auto get    (const variant<TYPES...>& _v) -> const alternative<I>& { return *get_if<I>(&_v); }
+    template<size_t I> static auto emplace(variant<TYPES...>& _v)       -> alternative<I>&       { return _v.template emplace<I>(); }
+    static void reset(variant<TYPES...>&) { }
+};
+
 /*
     'id_of'
 
@@ -251,12 +568,99 @@ namespace details {
 #define ML_PASTE(x,y) x##y
 #define ML_MERGE(x,y) ML_PASTE(x,y)
 #define ML_UNUSED ML_MERGE(unused,__COUNTER__)
+
+// ML_MAP(f, a, b, c...) expands to f(a) f(b) f(c)... (up to 365 arguments)
+
+#define ML_EVAL0(...) __VA_ARGS__
+#define ML_EVAL1(...) ML_EVAL0(ML_EVAL0(ML_EVAL0(__VA_ARGS__)))
+#define ML_EVAL2(...) ML_EVAL1(ML_EVAL1(ML_EVAL1(__VA_ARGS__)))
+#define ML_EVAL3(...) ML_EVAL2(ML_EVAL2(ML_EVAL2(__VA_ARGS__)))
+#define ML_EVAL4(...) ML_EVAL3(ML_EVAL3(ML_EVAL3(__VA_ARGS__)))
+#define ML_EVAL(...)  ML_EVAL4(ML_EVAL4(ML_EVAL4(__VA_ARGS__)))
+#define ML_MAP_END(...)
+#define ML_MAP_OUT
+#define ML_MAP_GET_END2() 0, ML_MAP_END
+#define ML_MAP_GET_END1(...) ML_MAP_GET_END2
+#define ML_MAP_GET_END(...) ML_MAP_GET_END1
+#define ML_MAP_NEXT0(_test, _next, ...) _next ML_MAP_OUT
+#define ML_MAP_NEXT1(_test, _next) ML_MAP_NEXT0(_test, _next, 0)
+#define ML_MAP_NEXT(_test, _next) ML_MAP_NEXT1(ML_MAP_GET_END _test, _next)
+#define ML_MAP0(_f, _x, _peek, ...) _f(_x) ML_MAP_NEXT(_peek, ML_MAP1)(_f, _peek, __VA_ARGS__)
+#define ML_MAP1(_f, _x, _peek, ...) _f(_x) ML_MAP_NEXT(_peek, ML_MAP0)(_f, _peek, __VA_ARGS__)
+#define ML_MAP(_f, ...) ML_EVAL(ML_MAP1(_f, __VA_ARGS__, ()()(), ()()(), ()()(), 0))
+
 #define FIELD_OFFSET(_class, _field) \
     reinterpret_cast<size_t>(&reinterpret_cast<char const volatile&>((qcstudio::map_layout::details::static_of<_class>()->_field))) - \
     reinterpret_cast<size_t>(reinterpret_cast<char const volatile*>((qcstudio::map_layout::details::static_of<_class>())))
 
 // internal macro implementation
 
+#if ML_LAZY_REGISTRATION
+
+/*
+    Lazy registration: the macros only record a 'lazy_field' descriptor (registration thunk,
+    names, user data and file/line) and the layout is built on the first call to 'get_layout'
+*/
+
+#define ML_IMPL_RF5P(_class, _field, _classname, _fieldname, _user_data, _file, _line) /* register field; 5 parameters version */\
+    do {\
+        static qcstudio::map_layout::details::lazy_field<ML_WRAP(_class)> unused {\
+            [](const qcstudio::map_layout::details::lazy_field<ML_WRAP(_class)>& _d) {\
+                return qcstudio::map_layout::details::register_field<ML_WRAP(_class), decltype(ML_WRAP(_class)::_field)>(\
+                    reinterpret_cast<size_t>(&reinterpret_cast<char const volatile&>(((reinterpret_cast<ML_WRAP(_class)*>(0))->_field))),\
+                    _d.classname, _d.fieldname, _d.user_data, nullptr,\
+                    _d.file, _d.line\
+                );\
+            },\
+            _classname, _fieldname, _user_data, _file, _line\
+        };\
+        (void)unused;\
+    } while (false)
+
+#define ML_IMPL_RBF5P(_class, _field, _classname, _fieldname, _user_data, _file, _line) /* register bit-field; 5 parameter version */\
+    do {\
+        static_assert(!std::is_reference<decltype(ML_WRAP(_class)::_field)>::value, "Reference attribute layout is not possible");\
+        static qcstudio::map_layout::details::lazy_field<ML_WRAP(_class)> unused {\
+            [](const qcstudio::map_layout::details::lazy_field<ML_WRAP(_class)>& _d) {\
+                return qcstudio::map_layout::details::register_bitfield<ML_WRAP(_class), decltype(ML_WRAP(_class)::_field)>(\
+                    _d.classname, _d.fieldname, _d.user_data,\
+                    [](const ML_WRAP(_class)& _inst) { return _inst._field; },\
+                    [](ML_WRAP(_class)& _inst, auto _b) { _inst._field = _b; },\
+                    _d.file, _d.line\
+                );\
+            },\
+            _classname, _fieldname, _user_data, _file, _line\
+        };\
+        (void)unused;\
+    } while (false)
+
+#define ML_IMPL_GRF5P(_class, _field, _classname, _fieldname, _user_data, _file, _line) /* global register field; 5 parameter version */\
+    static qcstudio::map_layout::details::lazy_field<ML_WRAP(_class)> ML_UNUSED {\
+        [](const qcstudio::map_layout::details::lazy_field<ML_WRAP(_class)>& _d) {\
+            return qcstudio::map_layout::details::register_field<ML_WRAP(_class), decltype(ML_WRAP(_class)::_field)>(\
+                (reinterpret_cast<size_t>(&reinterpret_cast<char const volatile&>(((reinterpret_cast<ML_WRAP(_class)*>(0))->_field)))),\
+                _d.classname, _d.fieldname, _d.user_data, nullptr,\
+                _d.file, _d.line\
+            );\
+        },\
+        _classname, _fieldname, _user_data, _file, _line\
+    }
+
+#define ML_IMPL_GRBF5P(_class, _field, _classname, _fieldname, _user_data, _file, _line) /* global register bitfield; 5 paramameter version */\
+    static qcstudio::map_layout::details::lazy_field<ML_WRAP(_class)> ML_UNUSED {\
+        [](const qcstudio::map_layout::details::lazy_field<ML_WRAP(_class)>& _d) {\
+            return qcstudio::map_layout::details::register_bitfield<ML_WRAP(_class), decltype(ML_WRAP(_class)::_field)>(\
+                _d.classname, _d.fieldname, _d.user_data,\
+                [](const ML_WRAP(_class)& _inst)    { return _inst._field; },\
+                [](ML_WRAP(_class)& _inst, auto _b) { _inst._field = _b; },\
+                _d.file, _d.line\
+            );\
+        },\
+        _classname, _fieldname, _user_data, _file, _line\
+    }
+
+#else
+
 #define ML_IMPL_RF5P(_class, _field, _classname, _fieldname, _user_data, _file, _line) /* register field; 5 parameters version */\
     do {\
         static auto unused =\
@@ -268,13 +672,9 @@ namespace details {
         (void)unused;\
     } while (false)
 
-#define ML_IMPL_RF4P(_class, _field, _classname, _fieldname, _file, _line) ML_IMPL_RF5P(ML_WRAP(_class), _field, _classname, _fieldname, 0,          _file, _line)
-#define ML_IMPL_RF3P(_class, _field, _user_data, _file, _line)             ML_IMPL_RF5P(ML_WRAP(_class), _field, #_class,    #_field,    _user_data, _file, _line)
-#define ML_IMPL_RF2P(_class, _field, _file, _line)                         ML_IMPL_RF5P(ML_WRAP(_class), _field, #_class,    #_field,    0,          _file, _line)
-
 #define ML_IMPL_RBF5P(_class, _field, _classname, _fieldname, _user_data, _file, _line) /* register bit-field; 5 parameter version */\
     do {\
-        static_assert(!is_reference<decltype(ML_WRAP(_class)::_field)>::value, "Reference attribute layout is not possible");\
+        static_assert(!std::is_reference<decltype(ML_WRAP(_class)::_field)>::value, "Reference attribute layout is not possible");\
         static auto unused =\
         qcstudio::map_layout::details::register_bitfield<ML_WRAP(_class), decltype(ML_WRAP(_class)::_field)>(\
             _classname, _fieldname, _user_data,\
@@ -285,10 +685,6 @@ namespace details {
         (void)unused;\
     } while (false)
 
-#define ML_IMPL_RBF4P(_class, _field, _classname, _fieldname, _file, _line) ML_IMPL_RBF5P(ML_WRAP(_class), _field, _classname, _fieldname, 0,          _file, _line)
-#define ML_IMPL_RBF3P(_class, _field, _user_data, _file, _line)             ML_IMPL_RBF5P(ML_WRAP(_class), _field, #_class,    #_field,    _user_data, _file, _line)
-#define ML_IMPL_RBF2P(_class, _field, _file, _line)                         ML_IMPL_RBF5P(ML_WRAP(_class), _field, #_class,    #_field,    0,          _file, _line)
-
 #define ML_IMPL_GRF5P(_class, _field, _classname, _fieldname, _user_data, _file, _line) /* global register field; 5 parameter version */\
     static auto ML_UNUSED =\
         qcstudio::map_layout::details::register_field<ML_WRAP(_class), decltype(ML_WRAP(_class)::_field)>(\
@@ -297,10 +693,6 @@ namespace details {
             _file, _line\
         )\
 
-#define ML_IMPL_GRF4P(_class, _field, _classname, _fieldname, _file, _line) ML_IMPL_GRF5P(ML_WRAP(_class), _field, _classname, _fieldname, 0,          _file, _line)
-#define ML_IMPL_GRF3P(_class, _field, _user_data, _file, _line)             ML_IMPL_GRF5P(ML_WRAP(_class), _field, #_class,    #_field,    _user_data, _file, _line)
-#define ML_IMPL_GRF2P(_class, _field, _file, _line)                         ML_IMPL_GRF5P(ML_WRAP(_class), _field, #_class,    #_field,    0,          _file, _line)
-
 #define ML_IMPL_GRBF5P(_class, _field, _classname, _fieldname, _user_data, _file, _line) /* global register bitfield; 5 paramameter version */\
     static auto ML_UNUSED =\
         qcstudio::map_layout::details::register_bitfield<ML_WRAP(_class), decltype(ML_WRAP(_class)::_field)>(\
@@ -310,10 +702,98 @@ namespace details {
             _file, _line\
         )
 
+#endif
+
+#define ML_IMPL_RF4P(_class, _field, _classname, _fieldname, _file, _line) ML_IMPL_RF5P(ML_WRAP(_class), _field, _classname, _fieldname, 0,          _file, _line)
+#define ML_IMPL_RF3P(_class, _field, _user_data, _file, _line)             ML_IMPL_RF5P(ML_WRAP(_class), _field, #_class,    #_field,    _user_data, _file, _line)
+#define ML_IMPL_RF2P(_class, _field, _file, _line)                         ML_IMPL_RF5P(ML_WRAP(_class), _field, #_class,    #_field,    0,          _file, _line)
+
+#define ML_IMPL_RBF4P(_class, _field, _classname, _fieldname, _file, _line) ML_IMPL_RBF5P(ML_WRAP(_class), _field, _classname, _fieldname, 0,          _file, _line)
+#define ML_IMPL_RBF3P(_class, _field, _user_data, _file, _line)             ML_IMPL_RBF5P(ML_WRAP(_class), _field, #_class,    #_field,    _user_data, _file, _line)
+#define ML_IMPL_RBF2P(_class, _field, _file, _line)                         ML_IMPL_RBF5P(ML_WRAP(_class), _field, #_class,    #_field,    0,          _file, _line)
+
+#define ML_IMPL_GRF4P(_class, _field, _classname, _fieldname, _file, _line) ML_IMPL_GRF5P(ML_WRAP(_class), _field, _classname, _fieldname, 0,          _file, _line)
+#define ML_IMPL_GRF3P(_class, _field, _user_data, _file, _line)             ML_IMPL_GRF5P(ML_WRAP(_class), _field, #_class,    #_field,    _user_data, _file, _line)
+#define ML_IMPL_GRF2P(_class, _field, _file, _line)                         ML_IMPL_GRF5P(ML_WRAP(_class), _field, #_class,    #_field,    0,          _file, _line)
+
 #define ML_IMPL_GRBF4P(_class, _field, _classname, _fieldname, _file, _line) ML_IMPL_GRBF5P(ML_WRAP(_class), _field, _classname, _fieldname, 0,          _file, _line)
 #define ML_IMPL_GRBF3P(_class, _field, _user_data, _file, _line)             ML_IMPL_GRBF5P(ML_WRAP(_class), _field, #_class,    #_field,    _user_data, _file, _line)
 #define ML_IMPL_GRBF2P(_class, _field, _file, _line)                         ML_IMPL_GRBF5P(ML_WRAP(_class), _field, #_class,    #_field,    0,          _file, _line)
 
+/*
+    Bulk registration: the per-field statements run inside one function that defines
+    'ml_class', 'ml_classname', 'ml_file', 'ml_line' and accumulates the result in 'ml_ok'
+*/
+
+#define ML_IMPL_BULK_FIELD(_field, _user_data)\
+    ml_ok &= qcstudio::map_layout::details::register_field<ml_class, decltype(ml_class::_field)>(\
+        reinterpret_cast<size_t>(&reinterpret_cast<char const volatile&>(((reinterpret_cast<ml_class*>(0))->_field))),\
+        ml_classname, #_field, _user_data, nullptr, ml_file, ml_line\
+    );
+
+#define ML_IMPL_BULK_BITFIELD(_field, _user_data)\
+    static_assert(!std::is_reference<decltype(ml_class::_field)>::value, "Reference attribute layout is not possible");\
+    ml_ok &= qcstudio::map_layout::details::register_bitfield<ml_class, decltype(ml_class::_field)>(\
+        ml_classname, #_field, _user_data,\
+        [](const ml_class& _inst)    { return _inst._field; },\
+        [](ml_class& _inst, auto _b) { _inst._field = _b; },\
+        ml_file, ml_line\
+    );
+
+#define ML_IMPL_BULK_F(_field)  ML_IMPL_BULK_FIELD(_field, 0)
+#define ML_IMPL_BULK_BF(_field) ML_IMPL_BULK_BITFIELD(_field, 0)
+#define ML_IMPL_BULK_FD(_pair)  ML_IMPL_BULK_FIELD _pair
+#define ML_IMPL_BULK_BFD(_pair) ML_IMPL_BULK_BITFIELD _pair
+
+#if ML_LAZY_REGISTRATION
+
+#define ML_IMPL_BULK_DESCRIPTOR(_class, _per_field, ...)\
+    {\
+        [](const qcstudio::map_layout::details::lazy_field<ML_WRAP(_class)>& _d) {\
+            using ml_class = ML_WRAP(_class);\
+            const auto ml_classname = _d.classname;\
+            const auto ml_file      = _d.file;\
+            const auto ml_line      = _d.line;\
+            auto       ml_ok        = true;\
+            ML_MAP(_per_field, __VA_ARGS__)\
+            return ml_ok;\
+        },\
+        #_class, "", 0, __FILE__, __LINE__\
+    }
+
+#define ML_IMPL_BULK(_class, _per_field, ...)\
+    do {\
+        static qcstudio::map_layout::details::lazy_field<ML_WRAP(_class)> unused ML_IMPL_BULK_DESCRIPTOR(ML_WRAP(_class), _per_field, __VA_ARGS__);\
+        (void)unused;\
+    } while (false)
+
+#define ML_IMPL_GBULK(_class, _per_field, ...)\
+    static qcstudio::map_layout::details::lazy_field<ML_WRAP(_class)> ML_UNUSED ML_IMPL_BULK_DESCRIPTOR(ML_WRAP(_class), _per_field, __VA_ARGS__)
+
+#else
+
+#define ML_IMPL_BULK_INIT(_class, _per_field, ...)\
+    [] {\
+        using ml_class = ML_WRAP(_class);\
+        const auto ml_classname = #_class;\
+        const auto ml_file      = __FILE__;\
+        const auto ml_line      = size_t{__LINE__};\
+        auto       ml_ok        = true;\
+        ML_MAP(_per_field, __VA_ARGS__)\
+        return ml_ok;\
+    }()
+
+#define ML_IMPL_BULK(_class, _per_field, ...)\
+    do {\
+        static auto unused = ML_IMPL_BULK_INIT(ML_WRAP(_class), _per_field, __VA_ARGS__);\
+        (void)unused;\
+    } while (false)
+
+#define ML_IMPL_GBULK(_class, _per_field, ...)\
+    static auto ML_UNUSED = ML_IMPL_BULK_INIT(ML_WRAP(_class), _per_field, __VA_ARGS__)
+
+#endif
+
 #define ML_IMPL_REGISTER_CLASSID(_class, _id, ...)\
     template <__VA_ARGS__>\
     struct qcstudio::map_layout::id_of<ML_WRAP(_class)> : std::integral_constant<uint32_t, _id> {\
@@ -328,20 +808,43 @@ namespace details {
     == PRIVATE Implementation details ==========
 */
 
+namespace details {
+
+    template<typename T>
+    auto layout_storage() -> class_layout& {
+        static class_layout ret = [] {
+            class_layout layout;
+            layout.trivially_copyable = is_trivially_copyable<T>::value;
+            return layout;
+        }();
+        return ret;
+    }
+
+    template<typename T>
+    auto errors_storage() -> vector<error_entry>& {
+        static vector<error_entry> ret;
+        return ret;
+    }
+
+    template<typename T>
+    void ensure_built();
+
+}
+
 // layout access
 
 template<typename T>
 auto get_layout() -> const class_layout& {
-    static class_layout ret;
-    return ret;
+    details::ensure_built<T>();
+    return details::layout_storage<T>();
 }
 
 // error list access
 
 template<typename T>
 auto get_type_errors() -> const vector<tuple<const char*, size_t, string>>& {
-    static vector<tuple<const char*, size_t, string>> ret;
-    return ret;
+    details::ensure_built<T>();
+    return details::errors_storage<T>();
 }
 
 namespace details {
@@ -407,23 +910,150 @@ namespace details {
 
 namespace details {
 
+// instrumentation
+
+inline auto stats_registry() -> vector<class_stats*>& {
+    static vector<class_stats*> ret;
+    return ret;
+}
+
+template<typename T>
+auto get_stats_mod() -> class_stats& {
+    static class_stats ret;
+    static auto registered = [] {
+        ret.layout = &layout_storage<T>();
+        stats_registry().push_back(&ret);
+        return true;
+    }();
+    (void)registered;
+    return ret;
+}
+
+template<typename T>
+void count_allocations(size_t _count) {
+#if ML_ENABLE_STATS
+    get_stats_mod<T>().allocations += _count;
+#else
+    (void)_count;
+#endif
+}
+
+template<typename T>
+struct stats_scope {
+#if ML_ENABLE_STATS
+    explicit stats_scope(bool _active) : active(_active), start(chrono::steady_clock::now()) {
+    }
+    ~stats_scope() {
+        if (active) {
+            const auto elapsed = chrono::steady_clock::now() - start;
+            get_stats_mod<T>().registration_ns += static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+        }
+    }
+    bool active;
+    chrono::steady_clock::time_point start;
+#else
+    explicit stats_scope(bool) {
+    }
+#endif
+};
+
+inline auto item_bytes(const item_t& _item) -> size_t {
+    auto ret = _item.ranges.capacity() > range_list::inline_capacity ? _item.ranges.capacity() * sizeof(bit_offset) : 0;
+    if (_item.category == item_category::container && _item.data.container.items) {
+        ret += _item.data.container.count * sizeof(item_t);
+        for (auto i = 0u; i < _item.data.container.count; ++i) {
+            ret += item_bytes(_item.data.container.items[i]);
+        }
+    } else if (_item.category == item_category::dynamic && _item.data.dynamic.elem) {
+        ret += sizeof(item_t) + item_bytes(*_item.data.dynamic.elem);
+    } else if (_item.category == item_category::tagged && _item.data.tagged.items) {
+        ret += _item.data.tagged.ops->count * sizeof(item_t);
+        for (auto i = 0u; i < _item.data.tagged.ops->count; ++i) {
+            ret += item_bytes(_item.data.tagged.items[i]);
+        }
+    }
+    return ret;
+}
+
 // write-access to layout
 
 template<typename T>
 static auto get_layout_mod() -> class_layout&
 {
-    return const_cast<class_layout&>(get_layout<T>());
+    return layout_storage<T>();
 }
 
 // error handling
 
 template<typename T>
 auto get_type_errors_mod() -> vector<tuple<const char*, size_t, string>>& {
-    return const_cast<vector<tuple<const char*, size_t, string>>&>(get_type_errors<T>());
+    return errors_storage<T>();
+}
+
+/*
+    Lazy registration
+
+    Every registration site owns a static 'lazy_field' that links itself, in registration
+    order, into the list of its class. The first 'get_layout'/'get_type_errors' call for that
+    class runs all the pending thunks exactly once (function-local static initialisation is
+    thread-safe). Descriptors created after that point are registered immediately.
+*/
+
+template<typename CLASS> struct lazy_field;
+
+template<typename CLASS>
+struct lazy_list {
+    static inline mutex              lock;
+    static inline lazy_field<CLASS>* head  = nullptr;
+    static inline lazy_field<CLASS>* tail  = nullptr;
+    static inline bool               built = false;
+};
+
+template<typename CLASS>
+struct lazy_field {
+    using thunk_t = bool (*)(const lazy_field&);
+
+    lazy_field(thunk_t _thunk, const char* _classname, const char* _fieldname, uint64_t _user_data, const char* _file, size_t _line)
+    : thunk(_thunk), classname(_classname), fieldname(_fieldname), user_data(_user_data), file(_file), line(_line) {
+        lock_guard<mutex> guard(lazy_list<CLASS>::lock);
+        if (lazy_list<CLASS>::built) {
+            thunk(*this);
+        } else if (lazy_list<CLASS>::tail) {
+            lazy_list<CLASS>::tail = lazy_list<CLASS>::tail->next = this;
+        } else {
+            lazy_list<CLASS>::head = lazy_list<CLASS>::tail = this;
+        }
+    }
+
+    thunk_t     thunk;
+    const char* classname;
+    const char* fieldname;
+    uint64_t    user_data;
+    const char* file;
+    size_t      line;
+    lazy_field* next = nullptr;
+};
+
+template<typename T>
+void ensure_built() {
+#if ML_LAZY_REGISTRATION
+    static const auto built = [] {
+        lock_guard<mutex> guard(lazy_list<T>::lock);
+        for (auto field = lazy_list<T>::head; field; field = field->next) {
+            field->thunk(*field);
+        }
+        lazy_list<T>::built = true;
+        return true;
+    }();
+    (void)built;
+#endif
 }
 
 template<typename T>
 void add_error(const char* _file, size_t _line, string&& _message) {
+#if ML_ENABLE_STATS
+    ++get_stats_mod<T>().errors;
+#endif
     auto& errors = get_type_errors_mod<T>();
     errors.push_back(make_tuple(_file, _line, move(_message)));
     sort(errors.begin(), errors.end(), [](auto& _a, auto& _b) { return get<1>(_a) < get<1>(_b); });
@@ -463,8 +1093,10 @@ template<typename T,           typename U = void>    using if_arithmetic
 template<typename T,           typename U = void>    using if_pointer             = typename enable_if<is_pointer<T>::value, U>::type;
 template<typename T,           typename U = void>    using if_ref                 = typename enable_if<is_reference<T>::value, U>::type;
 template<typename T,           typename U = void>    using if_not_ref             = typename enable_if<!is_reference<T>::value, U>::type;
-template<typename T,           typename U = void>    using if_non_container_class = typename enable_if<is_class<T>::value && !is_container<T>::value, U>::type;
+template<typename T,           typename U = void>    using if_non_container_class = typename enable_if<is_class<T>::value && !is_container<T>::value && !is_dynamic<T>::value && !is_tagged<T>::value, U>::type;
 template<typename T,           typename U = void>    using if_container           = typename enable_if<is_container<T>::value, U>::type;
+template<typename T,           typename U = void>    using if_dynamic             = typename enable_if<is_dynamic<T>::value, U>::type;
+template<typename T,           typename U = void>    using if_tagged              = typename enable_if<is_tagged<T>::value, U>::type;
 template<typename T,           typename U = uint8_t> using if_bool                = typename enable_if<is_same<T, bool>::value, U>::type;
 template<typename T,           typename U = uint8_t> using if_char                = typename enable_if<is_one_of<T, char, wchar_t, char16_t, char32_t>::value, U>::type;
 template<typename T,           typename U = uint8_t> using if_charchar            = typename enable_if<is_one_of<T, unsigned char, char, wchar_t>::value, U>::type;
@@ -512,6 +1144,29 @@ auto get_encoded_arithmetic() -> if_arithmetic<T, uint8_t> {
          | get_char_flags<T>            ();
 }
 
+// append a [first, last] bit range to an item
+
+template<typename CLASS>
+void add_range(item_t& _item, size_t _first, size_t _last) {
+    static_assert(sizeof(CLASS) <= (numeric_limits<bit_offset>::max() / CHAR_BIT), "Class too big for 32-bit bit offsets");
+    for (auto bit : { static_cast<bit_offset>(_first), static_cast<bit_offset>(_last) }) {
+        const auto capacity = _item.ranges.capacity();
+        _item.ranges.push_back(bit);
+        count_allocations<CLASS>(_item.ranges.capacity() != capacity ? 1 : 0);
+    }
+}
+
+// extend the class bit bounds with the ranges of a (top-level) item
+
+template<typename CLASS>
+void update_bounds(const item_t& _item) {
+    auto& layout = get_layout_mod<CLASS>();
+    for (auto i = 0u; i < _item.ranges.size(); i+=2) {
+        if (_item.ranges[i    ] < layout.firstbit) { layout.firstbit = _item.ranges[i    ]; }
+        if (_item.ranges[i + 1] > layout.lastbit)  { layout.lastbit  = _item.ranges[i + 1]; }
+    }
+}
+
 // initial setup of class/field
 
 inline auto get_filtered_classname(const char* _classname) -> string {
@@ -534,32 +1189,46 @@ inline auto get_filtered_classname(const char* _classname) -> string {
 template<typename CLASS, typename FIELD>
 auto setup_class_field(const char* _classname, const char* _fieldname, uint64_t _user_data, const char* _file, size_t _line) -> field_info_t* {
 
-    auto filtered_classname = get_filtered_classname(_classname);
+    // the class name is only filtered (regex) when the class is set up or on errors
+
     auto& layout = get_layout_mod<CLASS>();
     if (layout.name.empty()) {
         layout.id = id_of<CLASS>::value;
-        layout.name = filtered_classname;
+        layout.name = get_filtered_classname(_classname);
         layout.firstbit = numeric_limits<decltype(layout.firstbit)>::max();
         layout.lastbit = numeric_limits<decltype(layout.lastbit )>::min();
     }
 
     auto ret = layout.fields.insert({_fieldname, field_info_t{_user_data, {}}});
     if (ret.second) {
+        count_allocations<CLASS>(1);
         ret.first->second.user_data = _user_data;
         return &(ret.first->second);
     }
 
-    details::add_duplication_error<CLASS>(_file, _line, filtered_classname.c_str(), _fieldname);
+    details::add_duplication_error<CLASS>(_file, _line, get_filtered_classname(_classname).c_str(), _fieldname);
 
     return nullptr;
 }
 
+// forward declarations (the overloads below register the members of containers, variable-length and tagged types)
+
+template<typename CLASS, typename FIELD> auto register_field(size_t, const char*, const char*, uint64_t, item_t*, const char*, size_t) -> if_arithmetic<FIELD, bool>;
+template<typename CLASS, typename FIELD> auto register_field(size_t, const char*, const char*, uint64_t, item_t*, const char*, size_t) -> if_pointer<FIELD, bool>;
+template<typename CLASS, typename FIELD> auto register_field(size_t, const char*, const char*, uint64_t, item_t*, const char*, size_t) -> if_ref<FIELD, bool>;
+template<typename CLASS, typename FIELD> auto register_field(size_t, const char*, const char*, uint64_t, item_t*, const char*, size_t) -> if_non_container_class<FIELD, bool>;
+template<typename CLASS, typename FIELD> auto register_field(size_t, const char*, const char*, uint64_t, item_t*, const char*, size_t) -> if_container<FIELD, bool>;
+template<typename CLASS, typename FIELD> auto register_field(size_t, const char*, const char*, uint64_t, item_t*, const char*, size_t) -> if_dynamic<FIELD, bool>;
+template<typename CLASS, typename FIELD> auto register_field(size_t, const char*, const char*, uint64_t, item_t*, const char*, size_t) -> if_tagged<FIELD, bool>;
+
 // Arithmetic types
 
 template<typename CLASS, typename FIELD>
 auto register_field(size_t _offset, const char* _classname, const char* _fieldname, uint64_t _user_data, item_t* _item, const char* _file, size_t _line)
 -> if_arithmetic<FIELD, bool> {
 
+    stats_scope<CLASS> scope(_item == nullptr);
+
     auto item = _item;
     if (!item) {
         if (auto field = setup_class_field<CLASS, FIELD>(_classname, _fieldname, _user_data, _file, _line)) {
@@ -573,13 +1242,10 @@ auto register_field(size_t _offset, const char* _classname, const char* _fieldna
 
     item->category                = item_category::arithmetic;
     item->data.encoded_arithmetic = get_encoded_arithmetic<FIELD>();
-    item->ranges.push_back (_offset * 8);
-    item->ranges.push_back (((_offset + sizeof(FIELD)) * 8) - 1);
+    add_range<CLASS>(*item, _offset * 8, ((_offset + sizeof(FIELD)) * 8) - 1);
 
-    auto& layout = get_layout_mod<CLASS>();
-    for (auto i = 0u; i < item->ranges.size(); i+=2) {
-        if (item->ranges[i    ] < layout.firstbit) { layout.firstbit = item->ranges[i    ]; }
-        if (item->ranges[i + 1] > layout.lastbit)  { layout.lastbit  = item->ranges[i + 1]; }
+    if (!_item) {
+        update_bounds<CLASS>(*item);
     }
 
     return true;
@@ -591,6 +1257,8 @@ template<typename CLASS, typename FIELD>
 auto register_field(size_t _offset, const char* _classname, const char* _fieldname, uint64_t _user_data, item_t* _item, const char* _file, size_t _line)
 -> if_pointer<FIELD, bool> {
 
+    stats_scope<CLASS> scope(_item == nullptr);
+
     auto item = _item;
     if (!item) {
         if (auto field = setup_class_field<CLASS, FIELD>(_classname, _fieldname, _user_data, _file, _line)) {
@@ -603,13 +1271,10 @@ auto register_field(size_t _offset, const char* _classname, const char* _fieldna
     }
 
     item->category = item_category::pointer;
-    item->ranges.push_back (_offset * 8);
-    item->ranges.push_back (((_offset + sizeof(FIELD)) * 8) - 1);
+    add_range<CLASS>(*item, _offset * 8, ((_offset + sizeof(FIELD)) * 8) - 1);
 
-    auto& layout = get_layout_mod<CLASS>();
-    for (auto i = 0u; i < item->ranges.size(); i+=2) {
-        if (item->ranges[i    ] < layout.firstbit) { layout.firstbit = item->ranges[i    ]; }
-        if (item->ranges[i + 1] > layout.lastbit)  { layout.lastbit  = item->ranges[i + 1]; }
+    if (!_item) {
+        update_bounds<CLASS>(*item);
     }
 
     return true;
@@ -628,6 +1293,8 @@ template<typename CLASS, typename FIELD>
 auto register_field(size_t _offset, const char* _classname, const char* _fieldname, uint64_t _user_data, item_t* _item, const char* _file, size_t _line)
 -> if_non_container_class<FIELD, bool> {
 
+    stats_scope<CLASS> scope(_item == nullptr);
+
     auto item = _item;
     if (!item) {
         if (auto field = setup_class_field<CLASS, FIELD>(_classname, _fieldname, _user_data, _file, _line)) {
@@ -639,15 +1306,13 @@ auto register_field(size_t _offset, const char* _classname, const char* _fieldna
         return false;
     }
 
-    item->category = item_category::klass;
-    item->data.id = id_of<FIELD>::value;;
-    item->ranges.push_back (_offset * 8);
-    item->ranges.push_back (((_offset + sizeof(FIELD)) * 8) - 1);
+    item->category               = item_category::klass;
+    item->data.klass.id          = id_of<FIELD>::value;
+    item->data.klass.layout      = &get_layout<FIELD>;
+    add_range<CLASS>(*item, _offset * 8, ((_offset + sizeof(FIELD)) * 8) - 1);
 
-    auto& layout = get_layout_mod<CLASS>();
-    for (auto i = 0u; i < item->ranges.size(); i+=2) {
-        if (item->ranges[i    ] < layout.firstbit) { layout.firstbit = item->ranges[i    ]; }
-        if (item->ranges[i + 1] > layout.lastbit)  { layout.lastbit  = item->ranges[i + 1]; }
+    if (!_item) {
+        update_bounds<CLASS>(*item);
     }
 
     return true;
@@ -668,13 +1333,65 @@ inline auto get_max_bit (size_t _val, item_t* _item) -> size_t {
             }
         }
     } else {
-        return max(_val, _item->ranges.back());
+        return max(_val, static_cast<size_t>(_item->ranges.back()));
     }
     return _val;
 }
 
-template<typename CLASS, typename FIELD, size_t IDX, size_t SIZE>
-struct register_container;
+/*
+    Containers whose elements are all of the same type and evenly spaced: only the first
+    element is registered and the rest are copies of it with shifted ranges
+*/
+
+template<typename T>           struct is_homogeneous              : false_type {};
+template<typename T, size_t N> struct is_homogeneous<array<T, N>> : true_type  {};
+template<typename T, size_t N> struct is_homogeneous<T[N]>        : true_type  {};
+
+template<typename CLASS>
+void copy_shifted(const item_t& _src, item_t& _dst, bit_offset _shift, bool _shift_ranges = true) {
+    _dst.category = _src.category;
+    _dst.data     = _src.data;
+    const auto shift = _shift_ranges ? _shift : 0;
+    for (auto i = 0u; i + 1 < _src.ranges.size(); i += 2) {
+        add_range<CLASS>(_dst, _src.ranges[i] + shift, _src.ranges[i + 1] + shift);
+    }
+    if (_src.category == item_category::container) {
+        _dst.data.container.items = new item_t[_src.data.container.count];
+        count_allocations<CLASS>(1);
+        for (auto i = 0u; i < _src.data.container.count; ++i) {
+            copy_shifted<CLASS>(_src.data.container.items[i], _dst.data.container.items[i], _shift, _shift_ranges);
+        }
+    } else if (_src.category == item_category::dynamic) { // element ranges are relative to the element
+        _dst.data.dynamic.elem = new item_t;
+        count_allocations<CLASS>(1);
+        copy_shifted<CLASS>(*_src.data.dynamic.elem, *_dst.data.dynamic.elem, 0, false);
+    } else if (_src.category == item_category::tagged) { // alternative ranges are relative to the alternative
+        _dst.data.tagged.items = new item_t[_src.data.tagged.ops->count];
+        count_allocations<CLASS>(1);
+        for (auto i = 0u; i < _src.data.tagged.ops->count; ++i) {
+            copy_shifted<CLASS>(_src.data.tagged.items[i], _dst.data.tagged.items[i], 0, false);
+        }
+    }
+}
+
+template<typename CLASS, typename FIELD, size_t IDX>
+void register_container_item(size_t _offset, const FIELD& _field, item_t* _container_item, const char* _file, size_t _line) {
+    using item_type = decltype(container_elem<IDX>(_field));
+
+    static_assert(is_reference<item_type>::value, "item accessor function must return a reference");
+    auto elem_idx_ptr = reinterpret_cast<uintptr_t>(&container_elem<IDX>(_field));
+    auto elem_0_ptr   = reinterpret_cast<uintptr_t>(&_field);
+    auto item_offset  = elem_idx_ptr - elem_0_ptr;
+    register_field<CLASS, typename decay<item_type>::type>(
+        _offset + item_offset, nullptr, nullptr, 0, &_container_item->data.container.items[IDX],
+        _file, _line
+    );
+}
+
+template<typename CLASS, typename FIELD, size_t ...IDX>
+void register_container_items(size_t _offset, const FIELD& _field, item_t* _container_item, const char* _file, size_t _line, index_sequence<IDX...>) {
+    (register_container_item<CLASS, FIELD, IDX>(_offset, _field, _container_item, _file, _line), ...);
+}
 
 template<typename CLASS, typename FIELD>
 auto register_field(
@@ -687,6 +1404,8 @@ auto register_field(
     size_t      _line
 ) -> if_container<FIELD, bool> {
 
+    stats_scope<CLASS> scope(_item == nullptr);
+
     auto item = _item;
     if (!item) {
         if (auto field = setup_class_field<CLASS, FIELD>(_classname, _fieldname, _user_data, _file, _line)) {
@@ -701,45 +1420,141 @@ auto register_field(
     item->category = item_category::container;
     item->data.container.count = container_size<FIELD>::value;
     item->data.container.items = new item_t[container_size<FIELD>::value];
-    item->ranges.push_back(_offset * 8);
-    item->ranges.push_back(_offset * 8);
-    register_container<CLASS, FIELD, 0, container_size<FIELD>::value>()(_offset, /*WE CAN USE THIS FUNCTION INSIDE THE CLASS, CAN WE?*/
-        *static_of<FIELD>(), item, _file, _line);
+    count_allocations<CLASS>(1);
+    add_range<CLASS>(*item, _offset * 8, _offset * 8);
+    if constexpr (is_homogeneous<FIELD>::value) {
+        using elem_type = typename decay<decltype(container_elem<0>(*static_of<FIELD>()))>::type;
+        register_container_item<CLASS, FIELD, 0>(_offset, *static_of<FIELD>(), item, _file, _line);
+        for (auto i = 1u; i < container_size<FIELD>::value; ++i) {
+            copy_shifted<CLASS>(item->data.container.items[0], item->data.container.items[i], static_cast<bit_offset>(i * sizeof(elem_type) * CHAR_BIT));
+        }
+    } else {
+        register_container_items<CLASS, FIELD>(_offset, *static_of<FIELD>(), item, _file, _line, make_index_sequence<container_size<FIELD>::value>{});
+    }
 
-    item->ranges.back() = details::get_max_bit(0, item);
+    item->ranges.back() = static_cast<bit_offset>(details::get_max_bit(0, item));
 
-    auto& layout = get_layout_mod<CLASS>();
-    for (auto i = 0u; i < item->ranges.size(); i+=2) {
-        if (item->ranges[i    ] < layout.firstbit) { layout.firstbit = item->ranges[i    ]; }
-        if (item->ranges[i + 1] > layout.lastbit)  { layout.lastbit  = item->ranges[i + 1]; }
+    if (!_item) {
+        update_bounds<CLASS>(*item);
     }
 
     return true;
 }
 
-template<typename CLASS, typename FIELD, size_t SIZE>
-struct register_container<CLASS, FIELD, SIZE, SIZE> {
-    constexpr auto operator()(size_t /*_offset*/, const FIELD& /*_field*/, item_t* /*_container_item*/, const char* /*_file*/, size_t /*_line*/) -> size_t {
-        return 0;
+// Variable-length types
+
+template<typename T>
+auto get_dynamic_ops() -> const dynamic_ops& {
+    using traits = dynamic_traits<T>;
+    static const dynamic_ops ret {
+        sizeof(typename traits::elem_type),
+        [](const void* _field) -> pair<const void*, size_t> {
+            auto& field = *static_cast<const T*>(_field);
+            return { traits::data(field), traits::size(field) };
+        },
+        [](void* _field, size_t _count) -> void* {
+            auto& field = *static_cast<T*>(_field);
+            traits::resize(field, _count);
+            return traits::data(field);
+        }
+    };
+    return ret;
+}
+
+template<typename CLASS, typename FIELD>
+auto register_field(size_t _offset, const char* _classname, const char* _fieldname, uint64_t _user_data, item_t* _item, const char* _file, size_t _line)
+-> if_dynamic<FIELD, bool> {
+
+    stats_scope<CLASS> scope(_item == nullptr);
+
+    auto item = _item;
+    if (!item) {
+        if (auto field = setup_class_field<CLASS, FIELD>(_classname, _fieldname, _user_data, _file, _line)) {
+            item = &field->item;
+        }
     }
-};
 
-template<typename CLASS, typename FIELD, size_t IDX, size_t SIZE>
-struct register_container {
-    constexpr auto operator()(size_t _offset, const FIELD& _field, item_t* _container_item, const char* _file, size_t _line) -> size_t {
-        using item_type = decltype(container_elem<IDX>(_field));
-
-        static_assert(is_reference<item_type>::value, "item accessor function must return a reference");
-        auto elem_idx_ptr = reinterpret_cast<uintptr_t>(&container_elem<IDX>(_field));
-        auto elem_0_ptr   = reinterpret_cast<uintptr_t>(&_field);
-        auto item_offset  = elem_idx_ptr - elem_0_ptr;
-        register_field<CLASS, typename decay<item_type>::type>(
-            _offset + item_offset, nullptr, nullptr, 0, &_container_item->data.container.items[IDX],
-            _file, _line
-        );
-        return register_container<CLASS, FIELD, IDX + 1, container_size<FIELD>::value>()(_offset, _field, _container_item, _file, _line);
+    if (!item) {
+        return false;
     }
-};
+
+    item->category          = item_category::dynamic;
+    item->data.dynamic.ops  = &get_dynamic_ops<FIELD>();
+    item->data.dynamic.elem = new item_t;
+    count_allocations<CLASS>(1);
+    register_field<CLASS, typename dynamic_traits<FIELD>::elem_type>(0, nullptr, nullptr, 0, item->data.dynamic.elem, _file, _line);
+    add_range<CLASS>(*item, _offset * 8, ((_offset + sizeof(FIELD)) * 8) - 1);
+
+    if (!_item) {
+        update_bounds<CLASS>(*item);
+    }
+
+    return true;
+}
+
+// Tagged types
+
+template<typename T, size_t I>
+auto tagged_get(const void* _field) -> const void* {
+    return &tagged_traits<T>::template get<I>(*static_cast<const T*>(_field));
+}
+
+template<typename T, size_t I>
+auto tagged_emplace(void* _field) -> void* {
+    return &tagged_traits<T>::template emplace<I>(*static_cast<T*>(_field));
+}
+
+template<typename T, size_t ...I>
+auto get_tagged_ops(index_sequence<I...>) -> const tagged_ops& {
+    using traits = tagged_traits<T>;
+    static const size_t sizes[] = { sizeof(typename traits::template alternative<I>)... };
+    static const void* (* const getters[])  (const void*) = { &tagged_get<T, I>...     };
+    static void*       (* const emplacers[])(void*)       = { &tagged_emplace<T, I>... };
+    static const tagged_ops ret {
+        sizeof...(I), sizes,
+        [](const void* _field) { return traits::index(*static_cast<const T*>(_field)); },
+        getters, emplacers,
+        [](void* _field) { traits::reset(*static_cast<T*>(_field)); }
+    };
+    return ret;
+}
+
+template<typename CLASS, typename FIELD, size_t ...I>
+void register_alternatives(item_t* _items, index_sequence<I...>, const char* _file, size_t _line) {
+    (register_field<CLASS, typename tagged_traits<FIELD>::template alternative<I>>(0, nullptr, nullptr, 0, &_items[I], _file, _line), ...);
+}
+
+template<typename CLASS, typename FIELD>
+auto register_field(size_t _offset, const char* _classname, const char* _fieldname, uint64_t _user_data, item_t* _item, const char* _file, size_t _line)
+-> if_tagged<FIELD, bool> {
+
+    stats_scope<CLASS> scope(_item == nullptr);
+
+    auto item = _item;
+    if (!item) {
+        if (auto field = setup_class_field<CLASS, FIELD>(_classname, _fieldname, _user_data, _file, _line)) {
+            item = &field->item;
+        }
+    }
+
+    if (!item) {
+        return false;
+    }
+
+    constexpr auto count = tagged_traits<FIELD>::count;
+    item->category          = item_category::tagged;
+    item->data.tagged.ops   = &get_tagged_ops<FIELD>(make_index_sequence<count>{});
+    item->data.tagged.items = new item_t[count];
+    count_allocations<CLASS>(1);
+    register_alternatives<CLASS, FIELD>(item->data.tagged.items, make_index_sequence<count>{}, _file, _line);
+    add_range<CLASS>(*item, _offset * 8, ((_offset + sizeof(FIELD)) * 8) - 1);
+
+    if (!_item) {
+        update_bounds<CLASS>(*item);
+    }
+
+    return true;
+}
 
 // bit-field registering functions
 
@@ -762,6 +1577,8 @@ auto register_bitfield(const char* _classname, const char* _fieldname, uint64_t
 
     static_assert(is_integral<typename decay<FIELD>::type>::value, "Only integral types can be bit fields and the specified type is not");
 
+    stats_scope<CLASS> scope(true);
+
     auto field = setup_class_field<CLASS, FIELD>(_classname, _fieldname, _user_data, _file, _line);
     if (!field) {
         return false;
@@ -771,7 +1588,6 @@ auto register_bitfield(const char* _classname, const char* _fieldname, uint64_t
     field->item.data.encoded_arithmetic = get_encoded_arithmetic<FIELD>();
 
     static unsigned char buffer[sizeof(CLASS)];
-    auto& layout   = details::get_layout_mod<CLASS>();
     auto  instance = reinterpret_cast<CLASS*>(buffer);
 
     // local functions
@@ -813,8 +1629,7 @@ auto register_bitfield(const char* _classname, const char* _fieldname, uint64_t
         _setter(*instance, static_cast<FIELD>(expected));
         auto result = _getter(*instance);
         if (result != static_cast<decltype(result)>(expected) && static_cast<int>(result) >= 0) {
-            field->item.ranges.push_back(curr_bit);
-            field->item.ranges.push_back(last_bit);
+            add_range<CLASS>(field->item, curr_bit, last_bit);
             break;
         }
 
@@ -824,8 +1639,7 @@ auto register_bitfield(const char* _classname, const char* _fieldname, uint64_t
         if (nthbit != -1) {
             auto idx = static_cast<size_t>(nthbit);
             if (abs(static_cast<int64_t>(idx - last_bit)) > 1) {
-                field->item.ranges.push_back(curr_bit);
-                field->item.ranges.push_back(last_bit);
+                add_range<CLASS>(field->item, curr_bit, last_bit);
                 curr_bit = idx;
             }
             last_bit = idx;
@@ -836,21 +1650,147 @@ auto register_bitfield(const char* _classname, const char* _fieldname, uint64_t
 
     if (field->item.ranges.size() == 0)
     {
-        field->item.ranges.push_back(curr_bit);
-        field->item.ranges.push_back(last_bit);
+        add_range<CLASS>(field->item, curr_bit, last_bit);
     }
 
     // Update the global range
 
-    for (auto i = 0u; i < field->item.ranges.size(); i+=2) {
-        if (field->item.ranges[i    ] < layout.firstbit) { layout.firstbit = field->item.ranges[i    ]; }
-        if (field->item.ranges[i + 1] > layout.lastbit)  { layout.lastbit  = field->item.ranges[i + 1]; }
-    }
+    update_bounds<CLASS>(field->item);
 
     return true;
 }
 
 } // namespace details
 
+// instrumentation
+
+inline auto layout_bytes(const class_layout& _layout) -> size_t {
+    const auto node_overhead = 4 * sizeof(void*); // red-black tree node: color and three links
+    auto ret = sizeof(class_layout);
+    for (auto& [ name, info ] : _layout.fields) {
+        ret += node_overhead + sizeof(decltype(_layout.fields)::value_type) + details::item_bytes(info.item);
+    }
+    return ret;
+}
+
+inline auto registry_stats() -> vector<class_stats> {
+    vector<class_stats> ret;
+    for (auto stats : details::stats_registry()) {
+        ret.push_back(*stats);
+        ret.back().bytes = layout_bytes(*stats->layout);
+    }
+    return ret;
+}
+
+inline void dump_registry_stats(ostream& _out) {
+    auto stats = registry_stats();
+    sort(stats.begin(), stats.end(), [](auto& _a, auto& _b) { return _a.registration_ns > _b.registration_ns; });
+
+    auto total = class_stats{};
+    _out << left << setw(40) << "class" << right << setw(14) << "time (us)" << setw(10) << "allocs" << setw(12) << "bytes" << setw(8) << "errors" << "\n";
+    for (auto& s : stats) {
+        _out << left  << setw(40) << s.layout->name
+             << right << setw(14) << fixed << setprecision(3) << static_cast<double>(s.registration_ns) / 1000.0
+             << setw(10) << s.allocations << setw(12) << s.bytes << setw(8) << s.errors << "\n";
+        total.registration_ns += s.registration_ns;
+        total.allocations     += s.allocations;
+        total.bytes           += s.bytes;
+        total.errors          += s.errors;
+    }
+    _out << left  << setw(40) << "total"
+         << right << setw(14) << fixed << setprecision(3) << static_cast<double>(total.registration_ns) / 1000.0
+         << setw(10) << total.allocations << setw(12) << total.bytes << setw(8) << total.errors << "\n";
+}
+
+// fingerprint
+
+constexpr auto fingerprint_bytes(const char* _data, size_t _size, uint64_t _hash) -> uint64_t {
+    for (auto i = size_t{0}; i < _size; ++i) {
+        _hash = (_hash ^ static_cast<uint8_t>(_data[i])) * 0x100000001B3;
+    }
+    return _hash;
+}
+
+namespace details {
+
+inline auto fingerprint_value(uint64_t _value, uint64_t _hash) -> uint64_t {
+    char bytes[sizeof(_value)] = {};
+    for (auto i = 0u; i < sizeof(_value); ++i) {
+        bytes[i] = static_cast<char>(_value >> (i * CHAR_BIT));
+    }
+    return fingerprint_bytes(bytes, sizeof(bytes), _hash);
+}
+
+inline auto fingerprint_item(const item_t& _item, uint64_t _hash) -> uint64_t {
+    _hash = fingerprint_value(static_cast<uint64_t>(_item.category), _hash);
+    _hash = fingerprint_value(_item.ranges.size(), _hash);
+    for (auto bit : _item.ranges) {
+        _hash = fingerprint_value(bit, _hash);
+    }
+    switch (_item.category) {
+        case item_category::arithmetic:
+        case item_category::bitfield: {
+            _hash = fingerprint_value(_item.data.encoded_arithmetic, _hash);
+            break;
+        }
+        case item_category::klass: {
+            _hash = fingerprint_value(_item.data.klass.id, _hash);
+            _hash = fingerprint_value(layout_fingerprint(_item.data.klass.layout()), _hash); // not cached: it may be registered later (lazily)
+            break;
+        }
+        case item_category::container: {
+            _hash = fingerprint_value(_item.data.container.count, _hash);
+            for (auto i = 0u; i < _item.data.container.count; ++i) {
+                _hash = fingerprint_item(_item.data.container.items[i], _hash);
+            }
+            break;
+        }
+        case item_category::dynamic: {
+            _hash = fingerprint_value(_item.data.dynamic.ops->elem_size, _hash);
+            _hash = fingerprint_item(*_item.data.dynamic.elem, _hash);
+            break;
+        }
+        case item_category::tagged: {
+            _hash = fingerprint_value(_item.data.tagged.ops->count, _hash);
+            for (auto i = 0u; i < _item.data.tagged.ops->count; ++i) {
+                _hash = fingerprint_value(_item.data.tagged.ops->sizes[i], _hash);
+                _hash = fingerprint_item(_item.data.tagged.items[i], _hash);
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+    return _hash;
+}
+
+} // namespace details
+
+inline auto layout_fingerprint(const class_layout& _layout) -> uint64_t {
+
+    // the fields map is keyed by pointer so it is sorted by name first
+
+    vector<const pair<const char* const, field_info_t>*> fields;
+    for (auto& field : _layout.fields) {
+        fields.push_back(&field);
+    }
+    sort(fields.begin(), fields.end(), [](auto _a, auto _b) { return strcmp(_a->first, _b->first) < 0; });
+
+    auto ret = details::fingerprint_value(_layout.id, fingerprint_seed);
+    ret = details::fingerprint_value(fields.size(), ret);
+    for (auto field : fields) {
+        ret = fingerprint_bytes(field->first, strlen(field->first) + 1, ret);
+        ret = details::fingerprint_item(field->second.item, ret);
+    }
+    return ret;
+}
+
+template<typename T>
+auto layout_fingerprint() -> uint64_t {
+    static const auto ret = layout_fingerprint(get_layout<T>());
+    return ret;
+}
+
 } // namespace map_layout
 } // namespace qcstudio
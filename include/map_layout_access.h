@@ -0,0 +1,377 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+#include "map_layout_index.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Typed access to fields by name at runtime
+
+    A 'field_ref' is an arithmetic or bit-field leaf resolved once ('make_field_ref<T>(name)',
+    container elements named with their path, e.g. "pos[1]") into its position, width and
+    encoding. It reads and writes that field of any T record:
+
+        auto price = make_field_ref<tick>("price");
+        double value;
+        if (price.get(record, value)) { ... }         // checked
+        price.set(record, 101.5);
+        auto fast = price.read<double>(record);        // unchecked: a load and a conversion
+
+    - 'get' fails unless every value of the field converts to U without loss ('accepts<U>()'
+      tells in advance): integers into integers or reals wide enough, float into float or
+      double, double into double. bool fields hold one bit.
+    - 'set' fails, leaving the record untouched, unless the field holds the value exactly
+      (NaN and the infinities included for real fields).
+    - 'read' and 'write' skip the checks and convert like static_cast (integers written to
+      narrower fields keep their low bits).
+
+    'get_field'/'set_field' resolve the name on every call; keep a 'field_ref' for repeated
+    access. Bit-fields are written with a read-modify-write of the bytes they span, which is
+    not atomic with respect to their neighbors.
+*/
+
+enum class field_kind : uint8_t {
+    none,
+    boolean,
+    sint,
+    uint,
+    real
+};
+
+class field_ref {
+public:
+    field_ref() = default;
+
+    auto valid () const -> bool       { return type != field_kind::none; }
+    auto kind  () const -> field_kind { return type; }
+    auto offset() const -> size_t     { return first_bit; } // in bits
+    auto bits  () const -> uint32_t   { return width; }
+
+    template<typename U> auto accepts() const -> bool;
+
+    template<typename U> auto get  (const void* _record, U& _out) const -> bool;
+    template<typename U> auto set  (void* _record, U _value) const -> bool;
+    template<typename U> auto read (const void* _record) const -> U;
+    template<typename U> void write(void* _record, U _value) const;
+
+private:
+    template<typename T> friend auto make_field_ref(const char* _name) -> field_ref;
+
+    enum class access : uint8_t { bits, sbits, b8, u8, u16, u32, u64, s8, s16, s32, s64, f32, f64 };
+
+    auto load (const void* _record) const -> uint64_t; // raw bits, zero-extended
+    void store(void* _record, uint64_t _raw) const;
+
+    access     mode      = access::bits;
+    size_t     first_bit = 0;
+    size_t     byte      = 0;
+    uint32_t   shift     = 0;
+    uint32_t   width     = 0;  // bits of storage
+    uint32_t   digits    = 0;  // bits of value (1 for bool, width - 1 for signed integers)
+    int        exponent  = 0;  // 'max_exponent' of reals
+    field_kind type      = field_kind::none;
+};
+
+template<typename T> auto make_field_ref(const char* _name) -> field_ref;
+
+template<typename T, typename U> auto get_field(const T& _obj, const char* _name, U& _out) -> bool;
+template<typename T, typename U> auto set_field(T& _obj, const char* _name, U _value) -> bool;
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+// integer values carried as a sign and a magnitude so that any source fits
+
+struct wide_integer {
+    bool     negative;
+    uint64_t magnitude;
+};
+
+template<typename U>
+auto to_wide_integer(U _value, wide_integer& _out) -> bool {
+    if constexpr (is_floating_point<U>::value) {
+        const auto d = static_cast<double>(_value);
+        if (!(d == d) || trunc(d) != d || d <= -18446744073709551616.0 || d >= 18446744073709551616.0 || static_cast<U>(d) != _value) {
+            return false;
+        }
+        _out = { d < 0, static_cast<uint64_t>(d < 0 ? -d : d) };
+    } else if constexpr (is_signed<U>::value) {
+        const auto v = static_cast<int64_t>(_value);
+        _out = { v < 0, v < 0 ? ~static_cast<uint64_t>(v) + 1 : static_cast<uint64_t>(v) };
+    } else {
+        _out = { false, static_cast<uint64_t>(_value) };
+    }
+    return true;
+}
+
+template<typename V>
+auto load_as(const uint8_t* _src) -> V {
+    V ret;
+    memcpy(&ret, _src, sizeof(V));
+    return ret;
+}
+
+template<typename V>
+void store_as(uint8_t* _dst, V _value) {
+    memcpy(_dst, &_value, sizeof(V));
+}
+
+} // namespace details
+
+template<typename T>
+auto make_field_ref(const char* _name) -> field_ref {
+    auto ret = field_ref{};
+    auto hit = get_field_index<T>().leaf(_name);
+    if (!hit || (hit->item->category != item_category::arithmetic && hit->item->category != item_category::bitfield)) {
+        return ret;
+    }
+    const auto encoding = hit->item->data.encoded_arithmetic;
+    const auto width    = static_cast<uint32_t>(hit->last_bit - hit->first_bit + 1);
+    const auto real     = hit->item->category == item_category::arithmetic && (encoding & 0b11) == 0b11;
+    if (width > 64 || (real && width != 32 && width != 64)) {
+        return ret;
+    }
+    ret.first_bit = hit->first_bit;
+    ret.byte      = hit->first_bit / CHAR_BIT;
+    ret.shift     = static_cast<uint32_t>(hit->first_bit % CHAR_BIT);
+    ret.width     = width;
+    if (real) {
+        ret.type     = field_kind::real;
+        ret.digits   = width == 32 ? numeric_limits<float>::digits       : numeric_limits<double>::digits;
+        ret.exponent = width == 32 ? numeric_limits<float>::max_exponent : numeric_limits<double>::max_exponent;
+    } else if ((encoding & 0b11) == 0) {
+        ret.type   = field_kind::boolean;
+        ret.digits = 1;
+    } else if ((encoding & 0b100) == 0) {
+        ret.type   = field_kind::sint;
+        ret.digits = width - 1;
+    } else {
+        ret.type   = field_kind::uint;
+        ret.digits = width;
+    }
+
+    // whole aligned values are read with one load of their type, bit-fields through 'load'
+
+    const auto whole = ret.shift == 0 && (width == 8 || width == 16 || width == 32 || width == 64);
+    const auto log2  = width == 8 ? 0 : width == 16 ? 1 : width == 32 ? 2 : 3;
+    using access = field_ref::access;
+    switch (ret.type) {
+        case field_kind::real:    ret.mode = width == 32 ? access::f32 : access::f64;                                           break;
+        case field_kind::boolean: ret.mode = whole && width == 8 ? access::b8 : access::bits;                                   break;
+        case field_kind::sint:    ret.mode = whole ? static_cast<access>(static_cast<int>(access::s8) + log2) : access::sbits; break;
+        default:                  ret.mode = whole ? static_cast<access>(static_cast<int>(access::u8) + log2) : access::bits;  break;
+    }
+    return ret;
+}
+
+template<typename U>
+inline auto field_ref::accepts() const -> bool {
+    static_assert(is_arithmetic<U>::value, "Fields can only be read into arithmetic types");
+    return type != field_kind::none
+        && (type != field_kind::real || is_floating_point<U>::value)
+        && (type != field_kind::sint || numeric_limits<U>::is_signed)
+        && numeric_limits<U>::digits >= static_cast<int>(digits)
+        && numeric_limits<U>::max_exponent >= exponent;
+}
+
+inline auto field_ref::load(const void* _record) const -> uint64_t {
+    const auto src = static_cast<const uint8_t*>(_record) + byte;
+    if (shift == 0) {
+        switch (width) {
+            case  8: return *src;
+            case 16: { uint16_t v; memcpy(&v, src, 2); return v; }
+            case 32: { uint32_t v; memcpy(&v, src, 4); return v; }
+            case 64: { uint64_t v; memcpy(&v, src, 8); return v; }
+            default: break;
+        }
+    }
+    const auto bytes = (shift + width + CHAR_BIT - 1) / CHAR_BIT;
+    auto value = uint64_t{0};
+    for (auto i = 0u; i < bytes && i < 8; ++i) {
+        value |= static_cast<uint64_t>(src[i]) << (i * CHAR_BIT);
+    }
+    value >>= shift;
+    if (bytes > 8) {
+        value |= static_cast<uint64_t>(src[8]) << (64 - shift);
+    }
+    return width == 64 ? value : value & ((uint64_t{1} << width) - 1);
+}
+
+inline void field_ref::store(void* _record, uint64_t _raw) const {
+    const auto dst = static_cast<uint8_t*>(_record) + byte;
+    if (shift == 0) {
+        switch (width) {
+            case  8: { *dst = static_cast<uint8_t>(_raw); return; }
+            case 16: { auto v = static_cast<uint16_t>(_raw); memcpy(dst, &v, 2); return; }
+            case 32: { auto v = static_cast<uint32_t>(_raw); memcpy(dst, &v, 4); return; }
+            case 64: { memcpy(dst, &_raw, 8); return; }
+            default: break;
+        }
+    }
+
+    // read-modify-write of the bytes spanned by the bit-field
+
+    const auto bytes = (shift + width + CHAR_BIT - 1) / CHAR_BIT;
+    const auto mask  = width == 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1;
+    _raw &= mask;
+    for (auto i = 0u; i < bytes; ++i) {
+        const auto pos  = static_cast<int>(i * CHAR_BIT) - static_cast<int>(shift); // value bit at bit 0 of this byte
+        const auto bits = pos < 0 ? (mask << -pos) : (pos < 64 ? mask >> pos : 0);
+        const auto val  = pos < 0 ? (_raw << -pos) : (pos < 64 ? _raw >> pos : 0);
+        dst[i] = static_cast<uint8_t>((dst[i] & ~bits) | (val & bits));
+    }
+}
+
+template<typename U>
+inline auto field_ref::read(const void* _record) const -> U {
+    const auto src = static_cast<const uint8_t*>(_record) + byte;
+    switch (mode) {
+        case access::b8:  return static_cast<U>(*src != 0);
+        case access::u8:  return static_cast<U>(*src);
+        case access::u16: return static_cast<U>(details::load_as<uint16_t>(src));
+        case access::u32: return static_cast<U>(details::load_as<uint32_t>(src));
+        case access::u64: return static_cast<U>(details::load_as<uint64_t>(src));
+        case access::s8:  return static_cast<U>(details::load_as<int8_t  >(src));
+        case access::s16: return static_cast<U>(details::load_as<int16_t >(src));
+        case access::s32: return static_cast<U>(details::load_as<int32_t >(src));
+        case access::s64: return static_cast<U>(details::load_as<int64_t >(src));
+        case access::f32: return static_cast<U>(details::load_as<float   >(src));
+        case access::f64: return static_cast<U>(details::load_as<double  >(src));
+        case access::sbits: {
+            const auto sign = uint64_t{1} << (width - 1);
+            return static_cast<U>(static_cast<int64_t>((load(_record) ^ sign) - sign));
+        }
+        default: {
+            return static_cast<U>(load(_record));
+        }
+    }
+}
+
+template<typename U>
+inline void field_ref::write(void* _record, U _value) const {
+    const auto dst = static_cast<uint8_t*>(_record) + byte;
+    switch (mode) {
+        case access::b8:    *dst = _value != U{0} ? 1 : 0;                                            break;
+        case access::u8:    *dst = static_cast<uint8_t>(_value);                                      break;
+        case access::u16:   details::store_as(dst, static_cast<uint16_t>(_value));                    break;
+        case access::u32:   details::store_as(dst, static_cast<uint32_t>(_value));                    break;
+        case access::u64:   details::store_as(dst, static_cast<uint64_t>(_value));                    break;
+        case access::s8:    details::store_as(dst, static_cast<int8_t  >(_value));                    break;
+        case access::s16:   details::store_as(dst, static_cast<int16_t >(_value));                    break;
+        case access::s32:   details::store_as(dst, static_cast<int32_t >(_value));                    break;
+        case access::s64:   details::store_as(dst, static_cast<int64_t >(_value));                    break;
+        case access::f32:   details::store_as(dst, static_cast<float   >(_value));                    break;
+        case access::f64:   details::store_as(dst, static_cast<double  >(_value));                    break;
+        case access::sbits: store(_record, static_cast<uint64_t>(static_cast<int64_t>(_value)));      break;
+        default: {
+            store(_record, type == field_kind::boolean ? _value != U{0} : static_cast<uint64_t>(_value));
+            break;
+        }
+    }
+}
+
+template<typename U>
+inline auto field_ref::get(const void* _record, U& _out) const -> bool {
+    if (!accepts<U>()) {
+        return false;
+    }
+    _out = read<U>(_record);
+    return true;
+}
+
+template<typename U>
+inline auto field_ref::set(void* _record, U _value) const -> bool {
+    static_assert(is_arithmetic<U>::value, "Fields can only be written from arithmetic types");
+    switch (type) {
+        case field_kind::real: {
+            auto d = 0.0;
+            if constexpr (is_floating_point<U>::value) {
+                d = static_cast<double>(_value);
+                if (d == d && static_cast<U>(d) != _value) {
+                    return false;
+                }
+            } else {
+                auto v = details::wide_integer{};
+                details::to_wide_integer(_value, v);
+                const auto m = static_cast<double>(v.magnitude);
+                if (m >= 18446744073709551616.0 || static_cast<uint64_t>(m) != v.magnitude) {
+                    return false;
+                }
+                d = v.negative ? -m : m;
+            }
+            if (width == 32 && std::isfinite(d) && (fabs(d) > numeric_limits<float>::max() || static_cast<double>(static_cast<float>(d)) != d)) {
+                return false;
+            }
+            write(_record, d);
+            return true;
+        }
+        case field_kind::sint:
+        case field_kind::uint:
+        case field_kind::boolean: {
+            auto v = details::wide_integer{};
+            if (!details::to_wide_integer(_value, v)) {
+                return false;
+            }
+            const auto limit = digits == 64 ? ~uint64_t{0} : (uint64_t{1} << digits) - 1; // largest positive value
+            if (v.negative ? (type != field_kind::sint || v.magnitude - 1 > limit) : v.magnitude > limit) {
+                return false;
+            }
+            store(_record, v.negative ? ~v.magnitude + 1 : v.magnitude);
+            return true;
+        }
+        default: {
+            return false;
+        }
+    }
+}
+
+template<typename T, typename U>
+auto get_field(const T& _obj, const char* _name, U& _out) -> bool {
+    return make_field_ref<T>(_name).get(&_obj, _out);
+}
+
+template<typename T, typename U>
+auto set_field(T& _obj, const char* _name, U _value) -> bool {
+    return make_field_ref<T>(_name).set(&_obj, _value);
+}
+
+} // namespace map_layout
+} // namespace qcstudio
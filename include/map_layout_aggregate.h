@@ -0,0 +1,572 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ML_AGGREGATE_AVX2 1
+#endif
+
+#include "map_layout_index.h"
+#include "map_layout_parallel.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Aggregations over a field of record arrays
+
+    'aggregate<T>' reads one arithmetic or bit-field leaf of every record of an array in place
+    (at its offset and with the type given by its encoding) and returns an 'aggregation' with
+    the number of records, the sum, the minimum and the maximum of the values and, when a
+    'histogram' is given, their distribution:
+
+        auto a = aggregate(ticks.data(), ticks.size(), "price", histogram{ 90.0, 110.0, 20 });
+        a.sum.as<double>() / a.count;
+
+    - Sum, min and max are exact and kept in the domain of the field: 'sint', 'uint' or 'real'
+      ('as<V>()' converts them). Integer sums wrap modulo 2^64, real sums are doubles.
+    - NaN values are counted in 'nans' and skipped by everything else. Min and max are 0 when
+      there are no values.
+    - The histogram splits [lo, hi) in 'bins' equal bins; values outside go to 'below' and
+      'above'.
+
+    The array is processed in the chunks of 'parallel_for_each' (see map_layout_parallel.h) and
+    the partial results are merged in order, so passing a 'thread_pool' spreads the chunks over
+    its threads without changing the result. With AVX2, fields of 1 to 8 bytes and bit-fields
+    fitting in a 32-bit word are gathered 8 (or 4) records at a time.
+
+    The aggregation is not valid for unknown fields, fields that are not arithmetic or long
+    doubles.
+*/
+
+struct aggregate_value {
+    enum class kind : uint8_t { sint, uint, real } type = kind::sint;
+    int64_t  sint = 0;
+    uint64_t uint = 0;
+    double   real = 0;
+
+    template<typename V> auto as() const -> V;
+};
+
+struct histogram {
+    double lo, hi;
+    size_t bins;
+};
+
+struct aggregation {
+    bool            valid = false;
+    size_t          count = 0; // records
+    size_t          nans  = 0;
+    aggregate_value sum, min, max;
+    vector<size_t>  bins;      // histogram, if requested
+    size_t          below = 0, above = 0;
+};
+
+template<typename T> auto aggregate(const T* _records, size_t _count, const char* _field) -> aggregation;
+template<typename T> auto aggregate(const T* _records, size_t _count, const char* _field, const histogram& _hist) -> aggregation;
+template<typename T> auto aggregate(thread_pool& _pool, const T* _records, size_t _count, const char* _field) -> aggregation;
+template<typename T> auto aggregate(thread_pool& _pool, const T* _records, size_t _count, const char* _field, const histogram& _hist) -> aggregation;
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+enum class value_kind : uint8_t { sint, uint, real32, real64 };
+
+struct value_leaf {
+    value_kind kind;
+    size_t     byte;  // first byte of the field
+    uint32_t   shift; // first bit inside that byte (bit-fields)
+    uint32_t   bits;  // width of the value
+    uint32_t   bytes; // bytes spanned by the value
+};
+
+inline auto make_value_leaf(const field_index& _index, const char* _field, value_leaf& _leaf) -> bool {
+    auto hit = _index.leaf(_field);
+    if (!hit || (hit->item->category != item_category::arithmetic && hit->item->category != item_category::bitfield)) {
+        return false;
+    }
+    const auto encoding = hit->item->data.encoded_arithmetic;
+    const auto real     = hit->item->category == item_category::arithmetic && (encoding & 0b11) == 0b11;
+    _leaf.byte  = hit->first_bit / CHAR_BIT;
+    _leaf.shift = static_cast<uint32_t>(hit->first_bit % CHAR_BIT);
+    _leaf.bits  = static_cast<uint32_t>(hit->last_bit - hit->first_bit + 1);
+    _leaf.bytes = (_leaf.shift + _leaf.bits + CHAR_BIT - 1) / CHAR_BIT;
+    _leaf.kind  = real ? (_leaf.bits == 32 ? value_kind::real32 : value_kind::real64) : (encoding & 0b100) == 0 ? value_kind::sint : value_kind::uint;
+    return _leaf.bits <= 64 && (!real || _leaf.bits == 32 || _leaf.bits == 64);
+}
+
+// partial results of a chunk, in the domain of the field (int64_t, uint64_t or double)
+
+template<typename A>
+struct aggregate_state {
+    A              sum    = 0;
+    A              min    = numeric_limits<A>::has_infinity ? numeric_limits<A>::infinity()  : numeric_limits<A>::max();
+    A              max    = numeric_limits<A>::has_infinity ? -numeric_limits<A>::infinity() : numeric_limits<A>::lowest();
+    size_t         values = 0;
+    size_t         nans   = 0;
+    vector<size_t> bins;
+    size_t         below  = 0, above = 0;
+};
+
+// integer sums wrap (computed as unsigned to avoid signed overflow)
+
+template<typename A>
+auto add_sum(A _a, A _b) -> A {
+    if constexpr (is_floating_point<A>::value) {
+        return _a + _b;
+    } else {
+        return static_cast<A>(static_cast<uint64_t>(_a) + static_cast<uint64_t>(_b));
+    }
+}
+
+template<typename A>
+void merge_state(aggregate_state<A>& _into, const aggregate_state<A>& _part) {
+    _into.sum     = add_sum(_into.sum, _part.sum);
+    _into.min     = min(_into.min, _part.min);
+    _into.max     = max(_into.max, _part.max);
+    _into.values += _part.values;
+    _into.nans   += _part.nans;
+    _into.below  += _part.below;
+    _into.above  += _part.above;
+    for (auto i = 0u; i < _part.bins.size(); ++i) {
+        _into.bins[i] += _part.bins[i];
+    }
+}
+
+// scalar loads, returning the value widened to int64_t, uint64_t or double
+
+template<typename V>
+struct value_loader {
+    auto operator()(const uint8_t* _src) const -> V {
+        V value;
+        memcpy(&value, _src, sizeof(V));
+        return value;
+    }
+};
+
+inline auto load_bits(const uint8_t* _src, const value_leaf& _leaf) -> uint64_t {
+    auto value = uint64_t{0};
+    for (auto i = 0u; i < _leaf.bytes && i < 8; ++i) {
+        value |= static_cast<uint64_t>(_src[i]) << (i * CHAR_BIT);
+    }
+    value >>= _leaf.shift;
+    if (_leaf.bytes > 8) {
+        value |= static_cast<uint64_t>(_src[8]) << (64 - _leaf.shift);
+    }
+    if (_leaf.bits < 64) {
+        value &= (uint64_t{1} << _leaf.bits) - 1;
+        if (_leaf.kind == value_kind::sint) {
+            const auto sign = uint64_t{1} << (_leaf.bits - 1);
+            value = (value ^ sign) - sign;
+        }
+    }
+    return value;
+}
+
+template<typename A, typename LOAD>
+void scan_values(const uint8_t* _src, size_t _stride, size_t _first, size_t _count, aggregate_state<A>& _state, LOAD&& _load) {
+    auto sum = _state.sum, lo = _state.min, hi = _state.max;
+    for (auto i = _first; i < _count; ++i) {
+        const auto value = static_cast<A>(_load(_src + i * _stride));
+        if (value != value) {
+            ++_state.nans;
+            continue;
+        }
+        sum  = add_sum(sum, value);
+        lo   = min(lo, value);
+        hi   = max(hi, value);
+        ++_state.values;
+    }
+    _state.sum = sum;
+    _state.min = lo;
+    _state.max = hi;
+}
+
+template<typename A, typename LOAD>
+void scan_histogram(const uint8_t* _src, size_t _stride, size_t _count, const histogram& _hist, aggregate_state<A>& _state, LOAD&& _load) {
+    const auto scale = static_cast<double>(_hist.bins) / (_hist.hi - _hist.lo);
+    for (auto i = size_t{0}; i < _count; ++i) {
+        const auto value = static_cast<double>(_load(_src + i * _stride));
+        if (value != value) {
+            continue;
+        } else if (value < _hist.lo) {
+            ++_state.below;
+        } else if (value >= _hist.hi) {
+            ++_state.above;
+        } else {
+            ++_state.bins[min(_hist.bins - 1, static_cast<size_t>((value - _hist.lo) * scale))];
+        }
+    }
+}
+
+// calls '_fn(load)' with the scalar loader of the leaf
+
+template<typename F>
+void with_loader(const value_leaf& _leaf, F&& _fn) {
+    if (_leaf.shift == 0) {
+        switch (_leaf.kind) {
+            case value_kind::real32: _fn(value_loader<float>{});  return;
+            case value_kind::real64: _fn(value_loader<double>{}); return;
+            case value_kind::sint: {
+                switch (_leaf.bits) {
+                    case  8: _fn(value_loader<int8_t> {}); return;
+                    case 16: _fn(value_loader<int16_t>{}); return;
+                    case 32: _fn(value_loader<int32_t>{}); return;
+                    case 64: _fn(value_loader<int64_t>{}); return;
+                    default: break;
+                }
+                break;
+            }
+            case value_kind::uint: {
+                switch (_leaf.bits) {
+                    case  8: _fn(value_loader<uint8_t> {}); return;
+                    case 16: _fn(value_loader<uint16_t>{}); return;
+                    case 32: _fn(value_loader<uint32_t>{}); return;
+                    case 64: _fn(value_loader<uint64_t>{}); return;
+                    default: break;
+                }
+                break;
+            }
+        }
+    }
+    if (_leaf.kind == value_kind::sint) {
+        _fn([&](const uint8_t* _p) { return static_cast<int64_t>(load_bits(_p, _leaf)); });
+    } else {
+        _fn([&](const uint8_t* _p) { return load_bits(_p, _leaf); });
+    }
+}
+
+#if ML_AGGREGATE_AVX2
+
+__attribute__((target("avx2")))
+inline auto horizontal_sum(__m256i _v) -> uint64_t {
+    alignas(32) uint64_t lanes[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), _v);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+// integers fitting in 32-bit lanes (see 'scan32_avx2' in map_layout_filter.h for the shifts);
+// full-width unsigned values use the unsigned min/max and zero extension
+
+template<typename A>
+__attribute__((target("avx2")))
+auto sum32_avx2(const uint8_t* _src, size_t _stride, size_t _count, const value_leaf& _leaf, aggregate_state<A>& _state) -> size_t {
+    const auto s     = static_cast<int>(_stride);
+    const auto idx   = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+    const auto left  = _mm_cvtsi32_si128(static_cast<int>(32 - _leaf.shift - _leaf.bits));
+    const auto right = _mm_cvtsi32_si128(static_cast<int>(32 - _leaf.bits));
+    const auto is_signed = _leaf.kind == value_kind::sint;
+    const auto full      = !is_signed && _leaf.bits == 32;
+
+    auto sum = _mm256_setzero_si256();
+    auto lo  = _mm256_set1_epi32(full ? -1 : INT_MAX);
+    auto hi  = _mm256_set1_epi32(full ? 0 : INT_MIN);
+    auto i   = size_t{0};
+    for (; i + 8 <= _count; i += 8) {
+        auto v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(_src + i * _stride + _leaf.byte), idx, 1);
+        v = _mm256_sll_epi32(v, left);
+        v = is_signed ? _mm256_sra_epi32(v, right) : _mm256_srl_epi32(v, right);
+        if (full) {
+            sum = _mm256_add_epi64(sum, _mm256_add_epi64(_mm256_cvtepu32_epi64(_mm256_castsi256_si128(v)), _mm256_cvtepu32_epi64(_mm256_extracti128_si256(v, 1))));
+            lo  = _mm256_min_epu32(lo, v);
+            hi  = _mm256_max_epu32(hi, v);
+        } else {
+            sum = _mm256_add_epi64(sum, _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)), _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1))));
+            lo  = _mm256_min_epi32(lo, v);
+            hi  = _mm256_max_epi32(hi, v);
+        }
+    }
+
+    alignas(32) int32_t los[8], his[8];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(los), lo);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(his), hi);
+    if (i) {
+        for (auto l = 0; l < 8; ++l) {
+            const auto a = full ? static_cast<A>(static_cast<uint32_t>(los[l])) : static_cast<A>(los[l]);
+            const auto b = full ? static_cast<A>(static_cast<uint32_t>(his[l])) : static_cast<A>(his[l]);
+            _state.min = min(_state.min, a);
+            _state.max = max(_state.max, b);
+        }
+    }
+    _state.sum    = static_cast<A>(static_cast<uint64_t>(_state.sum) + horizontal_sum(sum));
+    _state.values += i;
+    return i;
+}
+
+// 64-bit integers (no 64-bit min/max in AVX2: compare and blend, with the sign bit flipped for
+// unsigned values)
+
+template<typename A>
+__attribute__((target("avx2")))
+auto sum64_avx2(const uint8_t* _src, size_t _stride, size_t _count, const value_leaf& _leaf, aggregate_state<A>& _state) -> size_t {
+    const auto s    = static_cast<long long>(_stride);
+    const auto idx  = _mm256_setr_epi64x(0, s, 2 * s, 3 * s);
+    const auto bias = _mm256_set1_epi64x(_leaf.kind == value_kind::sint ? 0 : LLONG_MIN);
+
+    auto sum = _mm256_setzero_si256();
+    auto lo  = _mm256_set1_epi64x(LLONG_MAX);
+    auto hi  = _mm256_set1_epi64x(LLONG_MIN);
+    auto i   = size_t{0};
+    for (; i + 4 <= _count; i += 4) {
+        const auto v = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(_src + i * _stride + _leaf.byte), idx, 1);
+        const auto k = _mm256_xor_si256(v, bias);
+        sum = _mm256_add_epi64(sum, v);
+        lo  = _mm256_blendv_epi8(lo, k, _mm256_cmpgt_epi64(lo, k));
+        hi  = _mm256_blendv_epi8(hi, k, _mm256_cmpgt_epi64(k, hi));
+    }
+
+    alignas(32) int64_t los[4], his[4];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(los), _mm256_xor_si256(lo, bias));
+    _mm256_store_si256(reinterpret_cast<__m256i*>(his), _mm256_xor_si256(hi, bias));
+    if (i) {
+        for (auto l = 0; l < 4; ++l) {
+            _state.min = min(_state.min, static_cast<A>(los[l]));
+            _state.max = max(_state.max, static_cast<A>(his[l]));
+        }
+    }
+    _state.sum    = static_cast<A>(static_cast<uint64_t>(_state.sum) + horizontal_sum(sum));
+    _state.values += i;
+    return i;
+}
+
+// reals: NaN lanes are masked out of the sum and left out of min/max ('min_ps(v, acc)'
+// returns 'acc' when 'v' is NaN); floats are summed as doubles
+
+__attribute__((target("avx2")))
+inline auto sum_float_avx2(const uint8_t* _src, size_t _stride, size_t _count, const value_leaf& _leaf, aggregate_state<double>& _state) -> size_t {
+    const auto s   = static_cast<int>(_stride);
+    const auto idx = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+
+    auto sum  = _mm256_setzero_pd();
+    auto lo   = _mm256_set1_ps(numeric_limits<float>::infinity());
+    auto hi   = _mm256_set1_ps(-numeric_limits<float>::infinity());
+    auto nans = size_t{0};
+    auto i    = size_t{0};
+    for (; i + 8 <= _count; i += 8) {
+        const auto v       = _mm256_i32gather_ps(reinterpret_cast<const float*>(_src + i * _stride + _leaf.byte), idx, 1);
+        const auto ordered = _mm256_cmp_ps(v, v, _CMP_ORD_Q);
+        const auto masked  = _mm256_and_ps(v, ordered);
+        sum  = _mm256_add_pd(sum, _mm256_add_pd(_mm256_cvtps_pd(_mm256_castps256_ps128(masked)), _mm256_cvtps_pd(_mm256_extractf128_ps(masked, 1))));
+        lo   = _mm256_min_ps(v, lo);
+        hi   = _mm256_max_ps(v, hi);
+        nans += 8 - static_cast<size_t>(__builtin_popcount(static_cast<unsigned>(_mm256_movemask_ps(ordered))));
+    }
+
+    alignas(32) float los[8], his[8];
+    alignas(32) double sums[4];
+    _mm256_store_ps(los, lo);
+    _mm256_store_ps(his, hi);
+    _mm256_store_pd(sums, sum);
+    for (auto l = 0; l < 8; ++l) {
+        _state.min = min(_state.min, static_cast<double>(los[l]));
+        _state.max = max(_state.max, static_cast<double>(his[l]));
+    }
+    _state.sum    += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    _state.nans   += nans;
+    _state.values += i - nans;
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline auto sum_double_avx2(const uint8_t* _src, size_t _stride, size_t _count, const value_leaf& _leaf, aggregate_state<double>& _state) -> size_t {
+    const auto s   = static_cast<long long>(_stride);
+    const auto idx = _mm256_setr_epi64x(0, s, 2 * s, 3 * s);
+
+    auto sum  = _mm256_setzero_pd();
+    auto lo   = _mm256_set1_pd(numeric_limits<double>::infinity());
+    auto hi   = _mm256_set1_pd(-numeric_limits<double>::infinity());
+    auto nans = size_t{0};
+    auto i    = size_t{0};
+    for (; i + 4 <= _count; i += 4) {
+        const auto v       = _mm256_i64gather_pd(reinterpret_cast<const double*>(_src + i * _stride + _leaf.byte), idx, 1);
+        const auto ordered = _mm256_cmp_pd(v, v, _CMP_ORD_Q);
+        sum  = _mm256_add_pd(sum, _mm256_and_pd(v, ordered));
+        lo   = _mm256_min_pd(v, lo);
+        hi   = _mm256_max_pd(v, hi);
+        nans += 4 - static_cast<size_t>(__builtin_popcount(static_cast<unsigned>(_mm256_movemask_pd(ordered))));
+    }
+
+    alignas(32) double los[4], his[4], sums[4];
+    _mm256_store_pd(los, lo);
+    _mm256_store_pd(his, hi);
+    _mm256_store_pd(sums, sum);
+    for (auto l = 0; l < 4; ++l) {
+        _state.min = min(_state.min, los[l]);
+        _state.max = max(_state.max, his[l]);
+    }
+    _state.sum    += (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    _state.nans   += nans;
+    _state.values += i - nans;
+    return i;
+}
+
+template<typename A>
+auto sum_avx2(const uint8_t* _src, size_t _stride, size_t _count, const value_leaf& _leaf, aggregate_state<A>& _state) -> size_t {
+    if constexpr (is_floating_point<A>::value) {
+        return _leaf.kind == value_kind::real32 ? sum_float_avx2(_src, _stride, _count, _leaf, _state) : sum_double_avx2(_src, _stride, _count, _leaf, _state);
+    } else {
+        if (_leaf.shift == 0 && _leaf.bits == 64) {
+            return sum64_avx2(_src, _stride, _count, _leaf, _state);
+        }
+        return _leaf.shift + _leaf.bits <= 32 ? sum32_avx2(_src, _stride, _count, _leaf, _state) : 0;
+    }
+}
+
+#endif
+
+// one chunk; '_avail' bytes are readable from '_src' (the gathers read whole 4 or 8-byte
+// words, which for narrow fields of the last records may go past the end)
+
+template<typename A>
+auto aggregate_chunk(const uint8_t* _src, size_t _stride, size_t _count, size_t _avail, const value_leaf& _leaf, const histogram* _hist) -> aggregate_state<A> {
+    auto state = aggregate_state<A>{};
+    auto first = size_t{0};
+#if ML_AGGREGATE_AVX2
+    static const auto has_avx2 = __builtin_cpu_supports("avx2") != 0;
+    if (has_avx2 && _stride <= INT_MAX / 8) {
+        const auto load = size_t{_leaf.kind == value_kind::real64 || _leaf.bits == 64 ? 8u : 4u};
+        const auto safe = _avail < _leaf.byte + load ? 0 : min(_count, (_avail - _leaf.byte - load) / _stride + 1);
+        first = sum_avx2(_src, _stride, safe, _leaf, state);
+    }
+#else
+    (void)_avail;
+#endif
+    with_loader(_leaf, [&](auto _load) {
+        scan_values(_src + _leaf.byte, _stride, first, _count, state, _load);
+        if (_hist) {
+            state.bins.assign(_hist->bins, 0);
+            scan_histogram(_src + _leaf.byte, _stride, _count, *_hist, state, _load);
+        }
+    });
+    return state;
+}
+
+template<typename A>
+auto aggregate_as(thread_pool* _pool, const uint8_t* _src, size_t _stride, size_t _count, size_t _chunk, const value_leaf& _leaf, const histogram* _hist) -> aggregate_state<A> {
+    const auto chunks = (_count + _chunk - 1) / _chunk;
+    vector<aggregate_state<A>> parts(chunks);
+    auto run = [&](size_t _c) {
+        const auto first = _c * _chunk;
+        parts[_c] = aggregate_chunk<A>(_src + first * _stride, _stride, min(_chunk, _count - first), (_count - first) * _stride, _leaf, _hist);
+    };
+    if (_pool) {
+        _pool->run(chunks, run);
+    } else {
+        for (auto c = size_t{0}; c < chunks; ++c) {
+            run(c);
+        }
+    }
+
+    auto ret = aggregate_state<A>{};
+    ret.bins.assign(_hist ? _hist->bins : 0, 0);
+    for (auto& part : parts) {
+        merge_state(ret, part);
+    }
+    return ret;
+}
+
+template<typename T>
+auto aggregate(thread_pool* _pool, const T* _records, size_t _count, const char* _field, const histogram* _hist) -> aggregation {
+    auto ret  = aggregation{};
+    auto leaf = value_leaf{};
+    if (!make_value_leaf(get_field_index<T>(), _field, leaf) || (_hist && (!_hist->bins || !(_hist->lo < _hist->hi)))) {
+        return ret;
+    }
+
+    auto fill = [&](auto&& _state, aggregate_value::kind _kind, auto aggregate_value::* _member) {
+        ret.valid = true;
+        ret.count = _count;
+        ret.nans  = _state.nans;
+        ret.bins  = move(_state.bins);
+        ret.below = _state.below;
+        ret.above = _state.above;
+        for (auto v : { &ret.sum, &ret.min, &ret.max }) {
+            v->type = _kind;
+        }
+        ret.sum.*_member = _state.sum;
+        if (_state.values) {
+            ret.min.*_member = _state.min;
+            ret.max.*_member = _state.max;
+        }
+    };
+    const auto src = reinterpret_cast<const uint8_t*>(_records);
+    switch (leaf.kind) {
+        case value_kind::sint: fill(aggregate_as<int64_t> (_pool, src, sizeof(T), _count, chunk_records<T>(), leaf, _hist), aggregate_value::kind::sint, &aggregate_value::sint); break;
+        case value_kind::uint: fill(aggregate_as<uint64_t>(_pool, src, sizeof(T), _count, chunk_records<T>(), leaf, _hist), aggregate_value::kind::uint, &aggregate_value::uint); break;
+        default:               fill(aggregate_as<double>  (_pool, src, sizeof(T), _count, chunk_records<T>(), leaf, _hist), aggregate_value::kind::real, &aggregate_value::real); break;
+    }
+    return ret;
+}
+
+} // namespace details
+
+template<typename V>
+auto aggregate_value::as() const -> V {
+    switch (type) {
+        case kind::sint: return static_cast<V>(sint);
+        case kind::uint: return static_cast<V>(uint);
+        default:         return static_cast<V>(real);
+    }
+}
+
+template<typename T>
+auto aggregate(const T* _records, size_t _count, const char* _field) -> aggregation {
+    return details::aggregate<T>(nullptr, _records, _count, _field, nullptr);
+}
+
+template<typename T>
+auto aggregate(const T* _records, size_t _count, const char* _field, const histogram& _hist) -> aggregation {
+    return details::aggregate<T>(nullptr, _records, _count, _field, &_hist);
+}
+
+template<typename T>
+auto aggregate(thread_pool& _pool, const T* _records, size_t _count, const char* _field) -> aggregation {
+    return details::aggregate<T>(&_pool, _records, _count, _field, nullptr);
+}
+
+template<typename T>
+auto aggregate(thread_pool& _pool, const T* _records, size_t _count, const char* _field, const histogram& _hist) -> aggregation {
+    return details::aggregate<T>(&_pool, _records, _count, _field, &_hist);
+}
+
+} // namespace map_layout
+} // namespace qcstudio
@@ -0,0 +1,265 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <type_traits>
+
+#include "map_layout_index.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Lock-free updates of bit-fields shared between threads
+
+    Neighboring bit-fields share their storage, so writing one of them with plain code races
+    with writers of the others. An 'atomic_bits' is a bit-field (or integer) leaf resolved once
+    ('make_atomic_bits<T>(name)') into the aligned word that contains it, and updates it with
+    atomic operations on that word:
+
+        auto state = make_atomic_bits<status>("state");
+        state.store(&shared, 3);                            // CAS loop, neighbors untouched
+        state.fetch_or(&shared, 0b100);                     // a single atomic or
+        auto expected = uint64_t{3};
+        state.compare_exchange(&shared, expected, 5);       // fails only if 'state' != 3
+
+    - Values are the raw bits of the field, zero-extended (two's complement for signed fields);
+      the handle methods keep the low 'bits()' bits of the values they are given.
+    - 'compare_exchange' compares the field alone: changes to the neighbors only retry the loop.
+    - Every operation is sequentially consistent.
+
+    All the fields of T use words of the same size, alignof(T) bytes up to 8 (the widest lock-free
+    word), so that concurrent updates of neighbors always go through the same atomic object.
+    Fields that straddle two words (any field spanning two bytes of a packed type) are refused
+    and the handle is invalid; so are real fields. Records must be aligned to alignof(T), as
+    they are in any array of T, and every thread must update the word through these functions.
+
+    'atomic_load_bits', 'atomic_store_bits', 'atomic_fetch_or_bits', 'atomic_fetch_and_bits' and
+    'atomic_compare_exchange_bits' resolve the name on every call and return false if the field
+    is refused or the value does not fit in it; keep an 'atomic_bits' for repeated updates.
+*/
+
+class atomic_bits {
+public:
+    atomic_bits() = default;
+
+    auto valid () const -> bool     { return width != 0; }
+    auto offset() const -> size_t   { return byte * CHAR_BIT + shift; } // in bits
+    auto bits  () const -> uint32_t { return width; }
+    auto word  () const -> uint32_t { return word_bytes; }              // bytes updated atomically
+    auto mask  () const -> uint64_t { return width == 64 ? ~uint64_t{0} : (uint64_t{1} << width) - 1; }
+
+    auto load            (const void* _record) const -> uint64_t;
+    void store           (void* _record, uint64_t _value) const;
+    auto fetch_or        (void* _record, uint64_t _value) const -> uint64_t; // previous value
+    auto fetch_and       (void* _record, uint64_t _value) const -> uint64_t;
+    auto compare_exchange(void* _record, uint64_t& _expected, uint64_t _desired) const -> bool; // on failure _expected gets the current value
+
+private:
+    template<typename T> friend auto make_atomic_bits(const char* _name) -> atomic_bits;
+
+    template<typename F> auto on_word(const void* _record, F&& _fn) const;
+
+    size_t   byte       = 0; // of the word
+    uint32_t word_bytes = 0;
+    uint32_t shift      = 0; // of the field inside the word
+    uint32_t width      = 0;
+};
+
+template<typename T> auto make_atomic_bits(const char* _name) -> atomic_bits;
+
+template<typename T> auto atomic_load_bits            (const T* _obj, const char* _name, uint64_t& _out) -> bool;
+template<typename T> auto atomic_store_bits           (T* _obj, const char* _name, uint64_t _value) -> bool;
+template<typename T> auto atomic_fetch_or_bits        (T* _obj, const char* _name, uint64_t _value, uint64_t* _previous = nullptr) -> bool;
+template<typename T> auto atomic_fetch_and_bits       (T* _obj, const char* _name, uint64_t _value, uint64_t* _previous = nullptr) -> bool;
+template<typename T> auto atomic_compare_exchange_bits(T* _obj, const char* _name, uint64_t& _expected, uint64_t _desired) -> bool;
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+// the words are accessed in place as std::atomic of the same size (as the shared memory ring does)
+
+template<typename W>
+auto atomic_word_at(const void* _record, size_t _byte) -> atomic<W>& {
+    static_assert(sizeof(atomic<W>) == sizeof(W) && alignof(atomic<W>) == sizeof(W), "atomic words must have the layout of plain words");
+    return *reinterpret_cast<atomic<W>*>(const_cast<uint8_t*>(static_cast<const uint8_t*>(_record) + _byte));
+}
+
+constexpr auto max_atomic_word() -> size_t {
+    return atomic<uint64_t>::is_always_lock_free ? 8 : atomic<uint32_t>::is_always_lock_free ? 4 : atomic<uint16_t>::is_always_lock_free ? 2 : 1;
+}
+
+} // namespace details
+
+template<typename T>
+auto make_atomic_bits(const char* _name) -> atomic_bits {
+    auto ret = atomic_bits{};
+    auto hit = get_field_index<T>().leaf(_name);
+    if (!hit || (hit->item->category != item_category::arithmetic && hit->item->category != item_category::bitfield)) {
+        return ret;
+    }
+    if (hit->item->category == item_category::arithmetic && (hit->item->data.encoded_arithmetic & 0b11) == 0b11) {
+        return ret; // reals have no meaningful bitwise updates
+    }
+
+    // the aligned word of alignof(T) bytes (at most the widest lock-free word) holding [first_bit, last_bit]
+
+    const auto bytes = min(details::max_atomic_word(), alignof(T));
+    const auto start = (hit->first_bit / CHAR_BIT) & ~(bytes - 1);
+    if (hit->last_bit < (start + bytes) * CHAR_BIT) {
+        ret.byte       = start;
+        ret.word_bytes = static_cast<uint32_t>(bytes);
+        ret.shift      = static_cast<uint32_t>(hit->first_bit - start * CHAR_BIT);
+        ret.width      = static_cast<uint32_t>(hit->last_bit - hit->first_bit + 1);
+    }
+    return ret;
+}
+
+template<typename F>
+inline auto atomic_bits::on_word(const void* _record, F&& _fn) const {
+    switch (word_bytes) {
+        case 1:  return _fn(details::atomic_word_at<uint8_t >(_record, byte));
+        case 2:  return _fn(details::atomic_word_at<uint16_t>(_record, byte));
+        case 4:  return _fn(details::atomic_word_at<uint32_t>(_record, byte));
+        default: return _fn(details::atomic_word_at<uint64_t>(_record, byte));
+    }
+}
+
+inline auto atomic_bits::load(const void* _record) const -> uint64_t {
+    return on_word(_record, [&](auto& _word) {
+        return (static_cast<uint64_t>(_word.load()) >> shift) & mask();
+    });
+}
+
+inline void atomic_bits::store(void* _record, uint64_t _value) const {
+    on_word(_record, [&](auto& _word) {
+        using W = typename remove_reference_t<decltype(_word)>::value_type;
+        const auto bits  = static_cast<W>(mask() << shift);
+        const auto value = static_cast<W>((_value & mask()) << shift);
+        auto old = _word.load(memory_order_relaxed);
+        while (!_word.compare_exchange_weak(old, static_cast<W>((old & ~bits) | value))) {
+        }
+    });
+}
+
+inline auto atomic_bits::fetch_or(void* _record, uint64_t _value) const -> uint64_t {
+    return on_word(_record, [&](auto& _word) {
+        using W = typename remove_reference_t<decltype(_word)>::value_type;
+        return (static_cast<uint64_t>(_word.fetch_or(static_cast<W>((_value & mask()) << shift))) >> shift) & mask();
+    });
+}
+
+inline auto atomic_bits::fetch_and(void* _record, uint64_t _value) const -> uint64_t {
+    return on_word(_record, [&](auto& _word) {
+        using W = typename remove_reference_t<decltype(_word)>::value_type;
+        return (static_cast<uint64_t>(_word.fetch_and(static_cast<W>(~((~_value & mask()) << shift)))) >> shift) & mask();
+    });
+}
+
+inline auto atomic_bits::compare_exchange(void* _record, uint64_t& _expected, uint64_t _desired) const -> bool {
+    return on_word(_record, [&](auto& _word) {
+        using W = typename remove_reference_t<decltype(_word)>::value_type;
+        const auto bits  = static_cast<W>(mask() << shift);
+        const auto value = static_cast<W>((_desired & mask()) << shift);
+        auto old = _word.load();
+        for (;;) {
+            const auto current = (static_cast<uint64_t>(old) >> shift) & mask();
+            if (current != (_expected & mask())) {
+                _expected = current;
+                return false;
+            }
+            if (_word.compare_exchange_weak(old, static_cast<W>((old & ~bits) | value))) {
+                return true;
+            }
+        }
+    });
+}
+
+template<typename T>
+auto atomic_load_bits(const T* _obj, const char* _name, uint64_t& _out) -> bool {
+    const auto field = make_atomic_bits<T>(_name);
+    if (!field.valid()) {
+        return false;
+    }
+    _out = field.load(_obj);
+    return true;
+}
+
+template<typename T>
+auto atomic_store_bits(T* _obj, const char* _name, uint64_t _value) -> bool {
+    const auto field = make_atomic_bits<T>(_name);
+    if (!field.valid() || (_value & ~field.mask())) {
+        return false;
+    }
+    field.store(_obj, _value);
+    return true;
+}
+
+template<typename T>
+auto atomic_fetch_or_bits(T* _obj, const char* _name, uint64_t _value, uint64_t* _previous) -> bool {
+    const auto field = make_atomic_bits<T>(_name);
+    if (!field.valid() || (_value & ~field.mask())) {
+        return false;
+    }
+    const auto previous = field.fetch_or(_obj, _value);
+    if (_previous) {
+        *_previous = previous;
+    }
+    return true;
+}
+
+template<typename T>
+auto atomic_fetch_and_bits(T* _obj, const char* _name, uint64_t _value, uint64_t* _previous) -> bool {
+    const auto field = make_atomic_bits<T>(_name);
+    if (!field.valid() || (_value & ~field.mask())) {
+        return false;
+    }
+    const auto previous = field.fetch_and(_obj, _value);
+    if (_previous) {
+        *_previous = previous;
+    }
+    return true;
+}
+
+template<typename T>
+auto atomic_compare_exchange_bits(T* _obj, const char* _name, uint64_t& _expected, uint64_t _desired) -> bool {
+    const auto field = make_atomic_bits<T>(_name);
+    if (!field.valid() || (_desired & ~field.mask())) {
+        return false;
+    }
+    return field.compare_exchange(_obj, _expected, _desired);
+}
+
+} // namespace map_layout
+} // namespace qcstudio
@@ -0,0 +1,264 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <climits>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "map_layout.h"
+#include "map_layout_iovec.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Code generation of specialized functions
+
+    A small driver that links the registered types writes a header with straight-line
+    functions for each of them (see the 'codegen' project):
+
+        generate_prologue(out, "my_generated");
+        generate_class<my_type>(out, "my_ns::my_type");
+        generate_epilogue(out, "my_generated");
+
+    For every class the generated namespace gets:
+
+    - 'packed<T>::size' and 'packed<T>::fingerprint' (the 'layout_fingerprint' of the layout
+      the code was generated from; compare it at start-up to detect stale code)
+    - 'serialize(const T&, uint8_t*)' / 'deserialize(const uint8_t*, T&)': the registered bytes
+      without padding ('byte_runs<T>') back-to-back, one fixed-size memcpy per run
+    - 'hash(const T&)': FNV-1a over the values of every leaf field
+    - 'equal(const T&, const T&)': bitwise comparison of every leaf field
+
+    Offsets, sizes, shifts and masks are constants and bit-fields are read with constant
+    shifts, so the compiler can inline and merge everything. Nested classes are hashed and
+    compared as raw bytes (padding included) and variable-length and tagged members are left
+    out.
+*/
+
+inline void generate_prologue(ostream& _out, const string& _namespace);
+inline void generate_epilogue(ostream& _out, const string& _namespace);
+
+template<typename T> void generate_class(ostream& _out, const string& _type_name);
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+struct code_leaf {
+    size_t first_bit;
+    size_t bits;
+    bool   is_bitfield;
+};
+
+inline void collect_code_leaves(const item_t& _item, vector<code_leaf>& _out) {
+    switch (_item.category) {
+        case item_category::container: {
+            for (auto i = 0u; i < _item.data.container.count; ++i) {
+                collect_code_leaves(_item.data.container.items[i], _out);
+            }
+            break;
+        }
+        case item_category::arithmetic:
+        case item_category::bitfield:
+        case item_category::pointer:
+        case item_category::klass: {
+            const auto first = static_cast<size_t>(_item.ranges.front());
+            _out.push_back({ first, _item.ranges.back() - first + 1, _item.category == item_category::bitfield });
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+// C++ expressions reading a leaf from the byte pointer '_ptr'
+
+inline auto load_expression(const char* _ptr, size_t _offset, size_t _bytes) -> string {
+    const char* type = _bytes == 8 ? "uint64_t" : _bytes == 4 ? "uint32_t" : _bytes == 2 ? "uint16_t" : "uint8_t";
+    return string("load<") + type + ">(" + _ptr + " + " + to_string(_offset) + ")";
+}
+
+inline auto bitfield_expression(const char* _ptr, const code_leaf& _leaf) -> string {
+    const auto first = _leaf.first_bit / CHAR_BIT;
+    const auto shift = _leaf.first_bit % CHAR_BIT;
+    const auto span  = (shift + _leaf.bits + CHAR_BIT - 1) / CHAR_BIT;
+    const auto mask  = _leaf.bits == 64 ? ~uint64_t{0} : (uint64_t{1} << _leaf.bits) - 1;
+
+    // assembled byte by byte (little-endian bit numbering); compilers turn it into one load
+
+    string bytes;
+    for (auto i = 0u; i < span && i < 8; ++i) {
+        bytes += (i ? " | " : "") + string("uint64_t(") + _ptr + "[" + to_string(first + i) + "])" + (i ? " << " + to_string(i * CHAR_BIT) : "");
+    }
+    auto ret = "((" + bytes + ") >> " + to_string(shift) + ")";
+    if (span > 8) {
+        ret = "(" + ret + " | uint64_t(" + _ptr + "[" + to_string(first + 8) + "]) << " + to_string(64 - shift) + ")";
+    }
+    return "(" + ret + " & " + to_string(mask) + "ull)";
+}
+
+// a leaf as a list of integer expressions (wide leaves are split in 8/4/2/1-byte loads)
+
+inline auto leaf_expressions(const char* _ptr, const code_leaf& _leaf) -> vector<string> {
+    if (_leaf.is_bitfield) {
+        return { bitfield_expression(_ptr, _leaf) };
+    }
+    vector<string> ret;
+    auto offset = _leaf.first_bit / CHAR_BIT;
+    auto left   = _leaf.bits / CHAR_BIT;
+    for (auto chunk : { 8u, 4u, 2u, 1u }) {
+        for (; left >= chunk; left -= chunk, offset += chunk) {
+            ret.push_back(load_expression(_ptr, offset, chunk));
+        }
+    }
+    return ret;
+}
+
+} // namespace details
+
+inline void generate_prologue(ostream& _out, const string& _namespace) {
+    _out << "// generated by map_layout code generation; do not edit\n"
+         << "\n"
+         << "#pragma once\n"
+         << "\n"
+         << "#include <cstddef>\n"
+         << "#include <cstdint>\n"
+         << "#include <cstring>\n"
+         << "\n"
+         << "namespace " << _namespace << " {\n"
+         << "\n"
+         << "template<typename T> struct packed;\n"
+         << "\n"
+         << "template<typename U>\n"
+         << "inline auto load(const uint8_t* _ptr) -> U {\n"
+         << "    U ret;\n"
+         << "    std::memcpy(&ret, _ptr, sizeof(U));\n"
+         << "    return ret;\n"
+         << "}\n";
+}
+
+inline void generate_epilogue(ostream& _out, const string& _namespace) {
+    _out << "\n} // namespace " << _namespace << "\n";
+}
+
+template<typename T>
+void generate_class(ostream& _out, const string& _type_name) {
+    auto& layout = get_layout<T>();
+    auto& runs   = byte_runs<T>();
+
+    vector<details::code_leaf> leaves;
+    for (auto& [ name, info ] : layout.fields) {
+        details::collect_code_leaves(info.item, leaves);
+    }
+    sort(leaves.begin(), leaves.end(), [](auto& _a, auto& _b) { return tie(_a.first_bit, _a.bits) < tie(_b.first_bit, _b.bits); });
+
+    auto size = size_t{0};
+    for (auto& run : runs) {
+        size += run.size;
+    }
+
+    _out << "\n"
+         << "// " << layout.name << "\n"
+         << "\n"
+         << "template<> struct packed<" << _type_name << "> {\n"
+         << "    static constexpr size_t   size        = " << size << ";\n"
+         << "    static constexpr uint64_t fingerprint = 0x" << hex << layout_fingerprint<T>() << dec << "ull;\n"
+         << "};\n";
+
+    // serialize / deserialize
+
+    _out << "\n"
+         << "inline void serialize(const " << _type_name << "& _obj, uint8_t* _out) {\n"
+         << "    auto src = reinterpret_cast<const uint8_t*>(&_obj);\n";
+    auto packed_offset = size_t{0};
+    for (auto& run : runs) {
+        _out << "    std::memcpy(_out + " << packed_offset << ", src + " << run.offset << ", " << run.size << ");\n";
+        packed_offset += run.size;
+    }
+    if (runs.empty()) {
+        _out << "    (void)src;\n";
+    }
+    _out << "}\n"
+         << "\n"
+         << "inline void deserialize(const uint8_t* _in, " << _type_name << "& _obj) {\n"
+         << "    auto dst = reinterpret_cast<uint8_t*>(&_obj);\n";
+    packed_offset = 0;
+    for (auto& run : runs) {
+        _out << "    std::memcpy(dst + " << run.offset << ", _in + " << packed_offset << ", " << run.size << ");\n";
+        packed_offset += run.size;
+    }
+    if (runs.empty()) {
+        _out << "    (void)dst;\n";
+    }
+    _out << "}\n";
+
+    // hash / equal
+
+    _out << "\n"
+         << "inline auto hash(const " << _type_name << "& _obj) -> uint64_t {\n"
+         << "    auto p = reinterpret_cast<const uint8_t*>(&_obj);\n"
+         << "    auto h = uint64_t{0x" << hex << fingerprint_seed << dec << "};\n";
+    for (auto& leaf : leaves) {
+        for (auto& expr : details::leaf_expressions("p", leaf)) {
+            _out << "    h = (h ^ " << expr << ") * 0x100000001b3ull;\n";
+        }
+    }
+    if (leaves.empty()) {
+        _out << "    (void)p;\n";
+    }
+    _out << "    return h;\n"
+         << "}\n"
+         << "\n"
+         << "inline auto equal(const " << _type_name << "& _a, const " << _type_name << "& _b) -> bool {\n"
+         << "    auto a = reinterpret_cast<const uint8_t*>(&_a);\n"
+         << "    auto b = reinterpret_cast<const uint8_t*>(&_b);\n"
+         << "    return true";
+    for (auto& leaf : leaves) {
+        auto lhs = details::leaf_expressions("a", leaf);
+        auto rhs = details::leaf_expressions("b", leaf);
+        for (auto i = 0u; i < lhs.size(); ++i) {
+            _out << "\n        && " << lhs[i] << " == " << rhs[i];
+        }
+    }
+    if (leaves.empty()) {
+        _out << " || a == b"; // keeps both pointers used
+    }
+    _out << ";\n"
+         << "}\n";
+}
+
+} // namespace map_layout
+} // namespace qcstudio
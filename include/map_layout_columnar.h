@@ -0,0 +1,532 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ML_COLUMNAR_AVX2 1
+#endif
+
+#include "map_layout.h"
+#include "map_layout_serializer.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Layout-aware columnar compression
+
+    'compress' transposes an array of records into one column per registered leaf and encodes
+    every column with a codec chosen from its type:
+
+    - integers, characters and pointers: delta + zigzag, bit-packed
+    - bools and bit-fields:              run-length, values and run lengths bit-packed
+    - float and double:                  XOR with the previous value, common trailing zero bits
+                                         dropped, bit-packed
+    - anything else (nested classes, long double): raw bytes
+
+    Bit-packing widths are sized from the observed values of every column. Padding is never
+    stored and variable-length or tagged members are skipped (use the serializer for those).
+
+    'decompress' resizes '_objs' to the stored number of records and writes back every column;
+    it returns the number of bytes consumed or 0 if the input is truncated, malformed or was
+    produced from a different layout (the stream carries the layout fingerprint). The number of
+    records is checked against what the column headers can hold before '_objs' is resized.
+    Unpacking uses AVX2 when the CPU supports it.
+*/
+
+template<typename T> void compress  (const T* _objs, size_t _count, vector<uint8_t>& _out);
+template<typename T> auto decompress(const uint8_t* _data, size_t _size, vector<T>& _objs) -> size_t;
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+enum class column_codec : uint8_t {
+    raw, delta_zigzag, run_length, xor_delta
+};
+
+struct column {
+    column_codec codec;
+    size_t       first_bit;
+    size_t       bits;       // width of the value in the record
+    bool         is_signed;
+    bool         is_bitfield;
+};
+
+struct column_header {
+    uint8_t  codec;
+    uint8_t  value_bits;   // packed width of values
+    uint8_t  length_bits;  // packed width of run lengths (run_length only)
+    uint8_t  shift;        // dropped trailing zero bits (xor_delta only)
+    uint32_t reserved;
+    uint64_t runs;         // number of packed values
+    uint64_t bytes;        // payload size
+};
+
+constexpr auto columnar_magic = uint32_t{0x434C4D4C}; // "LMLC"
+
+inline void collect_columns(const item_t& _item, vector<column>& _out) {
+    const auto first = static_cast<size_t>(_item.ranges.empty() ? 0 : _item.ranges[0]);
+    const auto bits  = static_cast<size_t>(_item.ranges.empty() ? 0 : _item.ranges[1] - _item.ranges[0] + 1);
+    switch (_item.category) {
+        case item_category::container: {
+            for (auto i = 0u; i < _item.data.container.count; ++i) {
+                collect_columns(_item.data.container.items[i], _out);
+            }
+            break;
+        }
+        case item_category::arithmetic: {
+            const auto kind      = _item.data.encoded_arithmetic & 0b11;
+            const auto is_signed = (_item.data.encoded_arithmetic & 0b100) == 0;
+            if (kind == 0) {
+                _out.push_back({ column_codec::run_length, first, bits, false, false });
+            } else if (kind == 3) {
+                _out.push_back({ bits == 32 || bits == 64 ? column_codec::xor_delta : column_codec::raw, first, bits, false, false });
+            } else {
+                _out.push_back({ bits <= 64 ? column_codec::delta_zigzag : column_codec::raw, first, bits, is_signed, false });
+            }
+            break;
+        }
+        case item_category::bitfield: {
+            _out.push_back({ column_codec::run_length, first, bits, false, true });
+            break;
+        }
+        case item_category::pointer: {
+            _out.push_back({ column_codec::delta_zigzag, first, bits, false, false });
+            break;
+        }
+        case item_category::klass: {
+            _out.push_back({ column_codec::raw, first, bits, false, false });
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+template<typename T>
+auto get_columns() -> const vector<column>& {
+    static const auto ret = [] {
+        vector<column> columns;
+        for (auto& [ name, info ] : get_layout<T>().fields) {
+            collect_columns(info.item, columns);
+        }
+        sort(columns.begin(), columns.end(), [](auto& _a, auto& _b) { return tie(_a.first_bit, _a.bits, _a.codec) < tie(_b.first_bit, _b.bits, _b.codec); });
+        return columns;
+    }();
+    return ret;
+}
+
+// record <-> value (whole bytes are read through fixed-width integers to stay endian-agnostic)
+
+inline auto read_value(const uint8_t* _record, const column& _col) -> uint64_t {
+    auto ret = uint64_t{0};
+    if (_col.is_bitfield) {
+        for (auto i = 0u; i < _col.bits; ++i) {
+            const auto bit = _col.first_bit + i;
+            ret |= static_cast<uint64_t>((_record[bit / CHAR_BIT] >> (bit % CHAR_BIT)) & 1) << i;
+        }
+        return ret;
+    }
+    const auto field = _record + _col.first_bit / CHAR_BIT;
+    switch (_col.bits) {
+        case  8: { uint8_t  v; memcpy(&v, field, 1); ret = _col.is_signed ? static_cast<uint64_t>(static_cast<int8_t> (v)) : v; break; }
+        case 16: { uint16_t v; memcpy(&v, field, 2); ret = _col.is_signed ? static_cast<uint64_t>(static_cast<int16_t>(v)) : v; break; }
+        case 32: { uint32_t v; memcpy(&v, field, 4); ret = _col.is_signed ? static_cast<uint64_t>(static_cast<int32_t>(v)) : v; break; }
+        case 64: { memcpy(&ret, field, 8); break; }
+    }
+    return ret;
+}
+
+inline void write_value(uint8_t* _record, const column& _col, uint64_t _value) {
+    if (_col.is_bitfield) {
+        for (auto i = 0u; i < _col.bits; ++i) {
+            const auto bit  = _col.first_bit + i;
+            const auto mask = static_cast<uint8_t>(1u << (bit % CHAR_BIT));
+            _record[bit / CHAR_BIT] = static_cast<uint8_t>(((_value >> i) & 1) ? (_record[bit / CHAR_BIT] | mask) : (_record[bit / CHAR_BIT] & ~mask));
+        }
+        return;
+    }
+    const auto field = _record + _col.first_bit / CHAR_BIT;
+    switch (_col.bits) {
+        case  8: { auto v = static_cast<uint8_t> (_value); memcpy(field, &v, 1); break; }
+        case 16: { auto v = static_cast<uint16_t>(_value); memcpy(field, &v, 2); break; }
+        case 32: { auto v = static_cast<uint32_t>(_value); memcpy(field, &v, 4); break; }
+        case 64: { memcpy(field, &_value, 8); break; }
+    }
+}
+
+// bit-packing (values are packed LSB first; 'pack_padding' trailing bytes allow 8-byte loads)
+
+constexpr auto pack_padding = size_t{16};
+
+inline auto bit_width(uint64_t _value) -> uint8_t {
+    auto ret = uint8_t{0};
+    for (; _value; _value >>= 1) {
+        ++ret;
+    }
+    return ret;
+}
+
+inline auto packed_bytes(size_t _count, size_t _bits) -> size_t {
+    return (_count * _bits + CHAR_BIT - 1) / CHAR_BIT + pack_padding;
+}
+
+inline void pack(const uint64_t* _values, size_t _count, size_t _bits, vector<uint8_t>& _out) {
+    const auto base = _out.size();
+    _out.resize(base + packed_bytes(_count, _bits), 0);
+    auto dst = _out.data() + base;
+    for (auto i = 0u; i < _count; ++i) {
+        const auto bit   = i * _bits;
+        auto       value = _values[i];
+        for (auto done = size_t{0}; done < _bits; ) {
+            const auto pos   = bit + done;
+            const auto chunk = min<size_t>(CHAR_BIT - pos % CHAR_BIT, _bits - done);
+            dst[pos / CHAR_BIT] |= static_cast<uint8_t>((value & ((1u << chunk) - 1)) << (pos % CHAR_BIT));
+            value >>= chunk;
+            done   += chunk;
+        }
+    }
+}
+
+inline auto load_u64(const uint8_t* _addr) -> uint64_t {
+    auto ret = uint64_t{0};
+    for (auto i = 0u; i < 8; ++i) {
+        ret |= static_cast<uint64_t>(_addr[i]) << (i * CHAR_BIT);
+    }
+    return ret;
+}
+
+inline auto unpack_one(const uint8_t* _src, size_t _index, size_t _bits, uint64_t _mask) -> uint64_t {
+    const auto bit   = _index * _bits;
+    const auto shift = bit % CHAR_BIT;
+    auto value = load_u64(_src + bit / CHAR_BIT) >> shift;
+    if (shift + _bits > 64) {
+        value |= static_cast<uint64_t>(_src[bit / CHAR_BIT + 8]) << (64 - shift);
+    }
+    return value & _mask;
+}
+
+inline void unpack_scalar(const uint8_t* _src, size_t _count, size_t _bits, uint64_t* _out) {
+    const auto mask = _bits == 64 ? ~uint64_t{0} : (uint64_t{1} << _bits) - 1;
+    for (auto i = 0u; i < _count; ++i) {
+        _out[i] = unpack_one(_src, i, _bits, mask);
+    }
+}
+
+#if ML_COLUMNAR_AVX2
+
+// four values per iteration: gather the 8 bytes holding each value and shift them in place
+
+__attribute__((target("avx2")))
+inline void unpack_avx2(const uint8_t* _src, size_t _count, size_t _bits, uint64_t* _out) {
+    const auto mask  = _mm256_set1_epi64x(static_cast<long long>((uint64_t{1} << _bits) - 1));
+    const auto seven = _mm256_set1_epi64x(7);
+    const auto step  = _mm256_set1_epi64x(static_cast<long long>(4 * _bits));
+    auto       bit   = _mm256_setr_epi64x(0, static_cast<long long>(_bits), static_cast<long long>(2 * _bits), static_cast<long long>(3 * _bits));
+    auto i = size_t{0};
+    for (; i + 4 <= _count; i += 4) {
+        const auto words = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(_src), _mm256_srli_epi64(bit, 3), 1);
+        const auto value = _mm256_and_si256(_mm256_srlv_epi64(words, _mm256_and_si256(bit, seven)), mask);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(_out + i), value);
+        bit = _mm256_add_epi64(bit, step);
+    }
+    for (; i < _count; ++i) {
+        _out[i] = unpack_one(_src, i, _bits, (uint64_t{1} << _bits) - 1);
+    }
+}
+
+#endif
+
+inline void unpack(const uint8_t* _src, size_t _count, size_t _bits, uint64_t* _out) {
+    if (_bits == 0) {
+        fill(_out, _out + _count, 0);
+        return;
+    }
+#if ML_COLUMNAR_AVX2
+    static const auto has_avx2 = __builtin_cpu_supports("avx2") != 0;
+    if (has_avx2 && _bits <= 57 && _count >= 4) { // 57: a value plus its bit shift fits in one 8-byte load
+        unpack_avx2(_src, _count, _bits, _out);
+        return;
+    }
+#endif
+    unpack_scalar(_src, _count, _bits, _out);
+}
+
+// encoding
+
+inline void write_column(const column& _col, const uint8_t* _base, size_t _stride, size_t _count, vector<uint8_t>& _out) {
+    auto header   = column_header{ static_cast<uint8_t>(_col.codec), 0, 0, 0, 0, _count, 0 };
+    auto payload  = vector<uint8_t>{};
+    auto values   = vector<uint64_t>(_count);
+    for (auto i = 0u; i < _count; ++i) {
+        values[i] = _col.codec == column_codec::raw ? 0 : read_value(_base + i * _stride, _col);
+    }
+
+    switch (_col.codec) {
+        case column_codec::raw: {
+            const auto bytes = _col.bits / CHAR_BIT;
+            payload.resize(_count * bytes);
+            for (auto i = 0u; i < _count; ++i) {
+                memcpy(payload.data() + i * bytes, _base + i * _stride + _col.first_bit / CHAR_BIT, bytes);
+            }
+            break;
+        }
+        case column_codec::delta_zigzag: {
+            auto prev = uint64_t{0}, widest = uint64_t{0};
+            for (auto& value : values) {
+                const auto delta = value - prev;
+                prev   = value;
+                value  = (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+                widest = max(widest, value);
+            }
+            header.value_bits = bit_width(widest);
+            pack(values.data(), _count, header.value_bits, payload);
+            break;
+        }
+        case column_codec::xor_delta: {
+            auto prev = uint64_t{0}, widest = uint64_t{0}, any = uint64_t{0};
+            for (auto& value : values) {
+                const auto x = value ^ prev;
+                prev   = value;
+                value  = x;
+                any   |= x;
+            }
+            while (any && !(any & 1)) {
+                any >>= 1;
+                ++header.shift;
+            }
+            for (auto& value : values) {
+                value >>= header.shift;
+                widest = max(widest, value);
+            }
+            header.value_bits = bit_width(widest);
+            pack(values.data(), _count, header.value_bits, payload);
+            break;
+        }
+        case column_codec::run_length: {
+            auto runs = vector<uint64_t>{}, lengths = vector<uint64_t>{};
+            for (auto i = 0u; i < _count; ++i) {
+                if (!runs.empty() && runs.back() == values[i]) {
+                    ++lengths.back();
+                } else {
+                    runs.push_back(values[i]);
+                    lengths.push_back(0); // stores length - 1
+                }
+            }
+            header.runs        = runs.size();
+            header.value_bits  = runs.empty() ? 0 : bit_width(*max_element(runs.begin(), runs.end()));
+            header.length_bits = runs.empty() ? 0 : bit_width(*max_element(lengths.begin(), lengths.end()));
+            pack(runs.data(), runs.size(), header.value_bits, payload);
+            pack(lengths.data(), lengths.size(), header.length_bits, payload);
+            break;
+        }
+    }
+
+    header.bytes = payload.size();
+    auto bytes = reinterpret_cast<const uint8_t*>(&header);
+    _out.insert(_out.end(), bytes, bytes + sizeof(header));
+    _out.insert(_out.end(), payload.begin(), payload.end());
+}
+
+// decoding
+
+inline auto read_column(const column& _col, const uint8_t* _data, size_t _size, uint8_t* _base, size_t _stride, size_t _count) -> size_t {
+    auto header = column_header{};
+    if (_size < sizeof(header)) {
+        return 0;
+    }
+    memcpy(&header, _data, sizeof(header));
+    const auto payload = _data + sizeof(header);
+    if (header.codec != static_cast<uint8_t>(_col.codec) || header.bytes > _size - sizeof(header) || header.value_bits > 64 || header.length_bits > 64) {
+        return 0;
+    }
+
+    auto values = vector<uint64_t>(_count);
+    switch (_col.codec) {
+        case column_codec::raw: {
+            const auto bytes = _col.bits / CHAR_BIT;
+            if (header.bytes != _count * bytes) {
+                return 0;
+            }
+            for (auto i = 0u; i < _count; ++i) {
+                memcpy(_base + i * _stride + _col.first_bit / CHAR_BIT, payload + i * bytes, bytes);
+            }
+            return sizeof(header) + header.bytes;
+        }
+        case column_codec::delta_zigzag: {
+            if (header.runs != _count || header.bytes != packed_bytes(_count, header.value_bits)) {
+                return 0;
+            }
+            unpack(payload, _count, header.value_bits, values.data());
+            auto prev = uint64_t{0};
+            for (auto& value : values) {
+                prev += (value >> 1) ^ (~(value & 1) + 1);
+                value = prev;
+            }
+            break;
+        }
+        case column_codec::xor_delta: {
+            if (header.runs != _count || header.shift >= 64 || header.bytes != packed_bytes(_count, header.value_bits)) {
+                return 0;
+            }
+            unpack(payload, _count, header.value_bits, values.data());
+            auto prev = uint64_t{0};
+            for (auto& value : values) {
+                prev ^= value << header.shift;
+                value = prev;
+            }
+            break;
+        }
+        case column_codec::run_length: {
+            const auto runs = static_cast<size_t>(header.runs);
+            if (runs > _count || header.bytes != packed_bytes(runs, header.value_bits) + packed_bytes(runs, header.length_bits)) {
+                return 0;
+            }
+            auto lengths = vector<uint64_t>(runs);
+            unpack(payload, runs, header.value_bits, values.data());
+            unpack(payload + packed_bytes(runs, header.value_bits), runs, header.length_bits, lengths.data());
+            auto total = size_t{0};
+            for (auto r = runs; r-- > 0; ) { // expand in place from the back
+                if (lengths[r] >= _count - total) {
+                    return 0;
+                }
+                total += lengths[r] + 1;
+                fill(values.begin() + (_count - total), values.begin() + (_count - total) + lengths[r] + 1, values[r]);
+            }
+            if (total != _count) {
+                return 0;
+            }
+            break;
+        }
+    }
+
+    for (auto i = 0u; i < _count; ++i) {
+        write_value(_base + i * _stride, _col, values[i]);
+    }
+    return sizeof(header) + header.bytes;
+}
+
+// upper bound of the records a column can decode to, from its header alone (no bound for
+// columns of equal values packed with zero bits)
+
+inline auto column_capacity(const column& _col, const column_header& _header) -> uint64_t {
+    constexpr auto unbounded = numeric_limits<uint64_t>::max();
+    switch (_col.codec) {
+        case column_codec::raw: {
+            return _header.bytes / (_col.bits / CHAR_BIT);
+        }
+        case column_codec::delta_zigzag:
+        case column_codec::xor_delta: {
+            return _header.value_bits ? _header.bytes * CHAR_BIT / _header.value_bits : unbounded;
+        }
+        case column_codec::run_length: {
+            const auto bits = static_cast<uint64_t>(_header.value_bits) + _header.length_bits;
+            const auto runs = bits ? min(_header.runs, _header.bytes * CHAR_BIT / bits) : _header.runs;
+            return _header.length_bits >= 64 || runs > (unbounded >> _header.length_bits) ? unbounded : runs << _header.length_bits;
+        }
+    }
+    return 0;
+}
+
+// walks the column headers of a stream, 0 if one is cut or does not match its column
+
+inline auto stream_capacity(const vector<column>& _columns, const uint8_t* _data, size_t _size) -> uint64_t {
+    auto ret = numeric_limits<uint64_t>::max();
+    auto pos = size_t{0};
+    for (auto& col : _columns) {
+        auto header = column_header{};
+        if (_size - pos < sizeof(header)) {
+            return 0;
+        }
+        memcpy(&header, _data + pos, sizeof(header));
+        if (header.codec != static_cast<uint8_t>(col.codec) || header.bytes > _size - pos - sizeof(header)) {
+            return 0;
+        }
+        ret  = min(ret, column_capacity(col, header));
+        pos += sizeof(header) + static_cast<size_t>(header.bytes);
+    }
+    return ret;
+}
+
+} // namespace details
+
+template<typename T>
+void compress(const T* _objs, size_t _count, vector<uint8_t>& _out) {
+    auto& columns = details::get_columns<T>();
+    details::write_scalar(details::columnar_magic, _out);
+    details::write_scalar(layout_fingerprint<T>(), _out);
+    details::write_scalar(static_cast<uint32_t>(columns.size()), _out);
+    details::write_scalar(static_cast<uint64_t>(_count), _out);
+    for (auto& col : columns) {
+        details::write_column(col, reinterpret_cast<const uint8_t*>(_objs), sizeof(T), _count, _out);
+    }
+}
+
+template<typename T>
+auto decompress(const uint8_t* _data, size_t _size, vector<T>& _objs) -> size_t {
+    auto& columns = details::get_columns<T>();
+    auto  magic   = uint32_t{0};
+    auto  layout  = uint64_t{0};
+    auto  ncols   = uint32_t{0};
+    auto  count   = uint64_t{0};
+    auto  in      = details::reader{ _data, _size, 0 };
+    if (!in.read(&magic, sizeof(magic)) || !in.read(&layout, sizeof(layout)) || !in.read(&ncols, sizeof(ncols)) || !in.read(&count, sizeof(count))) {
+        return 0;
+    }
+    if (magic != details::columnar_magic || layout != layout_fingerprint<T>() || ncols != columns.size() || count > numeric_limits<size_t>::max() / sizeof(T)) {
+        return 0;
+    }
+    if (count > details::stream_capacity(columns, _data + in.pos, in.remaining())) {
+        return 0;
+    }
+
+    _objs.resize(static_cast<size_t>(count));
+    for (auto& col : columns) {
+        const auto used = details::read_column(col, _data + in.pos, in.remaining(), reinterpret_cast<uint8_t*>(_objs.data()), sizeof(T), _objs.size());
+        if (!used) {
+            return 0;
+        }
+        in.pos += used;
+    }
+    return in.pos;
+}
+
+} // namespace map_layout
+} // namespace qcstudio
@@ -0,0 +1,357 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "map_layout.h"
+#include "map_layout_serializer.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Per-field dirty tracking and incremental snapshots
+
+    'dirty_bitmap<T>' is a companion of a table of T with one bit per registered leaf field
+    (arithmetic, bit-field, pointer or nested class) and row. Fields are marked through a
+    member pointer, by registered name (needed for bit-fields) or by byte range; every mark
+    flags all the leaves it overlaps.
+
+    'tracked<T>' bundles one object with its bitmap and marks fields as they are set.
+
+    'write_snapshot' appends the bytes of every dirty leaf of a table (the bytes holding the
+    field; bit-fields carry their bytes and only their bits are restored) and clears the
+    bitmap. 'apply_snapshot' replays a snapshot over a table holding the previous state, so
+    a full checkpoint followed by any number of snapshots rebuilds the latest table. It
+    returns the number of bytes consumed or 0 if the input is malformed.
+
+    Variable-length and tagged members are not tracked.
+*/
+
+template<typename T>
+class dirty_bitmap {
+public:
+    explicit dirty_bitmap(size_t _rows = 1);
+
+    auto rows  () const -> size_t { return num_rows; }
+    auto leaves() const -> size_t;
+    void resize(size_t _rows);
+
+    template<typename F> void mark(size_t _row, F T::* _member);
+    void mark      (size_t _row, const char* _fieldname);
+    void mark_bytes(size_t _row, size_t _offset, size_t _size);
+    void mark_all  (size_t _row);
+
+    auto is_dirty  (size_t _row, size_t _leaf) const -> bool;
+    auto is_dirty  (size_t _row) const -> bool;
+    auto next_dirty(size_t _row) const -> size_t; // first dirty row >= _row or rows()
+    void clear();
+
+private:
+    void set(size_t _row, size_t _leaf);
+
+    size_t           num_rows = 0;
+    size_t           words    = 0; // per row
+    vector<uint64_t> bits;
+    vector<uint64_t> summary;      // one bit per row with any leaf dirty
+};
+
+template<typename T>
+class tracked {
+public:
+    tracked() = default;
+    explicit tracked(const T& _value) : value(_value) {}
+
+    auto get  () const -> const T&           { return value; }
+    auto dirty() -> dirty_bitmap<T>&         { return bits;  }
+    auto dirty() const -> const dirty_bitmap<T>& { return bits; }
+
+    template<typename F, typename V> void set(F T::* _member, V&& _value) { value.*_member = forward<V>(_value); bits.mark(0, _member); }
+    template<typename F> auto modify(F T::* _member) -> F& { bits.mark(0, _member); return value.*_member; }
+    auto modify(const char* _fieldname) -> T&            { bits.mark(0, _fieldname); return value; } // e.g. bit-fields
+
+private:
+    T               value{};
+    dirty_bitmap<T> bits{ 1 };
+};
+
+template<typename T> void write_snapshot(const T* _table, dirty_bitmap<T>& _dirty, vector<uint8_t>& _out);
+template<typename T> void write_snapshot(tracked<T>& _obj, vector<uint8_t>& _out);
+template<typename T> auto apply_snapshot(const uint8_t* _data, size_t _size, T* _table, size_t _rows) -> size_t;
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+struct dirty_leaf {
+    const char* field;     // registered name of the owning field
+    size_t      first_bit;
+    size_t      last_bit;
+    bool        is_bitfield;
+
+    auto first_byte() const -> size_t { return first_bit / CHAR_BIT; }
+    auto bytes     () const -> size_t { return last_bit / CHAR_BIT + 1 - first_byte(); }
+};
+
+constexpr auto snapshot_magic = uint32_t{0x534C4D4C}; // "LMLS"
+
+inline void collect_dirty_leaves(const char* _field, const item_t& _item, vector<dirty_leaf>& _out) {
+    switch (_item.category) {
+        case item_category::container: {
+            for (auto i = 0u; i < _item.data.container.count; ++i) {
+                collect_dirty_leaves(_field, _item.data.container.items[i], _out);
+            }
+            break;
+        }
+        case item_category::arithmetic:
+        case item_category::bitfield:
+        case item_category::pointer:
+        case item_category::klass: {
+            _out.push_back({ _field, _item.ranges.front(), _item.ranges.back(), _item.category == item_category::bitfield });
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+// leaves are sorted by position so that indices do not depend on where names live in memory
+
+template<typename T>
+auto dirty_leaves() -> const vector<dirty_leaf>& {
+    static const auto ret = [] {
+        vector<dirty_leaf> leaves;
+        for (auto& [ name, info ] : get_layout<T>().fields) {
+            collect_dirty_leaves(name, info.item, leaves);
+        }
+        sort(leaves.begin(), leaves.end(), [](auto& _a, auto& _b) { return tie(_a.first_bit, _a.last_bit) < tie(_b.first_bit, _b.last_bit); });
+        return leaves;
+    }();
+    return ret;
+}
+
+template<typename T, typename F>
+auto member_offset(F T::* _member) -> size_t {
+    static aligned_storage_t<sizeof(T), alignof(T)> buffer;
+    auto instance = reinterpret_cast<const T*>(&buffer);
+    return static_cast<size_t>(reinterpret_cast<const uint8_t*>(&(instance->*_member)) - reinterpret_cast<const uint8_t*>(instance));
+}
+
+} // namespace details
+
+template<typename T>
+dirty_bitmap<T>::dirty_bitmap(size_t _rows) {
+    words = (details::dirty_leaves<T>().size() + 63) / 64;
+    resize(_rows);
+}
+
+template<typename T>
+auto dirty_bitmap<T>::leaves() const -> size_t {
+    return details::dirty_leaves<T>().size();
+}
+
+template<typename T>
+void dirty_bitmap<T>::resize(size_t _rows) {
+    num_rows = _rows;
+    bits.resize(_rows * words, 0);
+    summary.resize((_rows + 63) / 64, 0);
+}
+
+template<typename T>
+void dirty_bitmap<T>::set(size_t _row, size_t _leaf) {
+    bits[_row * words + _leaf / 64] |= uint64_t{1} << (_leaf % 64);
+    summary[_row / 64] |= uint64_t{1} << (_row % 64);
+}
+
+template<typename T>
+template<typename F>
+void dirty_bitmap<T>::mark(size_t _row, F T::* _member) {
+    mark_bytes(_row, details::member_offset(_member), sizeof(F));
+}
+
+template<typename T>
+void dirty_bitmap<T>::mark(size_t _row, const char* _fieldname) {
+    auto& leaves = details::dirty_leaves<T>();
+    for (auto i = 0u; i < leaves.size(); ++i) {
+        if (!strcmp(leaves[i].field, _fieldname)) {
+            set(_row, i);
+        }
+    }
+}
+
+template<typename T>
+void dirty_bitmap<T>::mark_bytes(size_t _row, size_t _offset, size_t _size) {
+    auto& leaves = details::dirty_leaves<T>();
+    for (auto i = 0u; i < leaves.size() && leaves[i].first_byte() < _offset + _size; ++i) {
+        if (leaves[i].first_byte() + leaves[i].bytes() > _offset) {
+            set(_row, i);
+        }
+    }
+}
+
+template<typename T>
+void dirty_bitmap<T>::mark_all(size_t _row) {
+    for (auto i = 0u; i < leaves(); ++i) {
+        set(_row, i);
+    }
+}
+
+template<typename T>
+auto dirty_bitmap<T>::is_dirty(size_t _row, size_t _leaf) const -> bool {
+    return (bits[_row * words + _leaf / 64] >> (_leaf % 64)) & 1;
+}
+
+template<typename T>
+auto dirty_bitmap<T>::is_dirty(size_t _row) const -> bool {
+    return (summary[_row / 64] >> (_row % 64)) & 1;
+}
+
+template<typename T>
+auto dirty_bitmap<T>::next_dirty(size_t _row) const -> size_t {
+    for (auto word = _row / 64; word < summary.size(); ++word) {
+        auto pending = word == _row / 64 ? summary[word] & (~uint64_t{0} << (_row % 64)) : summary[word];
+        if (pending) {
+            auto row = word * 64;
+            for (; !(pending & 1); pending >>= 1) {
+                ++row;
+            }
+            return row;
+        }
+    }
+    return num_rows;
+}
+
+template<typename T>
+void dirty_bitmap<T>::clear() {
+    fill(bits.begin(), bits.end(), 0);
+    fill(summary.begin(), summary.end(), 0);
+}
+
+/*
+    Snapshot format (native byte order):
+
+    uint32_t magic, uint32_t leaves per row, uint64_t dirty rows, then for every dirty row:
+    uint64_t row, uint32_t dirty leaves and, for every one of them, uint32_t leaf index
+    followed by the bytes of the leaf
+*/
+
+template<typename T>
+void write_snapshot(const T* _table, dirty_bitmap<T>& _dirty, vector<uint8_t>& _out) {
+    auto& leaves = details::dirty_leaves<T>();
+    details::write_scalar(details::snapshot_magic, _out);
+    details::write_scalar(static_cast<uint32_t>(leaves.size()), _out);
+    const auto rows_at = _out.size();
+    details::write_scalar(uint64_t{0}, _out);
+
+    auto rows = uint64_t{0};
+    for (auto row = _dirty.next_dirty(0); row < _dirty.rows(); row = _dirty.next_dirty(row + 1)) {
+        const auto count_at = _out.size();
+        details::write_scalar(static_cast<uint64_t>(row), _out);
+        details::write_scalar(uint32_t{0}, _out);
+
+        auto count = uint32_t{0};
+        auto base  = reinterpret_cast<const uint8_t*>(_table + row);
+        for (auto i = 0u; i < leaves.size(); ++i) {
+            if (_dirty.is_dirty(row, i)) {
+                details::write_scalar(static_cast<uint32_t>(i), _out);
+                _out.insert(_out.end(), base + leaves[i].first_byte(), base + leaves[i].first_byte() + leaves[i].bytes());
+                ++count;
+            }
+        }
+        memcpy(_out.data() + count_at + sizeof(uint64_t), &count, sizeof(count));
+        ++rows;
+    }
+    memcpy(_out.data() + rows_at, &rows, sizeof(rows));
+    _dirty.clear();
+}
+
+template<typename T>
+void write_snapshot(tracked<T>& _obj, vector<uint8_t>& _out) {
+    write_snapshot(&_obj.get(), _obj.dirty(), _out);
+}
+
+template<typename T>
+auto apply_snapshot(const uint8_t* _data, size_t _size, T* _table, size_t _rows) -> size_t {
+    auto& leaves = details::dirty_leaves<T>();
+    auto  in     = details::reader{ _data, _size, 0 };
+    auto  magic  = uint32_t{0};
+    auto  nleafs = uint32_t{0};
+    auto  rows   = uint64_t{0};
+    if (!in.read(&magic, sizeof(magic)) || !in.read(&nleafs, sizeof(nleafs)) || !in.read(&rows, sizeof(rows))) {
+        return 0;
+    }
+    if (magic != details::snapshot_magic || nleafs != leaves.size()) {
+        return 0;
+    }
+
+    uint8_t bytes[sizeof(T)];
+    for (auto r = uint64_t{0}; r < rows; ++r) {
+        auto row   = uint64_t{0};
+        auto count = uint32_t{0};
+        if (!in.read(&row, sizeof(row)) || !in.read(&count, sizeof(count)) || row >= _rows) {
+            return 0;
+        }
+        auto base = reinterpret_cast<uint8_t*>(_table + row);
+        for (auto i = 0u; i < count; ++i) {
+            auto leaf = uint32_t{0};
+            if (!in.read(&leaf, sizeof(leaf)) || leaf >= leaves.size()) {
+                return 0;
+            }
+            auto& info = leaves[leaf];
+            if (!in.read(bytes, info.bytes())) {
+                return 0;
+            }
+            if (!info.is_bitfield) {
+                memcpy(base + info.first_byte(), bytes, info.bytes());
+                continue;
+            }
+
+            // only the bits of the bit-field; the rest of its bytes may belong to other fields
+
+            for (auto bit = info.first_bit; bit <= info.last_bit; ++bit) {
+                const auto mask = static_cast<uint8_t>(1u << (bit % CHAR_BIT));
+                auto&      dst  = base[bit / CHAR_BIT];
+                dst = static_cast<uint8_t>((dst & ~mask) | (bytes[bit / CHAR_BIT - info.first_byte()] & mask));
+            }
+        }
+    }
+    return in.pos;
+}
+
+} // namespace map_layout
+} // namespace qcstudio
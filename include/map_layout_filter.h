@@ -0,0 +1,747 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ML_FILTER_AVX2 1
+#endif
+
+#include "map_layout_index.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Predicate pushdown over arrays of raw records
+
+    'filter<T>' evaluates a predicate on the registered fields of an array of T records in
+    place: every compared field is read at its offset with the type given by its encoding, no
+    record is copied or deserialized. The result is a 'selection' bitmap of matching records.
+
+        auto sel = filter<tick>(buffer, count, field("quantity") > 300 && field("price") < 110.5);
+        for (auto idx : sel.indices()) { ... }
+
+    - 'field(name)' names an arithmetic or bit-field leaf; container elements are named with
+      their path, e.g. field("pos[1]").
+    - Comparisons (<, <=, >, >=, ==, !=) take an arithmetic literal and are exact whatever
+      the field and literal types (an int8_t field against 300, an unsigned field against -1,
+      an integer field against 0.5...). NaN values only satisfy '!='.
+    - Comparisons combine with &&, || and !; a default-constructed predicate selects all.
+
+    Records are evaluated in blocks of 'filter_block' records so that the intermediate bitmaps
+    stay in cache. With AVX2, each comparison gathers the field of 8 records (4 for 8-byte
+    fields) per instruction; bit-fields are gathered as 32-bit words when they fit in one and
+    then shifted and masked.
+
+    The selection is not valid when the predicate names an unknown field, a field that is not
+    arithmetic or a long double.
+*/
+
+enum class compare_op : uint8_t {
+    less,
+    less_equal,
+    greater,
+    greater_equal,
+    equal,
+    not_equal
+};
+
+class predicate {
+public:
+    struct literal {
+        enum class kind : uint8_t { sint, uint, real } type;
+        int64_t  sint;
+        uint64_t uint;
+        double   real;
+    };
+
+    struct term {
+        enum class kind : uint8_t { compare, all_of, any_of, negation } type;
+        string     field; // compare only
+        compare_op op;
+        literal    value;
+    };
+
+    predicate() = default;
+    predicate(const string& _field, compare_op _op, const literal& _value);
+
+    auto terms() const -> const vector<term>& { return postfix; }
+
+    friend auto operator&&(predicate _a, const predicate& _b) -> predicate;
+    friend auto operator||(predicate _a, const predicate& _b) -> predicate;
+    friend auto operator! (predicate _a) -> predicate;
+
+private:
+    vector<term> postfix;
+};
+
+class field_expr {
+public:
+    explicit field_expr(string _name) : name(move(_name)) {}
+
+    template<typename V> auto operator< (V _value) const -> details::if_arithmetic<V, predicate> { return { name, compare_op::less,          make(_value) }; }
+    template<typename V> auto operator<=(V _value) const -> details::if_arithmetic<V, predicate> { return { name, compare_op::less_equal,    make(_value) }; }
+    template<typename V> auto operator> (V _value) const -> details::if_arithmetic<V, predicate> { return { name, compare_op::greater,       make(_value) }; }
+    template<typename V> auto operator>=(V _value) const -> details::if_arithmetic<V, predicate> { return { name, compare_op::greater_equal, make(_value) }; }
+    template<typename V> auto operator==(V _value) const -> details::if_arithmetic<V, predicate> { return { name, compare_op::equal,         make(_value) }; }
+    template<typename V> auto operator!=(V _value) const -> details::if_arithmetic<V, predicate> { return { name, compare_op::not_equal,     make(_value) }; }
+
+private:
+    template<typename V> static auto make(V _value) -> predicate::literal;
+
+    string name;
+};
+
+inline auto field(const char* _name) -> field_expr { return field_expr{ _name }; }
+
+class selection {
+public:
+    auto valid  () const -> bool                     { return ok; }
+    auto size   () const -> size_t                   { return records; } // evaluated records
+    auto words  () const -> const vector<uint64_t>&  { return bits; }    // bit (i % 64) of word (i / 64) is record i
+    auto test   (size_t _idx) const -> bool          { return (bits[_idx / 64] >> (_idx % 64)) & 1; }
+    auto count  () const -> size_t;                                      // selected records
+    auto indices() const -> vector<size_t>;
+
+    template<typename F> void for_each(F&& _fn) const; // calls '_fn(index)' for every selected record
+
+private:
+    template<typename T> friend auto filter(const void*, size_t, const predicate&) -> selection;
+
+    vector<uint64_t> bits;
+    size_t           records = 0;
+    bool             ok      = false;
+};
+
+constexpr auto filter_block = size_t{16384};
+
+template<typename T> auto filter(const void* _records, size_t _count, const predicate& _pred) -> selection;
+template<typename T> auto filter(const vector<T>& _records, const predicate& _pred) -> selection;
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+constexpr auto key_sign = uint64_t{1} << 63;
+
+enum class test_kind : uint8_t { integer, real32, real64 };
+
+// a comparison resolved against a leaf; integers are compared as keys (value ^ sign bit for
+// signed values) so that one unsigned range test covers every width and signedness
+
+struct field_test {
+    test_kind kind;
+    bool      is_signed;
+    bool      negate; // '!=' tests '==' and inverts
+    bool      none;   // no value of the field can match
+    size_t    byte;   // first byte of the field
+    uint32_t  shift;  // first bit inside that byte (bit-fields)
+    uint32_t  bits;   // width of the value
+    uint32_t  bytes;  // bytes spanned by the value
+    uint64_t  lo, hi; // inclusive key range
+    double    dlo, dhi;
+    float     flo, fhi;
+};
+
+struct filter_step {
+    predicate::term::kind type;
+    uint32_t              test;
+};
+
+struct filter_plan {
+    vector<field_test>  tests;
+    vector<filter_step> steps;
+    size_t              depth = 0; // bitmaps needed to evaluate the steps
+};
+
+// nearest representable bounds of a comparison against a real value
+
+template<typename F>
+void real_bounds(compare_op _op, double _value, F& _lo, F& _hi) {
+    const auto inf = numeric_limits<F>::infinity();
+    _lo = -inf;
+    _hi = inf;
+    if (std::isnan(_value)) {
+        swap(_lo, _hi);
+        return;
+    }
+    const auto v = _value > numeric_limits<F>::max() ? inf : _value < -numeric_limits<F>::max() ? -inf : static_cast<F>(_value);
+    const auto d = static_cast<double>(v);
+    switch (_op) {
+        case compare_op::greater_equal: _lo = d < _value ? nextafter(v, inf) : v;  break;
+        case compare_op::less_equal:    _hi = d > _value ? nextafter(v, -inf) : v; break;
+        case compare_op::greater: {
+            if (d > _value) {
+                _lo = v;
+            } else if (v != inf) {
+                _lo = nextafter(v, inf);
+            } else {
+                swap(_lo, _hi);
+            }
+            break;
+        }
+        case compare_op::less: {
+            if (d < _value) {
+                _hi = v;
+            } else if (v != -inf) {
+                _hi = nextafter(v, -inf);
+            } else {
+                swap(_lo, _hi);
+            }
+            break;
+        }
+        default: {
+            if (d == _value) {
+                _lo = _hi = v;
+            } else {
+                swap(_lo, _hi);
+            }
+            break;
+        }
+    }
+}
+
+// inclusive key range of an integer field matching a comparison
+
+enum class placement { below, inside, above };
+
+inline auto place(const predicate::literal& _value, bool _signed, uint64_t _kmin, uint64_t _kmax, uint64_t& _key) -> placement {
+    if (_value.type == predicate::literal::kind::sint) {
+        if (!_signed && _value.sint < 0) {
+            return placement::below;
+        }
+        _key = static_cast<uint64_t>(_value.sint) ^ (_signed ? key_sign : 0);
+    } else {
+        if (_signed && _value.uint > static_cast<uint64_t>(numeric_limits<int64_t>::max())) {
+            return placement::above;
+        }
+        _key = _value.uint ^ (_signed ? key_sign : 0);
+    }
+    return _key < _kmin ? placement::below : _key > _kmax ? placement::above : placement::inside;
+}
+
+inline void integer_bounds(compare_op _op, predicate::literal _value, field_test& _test) {
+    const auto kmin = _test.is_signed ? key_sign - (uint64_t{1} << (_test.bits - 1)) : 0;
+    const auto kmax = _test.is_signed ? key_sign + (uint64_t{1} << (_test.bits - 1)) - 1 : _test.bits == 64 ? ~uint64_t{0} : (uint64_t{1} << _test.bits) - 1;
+
+    // an integer is above 'x.5' iff it is above 'x', below it iff below 'x + 1', never equal
+
+    auto where = placement::inside;
+    auto key   = uint64_t{0};
+    if (_value.type == predicate::literal::kind::real) {
+        const auto d = _value.real;
+        const auto r = _op == compare_op::greater || _op == compare_op::less_equal ? floor(d) : ceil(d);
+        if (std::isnan(d) || ((_op == compare_op::equal || _op == compare_op::not_equal) && r != d)) {
+            _test.none = true;
+            return;
+        }
+        if (r < -9223372036854775808.0) {
+            where = placement::below;
+        } else if (r >= 18446744073709551616.0) {
+            where = placement::above;
+        } else if (r < 0) {
+            _value = { predicate::literal::kind::sint, static_cast<int64_t>(r), 0, 0 };
+        } else {
+            _value = { predicate::literal::kind::uint, 0, static_cast<uint64_t>(r), 0 };
+        }
+    }
+    if (where == placement::inside) {
+        where = place(_value, _test.is_signed, kmin, kmax, key);
+    }
+
+    const auto below = where == placement::below, above = where == placement::above;
+    _test.lo = kmin;
+    _test.hi = kmax;
+    switch (_op) {
+        case compare_op::greater:       _test.none = above || (!below && key == kmax); _test.lo = below ? kmin : key + 1; break;
+        case compare_op::greater_equal: _test.none = above;                            _test.lo = below ? kmin : key;     break;
+        case compare_op::less:          _test.none = below || (!above && key == kmin); _test.hi = above ? kmax : key - 1; break;
+        case compare_op::less_equal:    _test.none = below;                            _test.hi = above ? kmax : key;     break;
+        default:                        _test.none = below || above;                   _test.lo = _test.hi = key;         break;
+    }
+}
+
+inline auto make_field_test(const field_index& _index, const predicate::term& _term, field_test& _test) -> bool {
+    auto it = _index.leaf(_term.field);
+    if (!it) {
+        return false;
+    }
+    auto& item = *it->item;
+    if (item.category != item_category::arithmetic && item.category != item_category::bitfield) {
+        return false;
+    }
+
+    const auto encoding = item.data.encoded_arithmetic;
+    _test           = field_test{};
+    _test.is_signed = (encoding & 0b100) == 0;
+    _test.negate    = _term.op == compare_op::not_equal;
+    _test.byte      = it->first_bit / CHAR_BIT;
+    _test.shift     = static_cast<uint32_t>(it->first_bit % CHAR_BIT);
+    _test.bits      = static_cast<uint32_t>(it->last_bit - it->first_bit + 1);
+    _test.bytes     = (_test.shift + _test.bits + CHAR_BIT - 1) / CHAR_BIT;
+    if (_test.bits > 64) {
+        return false;
+    }
+
+    auto value = _term.value;
+    if (item.category == item_category::arithmetic && (encoding & 0b11) == 0b11) {
+        if (_test.bits != 32 && _test.bits != 64) {
+            return false;
+        }
+        const auto d = value.type == predicate::literal::kind::real ? value.real
+                     : value.type == predicate::literal::kind::sint ? static_cast<double>(value.sint)
+                     :                                                 static_cast<double>(value.uint);
+        _test.kind = _test.bits == 32 ? test_kind::real32 : test_kind::real64;
+        real_bounds(_term.op, d, _test.flo, _test.fhi);
+        real_bounds(_term.op, d, _test.dlo, _test.dhi);
+        return true;
+    }
+    _test.kind = test_kind::integer;
+    integer_bounds(_term.op, value, _test);
+    return true;
+}
+
+inline auto make_filter_plan(const field_index& _index, const predicate& _pred, filter_plan& _plan) -> bool {
+    auto depth = size_t{0};
+    for (auto& term : _pred.terms()) {
+        auto step = filter_step{ term.type, 0 };
+        switch (term.type) {
+            case predicate::term::kind::compare: {
+                step.test = static_cast<uint32_t>(_plan.tests.size());
+                _plan.tests.emplace_back();
+                if (!make_field_test(_index, term, _plan.tests.back())) {
+                    return false;
+                }
+                _plan.depth = max(_plan.depth, ++depth);
+                break;
+            }
+            case predicate::term::kind::negation: break;
+            default:                              --depth; break;
+        }
+        _plan.steps.push_back(step);
+    }
+    return true;
+}
+
+// bit counting
+
+inline auto popcount(uint64_t _word) -> size_t {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_popcountll(_word));
+#else
+    auto ret = size_t{0};
+    for (; _word; _word &= _word - 1) {
+        ++ret;
+    }
+    return ret;
+#endif
+}
+
+inline auto lowest_bit(uint64_t _word) -> size_t { // '_word' must not be 0
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<size_t>(__builtin_ctzll(_word));
+#else
+    auto ret = size_t{0};
+    for (; !(_word & 1); _word >>= 1) {
+        ++ret;
+    }
+    return ret;
+#endif
+}
+
+// scalar scans (set the bits of the matching records in [_first, _count), a word at a time)
+
+template<typename V>
+struct key_loader {
+    auto operator()(const uint8_t* _src) const -> uint64_t {
+        V value;
+        memcpy(&value, _src, sizeof(V));
+        return is_signed<V>::value ? static_cast<uint64_t>(static_cast<int64_t>(value)) ^ key_sign : static_cast<uint64_t>(value);
+    }
+};
+
+inline auto load_bits_key(const uint8_t* _src, const field_test& _test) -> uint64_t {
+    auto value = uint64_t{0};
+    for (auto i = 0u; i < _test.bytes && i < 8; ++i) {
+        value |= static_cast<uint64_t>(_src[i]) << (i * CHAR_BIT);
+    }
+    value >>= _test.shift;
+    if (_test.bytes > 8) {
+        value |= static_cast<uint64_t>(_src[8]) << (64 - _test.shift);
+    }
+    if (_test.bits < 64) {
+        value &= (uint64_t{1} << _test.bits) - 1;
+        if (_test.is_signed) {
+            const auto sign = uint64_t{1} << (_test.bits - 1);
+            value = (value ^ sign) - sign;
+        }
+    }
+    return _test.is_signed ? value ^ key_sign : value;
+}
+
+template<typename LOAD>
+void scan_keys(const uint8_t* _src, size_t _stride, size_t _first, size_t _count, uint64_t _lo, uint64_t _hi, uint64_t* _words, LOAD&& _load) {
+    for (auto i = _first; i < _count;) {
+        const auto end  = min(_count, (i / 64 + 1) * 64);
+        auto       word = uint64_t{0};
+        for (; i < end; ++i) {
+            const auto key = _load(_src + i * _stride);
+            word |= static_cast<uint64_t>(key - _lo <= _hi - _lo) << (i % 64);
+        }
+        _words[(end - 1) / 64] |= word;
+    }
+}
+
+template<typename F>
+void scan_reals(const uint8_t* _src, size_t _stride, size_t _first, size_t _count, F _lo, F _hi, uint64_t* _words) {
+    for (auto i = _first; i < _count;) {
+        const auto end  = min(_count, (i / 64 + 1) * 64);
+        auto       word = uint64_t{0};
+        for (; i < end; ++i) {
+            F value;
+            memcpy(&value, _src + i * _stride, sizeof(F));
+            word |= static_cast<uint64_t>(value >= _lo && value <= _hi) << (i % 64);
+        }
+        _words[(end - 1) / 64] |= word;
+    }
+}
+
+inline void scan_scalar(const uint8_t* _src, size_t _stride, size_t _first, size_t _count, const field_test& _test, uint64_t* _words) {
+    const auto src = _src + _test.byte;
+    switch (_test.kind) {
+        case test_kind::real32: scan_reals(src, _stride, _first, _count, _test.flo, _test.fhi, _words); return;
+        case test_kind::real64: scan_reals(src, _stride, _first, _count, _test.dlo, _test.dhi, _words); return;
+        default:                break;
+    }
+    const auto lo = _test.lo, hi = _test.hi;
+    if (_test.shift == 0) {
+        switch (_test.bits) {
+            case  8: _test.is_signed ? scan_keys(src, _stride, _first, _count, lo, hi, _words, key_loader<int8_t> {}) : scan_keys(src, _stride, _first, _count, lo, hi, _words, key_loader<uint8_t> {}); return;
+            case 16: _test.is_signed ? scan_keys(src, _stride, _first, _count, lo, hi, _words, key_loader<int16_t>{}) : scan_keys(src, _stride, _first, _count, lo, hi, _words, key_loader<uint16_t>{}); return;
+            case 32: _test.is_signed ? scan_keys(src, _stride, _first, _count, lo, hi, _words, key_loader<int32_t>{}) : scan_keys(src, _stride, _first, _count, lo, hi, _words, key_loader<uint32_t>{}); return;
+            case 64: _test.is_signed ? scan_keys(src, _stride, _first, _count, lo, hi, _words, key_loader<int64_t>{}) : scan_keys(src, _stride, _first, _count, lo, hi, _words, key_loader<uint64_t>{}); return;
+            default: break;
+        }
+    }
+    scan_keys(src, _stride, _first, _count, lo, hi, _words, [&](const uint8_t* _p) { return load_bits_key(_p, _test); });
+}
+
+#if ML_FILTER_AVX2
+
+// 32-bit lanes: the word holding the value is shifted left to drop the bits above it and then
+// right (arithmetic for signed values) to drop the bits below it; full-width unsigned values
+// get their sign bit flipped so that the signed comparisons order them
+
+__attribute__((target("avx2")))
+inline auto scan32_avx2(const uint8_t* _src, size_t _stride, size_t _count, const field_test& _test, uint64_t* _words) -> size_t {
+    const auto s     = static_cast<int>(_stride);
+    const auto idx   = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+    const auto left  = _mm_cvtsi32_si128(static_cast<int>(32 - _test.shift - _test.bits));
+    const auto right = _mm_cvtsi32_si128(static_cast<int>(32 - _test.bits));
+    const auto flip  = !_test.is_signed && _test.bits == 32 ? uint32_t{0x80000000} : 0;
+    const auto bound = [&](uint64_t _key) {
+        const auto value = _test.is_signed ? _key ^ key_sign : _key;
+        return static_cast<int>(static_cast<uint32_t>(value) ^ flip);
+    };
+    const auto lo   = _mm256_set1_epi32(bound(_test.lo));
+    const auto hi   = _mm256_set1_epi32(bound(_test.hi));
+    const auto bias = _mm256_set1_epi32(static_cast<int>(flip));
+
+    auto i    = size_t{0};
+    auto word = uint64_t{0};
+    for (; i + 8 <= _count; i += 8) {
+        auto v = _mm256_i32gather_epi32(reinterpret_cast<const int*>(_src + i * _stride + _test.byte), idx, 1);
+        v = _mm256_sll_epi32(v, left);
+        v = _test.is_signed ? _mm256_sra_epi32(v, right) : _mm256_srl_epi32(v, right);
+        v = _mm256_xor_si256(v, bias);
+        const auto out  = _mm256_or_si256(_mm256_cmpgt_epi32(lo, v), _mm256_cmpgt_epi32(v, hi));
+        const auto mask = ~static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(out))) & 0xFF;
+        word |= static_cast<uint64_t>(mask) << (i % 64);
+        if ((i + 8) % 64 == 0) {
+            _words[i / 64] |= word;
+            word = 0;
+        }
+    }
+    if (i % 64) {
+        _words[i / 64] |= word;
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline auto scan64_avx2(const uint8_t* _src, size_t _stride, size_t _count, const field_test& _test, uint64_t* _words) -> size_t {
+    const auto s    = static_cast<long long>(_stride);
+    const auto idx  = _mm256_setr_epi64x(0, s, 2 * s, 3 * s);
+    const auto lo   = _mm256_set1_epi64x(static_cast<long long>(_test.lo ^ key_sign));
+    const auto hi   = _mm256_set1_epi64x(static_cast<long long>(_test.hi ^ key_sign));
+    const auto bias = _mm256_set1_epi64x(static_cast<long long>(_test.is_signed ? 0 : key_sign));
+
+    auto i    = size_t{0};
+    auto word = uint64_t{0};
+    for (; i + 4 <= _count; i += 4) {
+        auto v = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(_src + i * _stride + _test.byte), idx, 1);
+        v = _mm256_xor_si256(v, bias);
+        const auto out  = _mm256_or_si256(_mm256_cmpgt_epi64(lo, v), _mm256_cmpgt_epi64(v, hi));
+        const auto mask = ~static_cast<uint32_t>(_mm256_movemask_pd(_mm256_castsi256_pd(out))) & 0xF;
+        word |= static_cast<uint64_t>(mask) << (i % 64);
+        if ((i + 4) % 64 == 0) {
+            _words[i / 64] |= word;
+            word = 0;
+        }
+    }
+    if (i % 64) {
+        _words[i / 64] |= word;
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline auto scan_float_avx2(const uint8_t* _src, size_t _stride, size_t _count, const field_test& _test, uint64_t* _words) -> size_t {
+    const auto s   = static_cast<int>(_stride);
+    const auto idx = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+    const auto lo  = _mm256_set1_ps(_test.flo);
+    const auto hi  = _mm256_set1_ps(_test.fhi);
+
+    auto i    = size_t{0};
+    auto word = uint64_t{0};
+    for (; i + 8 <= _count; i += 8) {
+        const auto v    = _mm256_i32gather_ps(reinterpret_cast<const float*>(_src + i * _stride + _test.byte), idx, 1);
+        const auto in   = _mm256_and_ps(_mm256_cmp_ps(v, lo, _CMP_GE_OQ), _mm256_cmp_ps(v, hi, _CMP_LE_OQ));
+        const auto mask = static_cast<uint32_t>(_mm256_movemask_ps(in));
+        word |= static_cast<uint64_t>(mask) << (i % 64);
+        if ((i + 8) % 64 == 0) {
+            _words[i / 64] |= word;
+            word = 0;
+        }
+    }
+    if (i % 64) {
+        _words[i / 64] |= word;
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline auto scan_double_avx2(const uint8_t* _src, size_t _stride, size_t _count, const field_test& _test, uint64_t* _words) -> size_t {
+    const auto s   = static_cast<long long>(_stride);
+    const auto idx = _mm256_setr_epi64x(0, s, 2 * s, 3 * s);
+    const auto lo  = _mm256_set1_pd(_test.dlo);
+    const auto hi  = _mm256_set1_pd(_test.dhi);
+
+    auto i    = size_t{0};
+    auto word = uint64_t{0};
+    for (; i + 4 <= _count; i += 4) {
+        const auto v    = _mm256_i64gather_pd(reinterpret_cast<const double*>(_src + i * _stride + _test.byte), idx, 1);
+        const auto in   = _mm256_and_pd(_mm256_cmp_pd(v, lo, _CMP_GE_OQ), _mm256_cmp_pd(v, hi, _CMP_LE_OQ));
+        const auto mask = static_cast<uint32_t>(_mm256_movemask_pd(in));
+        word |= static_cast<uint64_t>(mask) << (i % 64);
+        if ((i + 4) % 64 == 0) {
+            _words[i / 64] |= word;
+            word = 0;
+        }
+    }
+    if (i % 64) {
+        _words[i / 64] |= word;
+    }
+    return i;
+}
+
+#endif
+
+// '_avail' bytes are readable from '_src': the gathers read whole 4 or 8-byte words, which for
+// narrow fields of the last records may go past the end and are left to the scalar scan
+
+inline void scan_test(const uint8_t* _src, size_t _stride, size_t _count, size_t _avail, const field_test& _test, uint64_t* _words) {
+    auto first = size_t{0};
+#if ML_FILTER_AVX2
+    static const auto has_avx2 = __builtin_cpu_supports("avx2") != 0;
+    if (has_avx2 && _stride <= INT_MAX / 8) {
+        const auto wide  = _test.kind == test_kind::real64 || (_test.kind == test_kind::integer && _test.bits == 64 && _test.shift == 0);
+        const auto load  = size_t{wide ? 8u : 4u};
+        const auto safe  = _avail < _test.byte + load ? 0 : min(_count, (_avail - _test.byte - load) / _stride + 1);
+        switch (_test.kind) {
+            case test_kind::real32: first = scan_float_avx2 (_src, _stride, safe, _test, _words); break;
+            case test_kind::real64: first = scan_double_avx2(_src, _stride, safe, _test, _words); break;
+            default: {
+                if (wide) {
+                    first = scan64_avx2(_src, _stride, safe, _test, _words);
+                } else if (_test.shift + _test.bits <= 32) {
+                    first = scan32_avx2(_src, _stride, safe, _test, _words);
+                }
+                break;
+            }
+        }
+    }
+#else
+    (void)_avail;
+#endif
+    scan_scalar(_src, _stride, first, _count, _test, _words);
+}
+
+inline void run_filter(const filter_plan& _plan, const uint8_t* _src, size_t _stride, size_t _count, vector<uint64_t>& _out) {
+    const auto block_words = filter_block / 64;
+    const auto total_words = (_count + 63) / 64;
+    _out.assign(total_words, 0);
+
+    vector<uint64_t> stack(max(_plan.depth, size_t{1}) * block_words);
+    for (auto first = size_t{0}; first < _count; first += filter_block) {
+        const auto count = min(filter_block, _count - first);
+        const auto words = (count + 63) / 64;
+        const auto src   = _src + first * _stride;
+        auto top = stack.data();
+        if (_plan.steps.empty()) {
+            fill(top, top + words, ~uint64_t{0});
+            top += block_words;
+        }
+        for (auto& step : _plan.steps) {
+            switch (step.type) {
+                case predicate::term::kind::compare: {
+                    auto& test = _plan.tests[step.test];
+                    fill(top, top + words, 0);
+                    if (!test.none) {
+                        scan_test(src, _stride, count, (_count - first) * _stride, test, top);
+                    }
+                    if (test.negate) {
+                        for (auto w = 0u; w < words; ++w) top[w] = ~top[w];
+                    }
+                    top += block_words;
+                    break;
+                }
+                case predicate::term::kind::all_of: {
+                    top -= block_words;
+                    for (auto w = 0u; w < words; ++w) top[w - block_words] &= top[w];
+                    break;
+                }
+                case predicate::term::kind::any_of: {
+                    top -= block_words;
+                    for (auto w = 0u; w < words; ++w) top[w - block_words] |= top[w];
+                    break;
+                }
+                case predicate::term::kind::negation: {
+                    for (auto w = 0u; w < words; ++w) top[w - block_words] = ~top[w - block_words];
+                    break;
+                }
+            }
+        }
+        copy(stack.data(), stack.data() + words, _out.data() + first / 64);
+    }
+    if (_count % 64) {
+        _out.back() &= (uint64_t{1} << (_count % 64)) - 1;
+    }
+}
+
+} // namespace details
+
+inline predicate::predicate(const string& _field, compare_op _op, const literal& _value) {
+    postfix.push_back({ term::kind::compare, _field, _op, _value });
+}
+
+inline auto operator&&(predicate _a, const predicate& _b) -> predicate {
+    _a.postfix.insert(_a.postfix.end(), _b.postfix.begin(), _b.postfix.end());
+    _a.postfix.push_back({ predicate::term::kind::all_of, {}, compare_op::equal, {} });
+    return _a;
+}
+
+inline auto operator||(predicate _a, const predicate& _b) -> predicate {
+    _a.postfix.insert(_a.postfix.end(), _b.postfix.begin(), _b.postfix.end());
+    _a.postfix.push_back({ predicate::term::kind::any_of, {}, compare_op::equal, {} });
+    return _a;
+}
+
+inline auto operator!(predicate _a) -> predicate {
+    _a.postfix.push_back({ predicate::term::kind::negation, {}, compare_op::equal, {} });
+    return _a;
+}
+
+template<typename V>
+auto field_expr::make(V _value) -> predicate::literal {
+    if (is_floating_point<V>::value) {
+        return { predicate::literal::kind::real, 0, 0, static_cast<double>(_value) };
+    }
+    if (is_signed<V>::value) {
+        return { predicate::literal::kind::sint, static_cast<int64_t>(_value), 0, 0 };
+    }
+    return { predicate::literal::kind::uint, 0, static_cast<uint64_t>(_value), 0 };
+}
+
+inline auto selection::count() const -> size_t {
+    auto ret = size_t{0};
+    for (auto word : bits) {
+        ret += details::popcount(word);
+    }
+    return ret;
+}
+
+template<typename F>
+void selection::for_each(F&& _fn) const {
+    for (auto w = size_t{0}; w < bits.size(); ++w) {
+        for (auto word = bits[w]; word; word &= word - 1) {
+            _fn(w * 64 + details::lowest_bit(word));
+        }
+    }
+}
+
+inline auto selection::indices() const -> vector<size_t> {
+    vector<size_t> ret;
+    ret.reserve(count());
+    for_each([&](size_t _idx) { ret.push_back(_idx); });
+    return ret;
+}
+
+template<typename T>
+auto filter(const void* _records, size_t _count, const predicate& _pred) -> selection {
+    auto ret  = selection{};
+    auto plan = details::filter_plan{};
+    if (!details::make_filter_plan(get_field_index<T>(), _pred, plan)) {
+        return ret;
+    }
+    details::run_filter(plan, static_cast<const uint8_t*>(_records), sizeof(T), _count, ret.bits);
+    ret.records = _count;
+    ret.ok      = true;
+    return ret;
+}
+
+template<typename T>
+auto filter(const vector<T>& _records, const predicate& _pred) -> selection {
+    return filter<T>(_records.data(), _records.size(), _pred);
+}
+
+} // namespace map_layout
+} // namespace qcstudio
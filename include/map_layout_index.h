@@ -0,0 +1,283 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "map_layout.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Offset to field lookup
+
+    A 'field_index' flattens the registered fields of a layout into leaves (arithmetic values,
+    bit-fields, pointers, nested classes and the handles of variable-length/tagged members,
+    with container elements identified by their path, e.g. "[1][0]") and answers, in
+    O(log n + k):
+
+    - 'field_at(bit)': the leaf covering a bit offset or nullptr for padding/unregistered bits.
+      When leaves overlap (union members) the narrowest one is returned.
+    - 'fields_in(begin, end)': every leaf intersecting the bit range [begin, end), each reported
+      once and in ascending position, either to a callback or as a vector.
+
+    Offsets are in bits like the layout ranges; use 'byte * CHAR_BIT' for byte offsets.
+    'leaf(name)' returns the leaf of a field by name, with the path of container elements
+    appended (e.g. "pos[1]"), or nullptr. 'get_field_index<T>' returns the cached index of a
+    registered type.
+*/
+
+struct field_hit {
+    const char*   field;     // registered name of the owning field
+    const item_t* item;      // the leaf item
+    string        path;      // container element path inside the field (empty for plain fields)
+    size_t        first_bit; // first and last bit of the leaf (inclusive, like the item ranges)
+    size_t        last_bit;
+};
+
+class field_index {
+public:
+    field_index() = default;
+    explicit field_index(const class_layout& _layout);
+
+    auto leaves() const -> const vector<field_hit>& { return hits; }
+
+    auto leaf     (const string& _name) const -> const field_hit*;
+    auto field_at (size_t _bit) const -> const field_hit*;
+    auto fields_in(size_t _begin, size_t _end) const -> vector<const field_hit*>;
+    template<typename F> void fields_in(size_t _begin, size_t _end, F&& _fn) const;
+
+private:
+    struct segment {
+        size_t   end;       // bits [starts[i], end) are covered by the same set of leaves
+        uint32_t from, to;  // range of 'cover' holding the indices of those leaves
+        uint32_t narrowest; // answer to 'field_at'
+    };
+
+    auto find_segment(size_t _bit) const -> size_t; // last segment starting at or before '_bit' (~0 if none)
+
+    vector<field_hit> hits;
+    vector<bool>      gapped;   // leaves made of several intervals (nested classes with holes)
+    vector<size_t>    starts;   // first bit of every segment, kept apart for a compact binary search
+    vector<segment>   segments;
+    vector<uint32_t>  cover;
+};
+
+template<typename T> auto get_field_index() -> const field_index&;
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+struct leaf_interval {
+    size_t   first, end;
+    uint32_t hit;
+};
+
+inline void collect_field_hits(const char* _field, const item_t& _item, const string& _path, vector<field_hit>& _hits, vector<leaf_interval>& _intervals) {
+    switch (_item.category) {
+        case item_category::container: {
+            for (auto i = 0u; i < _item.data.container.count; ++i) {
+                collect_field_hits(_field, _item.data.container.items[i], _path + "[" + to_string(i) + "]", _hits, _intervals);
+            }
+            break;
+        }
+        case item_category::undefined: {
+            break;
+        }
+        default: {
+            if (_item.ranges.empty()) {
+                break;
+            }
+            const auto hit = static_cast<uint32_t>(_hits.size());
+            _hits.push_back({ _field, &_item, _path, _item.ranges.front(), _item.ranges.back() });
+            for (auto i = 0u; i + 1 < _item.ranges.size(); i += 2) { // nested classes may have holes
+                _intervals.push_back({ _item.ranges[i], _item.ranges[i + 1] + 1, hit });
+            }
+            break;
+        }
+    }
+}
+
+} // namespace details
+
+inline field_index::field_index(const class_layout& _layout) {
+    vector<details::leaf_interval> intervals;
+    for (auto& [ name, info ] : _layout.fields) {
+        details::collect_field_hits(name, info.item, string{}, hits, intervals);
+    }
+
+    // order leaves by position, narrowest first, then by name so that it does not depend on
+    // where the names live in memory
+
+    vector<uint32_t> order(hits.size());
+    for (auto i = 0u; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    sort(order.begin(), order.end(), [&](auto _a, auto _b) {
+        auto& a = hits[_a];
+        auto& b = hits[_b];
+        if (a.first_bit != b.first_bit) return a.first_bit < b.first_bit;
+        if (a.last_bit  != b.last_bit)  return a.last_bit  < b.last_bit;
+        if (auto cmp = strcmp(a.field, b.field)) return cmp < 0;
+        return a.path < b.path;
+    });
+    vector<uint32_t>  rank(hits.size());
+    vector<field_hit> sorted;
+    sorted.reserve(hits.size());
+    for (auto i = 0u; i < order.size(); ++i) {
+        rank[order[i]] = i;
+        sorted.push_back(move(hits[order[i]]));
+    }
+    hits.swap(sorted);
+    gapped.assign(hits.size(), false);
+    for (auto& interval : intervals) {
+        interval.hit = rank[interval.hit];
+        gapped[interval.hit] = gapped[interval.hit] || interval.first != hits[interval.hit].first_bit;
+    }
+
+    // split the bit space at every interval boundary; each elementary segment keeps the
+    // (usually single) leaves covering it, overlaps only come from unions
+
+    vector<size_t> bounds;
+    bounds.reserve(intervals.size() * 2);
+    for (auto& interval : intervals) {
+        bounds.push_back(interval.first);
+        bounds.push_back(interval.end);
+    }
+    sort(bounds.begin(), bounds.end());
+    bounds.erase(unique(bounds.begin(), bounds.end()), bounds.end());
+
+    sort(intervals.begin(), intervals.end(), [](auto& _a, auto& _b) { return _a.first < _b.first; });
+
+    vector<details::leaf_interval> active;
+    auto next = size_t{0};
+    for (auto i = 0u; i + 1 < bounds.size(); ++i) {
+        const auto first = bounds[i], end = bounds[i + 1];
+        active.erase(remove_if(active.begin(), active.end(), [&](auto& _a) { return _a.end <= first; }), active.end());
+        while (next < intervals.size() && intervals[next].first == first) {
+            active.push_back(intervals[next++]);
+        }
+        if (active.empty()) {
+            continue;
+        }
+        const auto from = static_cast<uint32_t>(cover.size());
+        for (auto& interval : active) {
+            cover.push_back(interval.hit);
+        }
+        sort(cover.begin() + from, cover.end());
+        cover.erase(unique(cover.begin() + from, cover.end()), cover.end());
+
+        // narrowest covering leaf (leaves with the same start are sorted narrowest first)
+
+        auto narrowest = cover[from];
+        for (auto j = from + 1; j < cover.size(); ++j) {
+            if (hits[cover[j]].last_bit - hits[cover[j]].first_bit < hits[narrowest].last_bit - hits[narrowest].first_bit) {
+                narrowest = cover[j];
+            }
+        }
+        starts.push_back(first);
+        segments.push_back({ end, from, static_cast<uint32_t>(cover.size()), narrowest });
+    }
+}
+
+inline auto field_index::leaf(const string& _name) const -> const field_hit* {
+    const auto bracket = _name.find('[');
+    const auto name    = _name.substr(0, bracket);
+    const auto path    = bracket == string::npos ? string{} : _name.substr(bracket);
+    auto it = find_if(hits.begin(), hits.end(), [&](auto& _hit) { return name == _hit.field && path == _hit.path; });
+    return it != hits.end() ? &*it : nullptr;
+}
+
+// branchless binary search (random offsets make the branches of 'upper_bound' unpredictable)
+
+inline auto field_index::find_segment(size_t _bit) const -> size_t {
+    if (starts.empty() || _bit < starts[0]) {
+        return ~size_t{0};
+    }
+    auto base = starts.data();
+    for (auto n = starts.size(); n > 1; n -= n / 2) {
+        base = base[n / 2] <= _bit ? base + n / 2 : base;
+    }
+    return static_cast<size_t>(base - starts.data());
+}
+
+inline auto field_index::field_at(size_t _bit) const -> const field_hit* {
+    auto idx = find_segment(_bit);
+    return idx < segments.size() && _bit < segments[idx].end ? &hits[segments[idx].narrowest] : nullptr;
+}
+
+template<typename F>
+void field_index::fields_in(size_t _begin, size_t _end, F&& _fn) const {
+    auto idx = find_segment(_begin);
+    if (idx >= segments.size() || segments[idx].end <= _begin) {
+        ++idx; // ~0 wraps to 0 when '_begin' precedes every segment
+    }
+
+    // a leaf spanning several segments is reported only by the segment holding its first bit
+    // inside the range; leaves with holes are deduplicated explicitly
+
+    vector<uint32_t> seen;
+    for (; idx < segments.size() && starts[idx] < _end; ++idx) {
+        auto& seg = segments[idx];
+        for (auto i = seg.from; i < seg.to; ++i) {
+            auto& hit = hits[cover[i]];
+            if (gapped[cover[i]]) {
+                if (find(seen.begin(), seen.end(), cover[i]) != seen.end()) {
+                    continue;
+                }
+                seen.push_back(cover[i]);
+                _fn(hit);
+            } else if (auto start = max(hit.first_bit, _begin); start >= starts[idx] && start < seg.end) {
+                _fn(hit);
+            }
+        }
+    }
+}
+
+inline auto field_index::fields_in(size_t _begin, size_t _end) const -> vector<const field_hit*> {
+    vector<const field_hit*> ret;
+    fields_in(_begin, _end, [&](const field_hit& _hit) { ret.push_back(&_hit); });
+    return ret;
+}
+
+template<typename T>
+auto get_field_index() -> const field_index& {
+    static const auto ret = field_index{ get_layout<T>() };
+    return ret;
+}
+
+} // namespace map_layout
+} // namespace qcstudio
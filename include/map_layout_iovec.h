@@ -0,0 +1,220 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#if defined(_WIN32)
+#include <cstddef>
+#else
+#include <sys/uio.h>
+#endif
+
+#include "map_layout.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+#if defined(_WIN32)
+struct iovec { // same shape as the POSIX one
+    void*  iov_base;
+    size_t iov_len;
+};
+#else
+using ::iovec;
+#endif
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Zero-copy gather lists
+
+    'byte_runs<T>' returns the coalesced byte runs of T covered by registered fields, i.e. the
+    object without its padding (bytes not covered by any registered field count as padding).
+    Variable-length and tagged members are not part of the runs as their bytes are only a
+    handle; use the serializer for those types.
+
+    'iovec_gather' appends the runs of one or more objects (of any registered types) to a
+    caller-provided 'iovec' array, merging runs that happen to be contiguous in memory, so that
+    the result can be handed to writev/sendmsg/io_uring. An 'add' that does not fit leaves the
+    list untouched and returns false.
+
+    'to_iovecs' is the one-shot version for an object or an array of objects; it returns the
+    number of entries written or 0 if '_max' entries are not enough.
+*/
+
+struct byte_run {
+    size_t offset;
+    size_t size;
+};
+
+template<typename T> auto byte_runs() -> const vector<byte_run>&;
+
+class iovec_gather {
+public:
+    iovec_gather(iovec* _out, size_t _max) : out(_out), max(_max) {
+    }
+
+    template<typename T> auto add(const T& _obj) -> bool;
+    template<typename T> auto add(const T* _objs, size_t _count) -> bool;
+
+    auto count() const -> size_t { return used;  }
+    auto bytes() const -> size_t { return total; }
+    void clear()                 { used = total = 0; }
+
+private:
+    struct mark {
+        size_t used, total, last_len;
+    };
+
+    auto checkpoint() const -> mark { return { used, total, used ? out[used - 1].iov_len : 0 }; }
+    void rollback(const mark& _mark);
+    auto append(const uint8_t* _base, const vector<byte_run>& _runs) -> bool;
+
+    iovec* out;
+    size_t max;
+    size_t used  = 0;
+    size_t total = 0;
+};
+
+template<typename T> auto to_iovecs(const T& _obj, iovec* _out, size_t _max) -> size_t;
+template<typename T> auto to_iovecs(const T* _objs, size_t _count, iovec* _out, size_t _max) -> size_t;
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+inline void collect_byte_runs(const item_t& _item, vector<byte_run>& _out) {
+    switch (_item.category) {
+        case item_category::container: {
+            for (auto i = 0u; i < _item.data.container.count; ++i) {
+                collect_byte_runs(_item.data.container.items[i], _out);
+            }
+            break;
+        }
+        case item_category::dynamic:
+        case item_category::tagged:
+        case item_category::undefined: {
+            break;
+        }
+        default: {
+            for (auto i = 0u; i + 1 < _item.ranges.size(); i += 2) {
+                const auto first = _item.ranges[i] / CHAR_BIT;
+                _out.push_back({ first, _item.ranges[i + 1] / CHAR_BIT + 1 - first });
+            }
+            break;
+        }
+    }
+}
+
+inline auto make_byte_runs(const class_layout& _layout) -> vector<byte_run> {
+    vector<byte_run> runs;
+    for (auto& [ name, info ] : _layout.fields) {
+        collect_byte_runs(info.item, runs);
+    }
+    sort(runs.begin(), runs.end(), [](auto& _a, auto& _b) { return _a.offset < _b.offset; });
+
+    // merge overlapping (unions, bit-fields sharing bytes) and adjacent runs
+
+    vector<byte_run> ret;
+    for (auto& run : runs) {
+        if (!ret.empty() && run.offset <= ret.back().offset + ret.back().size) {
+            ret.back().size = max(ret.back().size, run.offset + run.size - ret.back().offset);
+        } else {
+            ret.push_back(run);
+        }
+    }
+    return ret;
+}
+
+} // namespace details
+
+template<typename T>
+auto byte_runs() -> const vector<byte_run>& {
+    static const auto ret = details::make_byte_runs(get_layout<T>());
+    return ret;
+}
+
+inline void iovec_gather::rollback(const mark& _mark) {
+    used  = _mark.used;
+    total = _mark.total;
+    if (used) {
+        out[used - 1].iov_len = _mark.last_len;
+    }
+}
+
+inline auto iovec_gather::append(const uint8_t* _base, const vector<byte_run>& _runs) -> bool {
+    const auto prev = checkpoint();
+    for (auto& run : _runs) {
+        auto ptr = _base + run.offset;
+        if (used && static_cast<uint8_t*>(out[used - 1].iov_base) + out[used - 1].iov_len == ptr) {
+            out[used - 1].iov_len += run.size;
+        } else if (used < max) {
+            out[used++] = iovec{ const_cast<uint8_t*>(ptr), run.size };
+        } else {
+            rollback(prev);
+            return false;
+        }
+        total += run.size;
+    }
+    return true;
+}
+
+template<typename T>
+auto iovec_gather::add(const T& _obj) -> bool {
+    return append(reinterpret_cast<const uint8_t*>(&_obj), byte_runs<T>());
+}
+
+template<typename T>
+auto iovec_gather::add(const T* _objs, size_t _count) -> bool {
+    const auto prev = checkpoint();
+    for (auto i = 0u; i < _count; ++i) {
+        if (!add(_objs[i])) {
+            rollback(prev);
+            return false;
+        }
+    }
+    return true;
+}
+
+template<typename T>
+auto to_iovecs(const T& _obj, iovec* _out, size_t _max) -> size_t {
+    auto gather = iovec_gather{ _out, _max };
+    return gather.add(_obj) ? gather.count() : 0;
+}
+
+template<typename T>
+auto to_iovecs(const T* _objs, size_t _count, iovec* _out, size_t _max) -> size_t {
+    auto gather = iovec_gather{ _out, _max };
+    return gather.add(_objs, _count) ? gather.count() : 0;
+}
+
+} // namespace map_layout
+} // namespace qcstudio
@@ -0,0 +1,288 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "map_layout.h"
+#include "map_layout_serializer.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Parallel bulk processing of record arrays
+
+    'thread_pool' runs a batch of indexed tasks on persistent threads (the calling thread takes
+    part as well). Tasks are initially split evenly across threads; a thread that runs out of
+    work steals half of the remaining range of another one, so uneven tasks still keep every
+    core busy. Tasks must not throw.
+
+    Arrays are split in chunks of 'chunk_records<T>()' records (about 'chunk_bytes' worth of
+    data, so that a chunk stays in cache while being transformed). Chunk boundaries only depend
+    on the array size, never on the number of threads or on scheduling, so:
+
+    - 'parallel_for_each' invokes '_fn(T&)' on every record
+    - 'parallel_transform' invokes '_fn(const T&, vector<uint8_t>&)' on every record and
+      appends what every invocation writes to '_out' in record order, i.e. the output is
+      byte-identical to running the transform sequentially
+    - 'parallel_serialize' is 'parallel_transform' with 'serialize' (false, writing nothing, for the
+      types 'serialize' refuses)
+*/
+
+class thread_pool {
+public:
+    explicit thread_pool(size_t _threads = thread::hardware_concurrency()); // threads in total, caller included
+    ~thread_pool();
+
+    thread_pool(const thread_pool&) = delete;
+    auto operator=(const thread_pool&) -> thread_pool& = delete;
+
+    auto size() const -> size_t { return workers.size() + 1; }
+
+    template<typename F> void run(size_t _tasks, F&& _fn); // _fn(task) for every task in [0, _tasks)
+
+private:
+    struct alignas(64) slot {
+        atomic<uint64_t> range{ 0 }; // [begin, end) packed as begin << 32 | end
+    };
+
+    void dispatch(size_t _tasks, void (*_invoke)(void*, size_t), void* _ctx);
+    void loop(size_t _self);
+    void work(size_t _self);
+    auto pop(size_t _self, size_t& _task) -> bool;
+    auto steal(size_t _self) -> bool;
+
+    vector<thread>          workers;
+    unique_ptr<slot[]>      slots;
+    mutex                   lock;
+    condition_variable      wake, done;
+    uint64_t                generation = 0;
+    size_t                  busy       = 0;
+    bool                    stop       = false;
+    void                  (*invoke)(void*, size_t) = nullptr;
+    void*                   ctx        = nullptr;
+};
+
+constexpr auto chunk_bytes = size_t{256 * 1024};
+
+template<typename T> constexpr auto chunk_records() -> size_t { return max(size_t{1}, chunk_bytes / sizeof(T)); }
+
+template<typename T, typename F> void parallel_for_each (thread_pool& _pool, T* _objs, size_t _count, F&& _fn);
+template<typename T, typename F> void parallel_transform(thread_pool& _pool, const T* _objs, size_t _count, vector<uint8_t>& _out, F&& _fn);
+template<typename T>             auto parallel_serialize(thread_pool& _pool, const T* _objs, size_t _count, vector<uint8_t>& _out) -> bool;
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+constexpr auto pack_range  (uint64_t _begin, uint64_t _end) -> uint64_t { return _begin << 32 | _end; }
+constexpr auto range_begin (uint64_t _range) -> uint64_t { return _range >> 32;         }
+constexpr auto range_end   (uint64_t _range) -> uint64_t { return _range & 0xFFFFFFFFu; }
+
+} // namespace details
+
+inline thread_pool::thread_pool(size_t _threads) : slots(new slot[max(size_t{1}, _threads)]) {
+    for (auto i = 1u; i < max(size_t{1}, _threads); ++i) {
+        workers.emplace_back([this, i] { loop(i); });
+    }
+}
+
+inline thread_pool::~thread_pool() {
+    {
+        lock_guard<mutex> guard(lock);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+inline void thread_pool::loop(size_t _self) {
+    auto seen = uint64_t{0};
+    while (true) {
+        {
+            unique_lock<mutex> guard(lock);
+            wake.wait(guard, [&] { return stop || generation != seen; });
+            if (stop) {
+                return;
+            }
+            seen = generation;
+        }
+        work(_self);
+        {
+            lock_guard<mutex> guard(lock);
+            if (--busy == 0) {
+                done.notify_one();
+            }
+        }
+    }
+}
+
+inline auto thread_pool::pop(size_t _self, size_t& _task) -> bool {
+    auto& range = slots[_self].range;
+    auto  cur   = range.load(memory_order_acquire);
+    while (details::range_begin(cur) < details::range_end(cur)) {
+        if (range.compare_exchange_weak(cur, details::pack_range(details::range_begin(cur) + 1, details::range_end(cur)), memory_order_acq_rel)) {
+            _task = static_cast<size_t>(details::range_begin(cur));
+            return true;
+        }
+    }
+    return false;
+}
+
+inline auto thread_pool::steal(size_t _self) -> bool {
+    for (auto i = 1u; i < size(); ++i) {
+        auto& victim = slots[(_self + i) % size()].range;
+        auto  cur    = victim.load(memory_order_acquire);
+        while (details::range_begin(cur) < details::range_end(cur)) {
+            const auto begin = details::range_begin(cur);
+            const auto end   = details::range_end(cur);
+            const auto half  = begin + (end - begin) / 2;
+            if (victim.compare_exchange_weak(cur, details::pack_range(begin, half), memory_order_acq_rel)) {
+                slots[_self].range.store(details::pack_range(half, end), memory_order_release);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+inline void thread_pool::work(size_t _self) {
+    auto task = size_t{0};
+    do {
+        while (pop(_self, task)) {
+            invoke(ctx, task);
+        }
+    } while (steal(_self));
+}
+
+inline void thread_pool::dispatch(size_t _tasks, void (*_invoke)(void*, size_t), void* _ctx) {
+    for (auto i = 0u; i < size(); ++i) {
+        slots[i].range.store(details::pack_range(_tasks * i / size(), _tasks * (i + 1) / size()), memory_order_relaxed);
+    }
+    {
+        lock_guard<mutex> guard(lock);
+        invoke = _invoke;
+        ctx    = _ctx;
+        busy   = workers.size();
+        ++generation;
+    }
+    wake.notify_all();
+
+    work(0);
+
+    unique_lock<mutex> guard(lock);
+    done.wait(guard, [&] { return busy == 0; });
+}
+
+template<typename F>
+void thread_pool::run(size_t _tasks, F&& _fn) {
+    if (_tasks == 0) {
+        return;
+    }
+    dispatch(_tasks, [](void* _ctx, size_t _task) { (*static_cast<remove_reference_t<F>*>(_ctx))(_task); }, &_fn);
+}
+
+template<typename T, typename F>
+void parallel_for_each(thread_pool& _pool, T* _objs, size_t _count, F&& _fn) {
+    constexpr auto chunk = chunk_records<T>();
+    _pool.run((_count + chunk - 1) / chunk, [&](size_t _chunk) {
+        const auto last = min(_count, (_chunk + 1) * chunk);
+        for (auto i = _chunk * chunk; i < last; ++i) {
+            _fn(_objs[i]);
+        }
+    });
+}
+
+template<typename T, typename F>
+void parallel_transform(thread_pool& _pool, const T* _objs, size_t _count, vector<uint8_t>& _out, F&& _fn) {
+    constexpr auto chunk  = chunk_records<T>();
+    const auto     chunks = (_count + chunk - 1) / chunk;
+
+    // every chunk is transformed into its own buffer...
+
+    auto buffers = vector<vector<uint8_t>>(chunks);
+    _pool.run(chunks, [&](size_t _chunk) {
+        const auto last = min(_count, (_chunk + 1) * chunk);
+        buffers[_chunk].reserve((last - _chunk * chunk) * sizeof(T));
+        for (auto i = _chunk * chunk; i < last; ++i) {
+            _fn(_objs[i], buffers[_chunk]);
+        }
+    });
+
+    // ...and the buffers are concatenated in chunk order
+
+    auto offsets = vector<size_t>(chunks + 1, _out.size());
+    for (auto i = 0u; i < chunks; ++i) {
+        offsets[i + 1] = offsets[i] + buffers[i].size();
+    }
+    _out.resize(offsets.back());
+    _pool.run(chunks, [&](size_t _chunk) {
+        if (!buffers[_chunk].empty()) {
+            memcpy(_out.data() + offsets[_chunk], buffers[_chunk].data(), buffers[_chunk].size());
+        }
+    });
+}
+
+template<typename T>
+auto parallel_serialize(thread_pool& _pool, const T* _objs, size_t _count, vector<uint8_t>& _out) -> bool {
+    if (!details::get_plan<T>().safe) {
+        return false;
+    }
+
+    // without variable-length members every record takes exactly sizeof(T) bytes
+
+    if (details::get_plan<T>().items.empty()) {
+        constexpr auto chunk = chunk_records<T>();
+        const auto     base  = _out.size();
+        _out.resize(base + _count * sizeof(T));
+        _pool.run((_count + chunk - 1) / chunk, [&](size_t _chunk) {
+            const auto first = _chunk * chunk;
+            memcpy(_out.data() + base + first * sizeof(T), _objs + first, (min(_count, first + chunk) - first) * sizeof(T));
+        });
+        return true;
+    }
+    parallel_transform(_pool, _objs, _count, _out, [](const T& _obj, vector<uint8_t>& _buffer) { serialize(_obj, _buffer); });
+    return true;
+}
+
+} // namespace map_layout
+} // namespace qcstudio
@@ -0,0 +1,333 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iomanip>
+#include <istream>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "map_layout_index.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Attribution of sampled data accesses to fields
+
+    An 'access_profile' maps the data addresses of memory samples to the registered fields of
+    arrays of T and aggregates sample count, misses and latency per field and per cache line.
+
+    - The profiled process describes where its arrays live with 'write_region' (one line per
+      array: hex base address, element count and class name).
+    - The analyzer registers the candidate types with 'add_type<T>' and reads that description
+      with 'load_regions' (or calls 'add_region<T>' directly).
+    - Samples come from 'add' or from the output of
+
+          perf mem record -- ./app
+          perf script -F addr,weight,data_src > samples.txt
+
+      fed to 'add_perf_script'. Each line is parsed by 'parse_perf_sample': the last three
+      columns before the decoded data source are the address, the weight (load latency in
+      cycles) and the raw data source. A sample counts as a miss when it was not an L1 hit
+      (line fill buffer hits count as misses as they wait on one); samples without a memory
+      level ("LVL N/A") are not misses.
+
+    Cache lines are 64-byte blocks relative to the start of each element, which matches the
+    hardware lines when arrays are 64-byte aligned and sizeof(T) is a multiple of 64. Bytes not
+    covered by a registered field are reported as "(padding)".
+*/
+
+struct mem_sample {
+    uintptr_t address;
+    uint64_t  latency;
+    bool      miss;
+};
+
+struct access_stats {
+    size_t   samples = 0;
+    size_t   misses  = 0;
+    uint64_t latency = 0;
+};
+
+struct field_access {
+    string       region;     // class name and base address
+    string       field;      // field name and container path
+    size_t       first_byte; // position inside the element
+    access_stats stats;
+};
+
+struct line_access {
+    string       region;
+    size_t       line;       // 64-byte block inside the element
+    string       fields;     // fields overlapping the line
+    access_stats stats;
+};
+
+inline auto parse_perf_sample(const string& _line, mem_sample& _out) -> bool;
+
+template<typename T> void write_region(ostream& _out, const T* _base, size_t _count);
+
+class access_profile {
+public:
+    static constexpr auto line_bytes = size_t{64};
+
+    template<typename T> void add_type();
+    template<typename T> void add_region(uintptr_t _base, size_t _count);
+
+    auto load_regions   (istream& _in) -> size_t; // returns the number of regions added
+    auto add            (const mem_sample& _sample) -> bool;
+    auto add_perf_script(istream& _in) -> size_t; // returns the number of attributed samples
+
+    auto fields      () const -> vector<field_access>; // sorted by total latency
+    auto lines       () const -> vector<line_access>;  // sorted by total latency
+    auto unattributed() const -> const access_stats& { return outside; }
+
+    void report(ostream& _out, size_t _top = 20) const;
+
+private:
+    struct type_entry {
+        const field_index* index;
+        size_t             size;
+    };
+    struct region {
+        uintptr_t            base, end;
+        const string*        name;
+        const type_entry*    type;
+        vector<access_stats> leaves; // one per index leaf plus one for padding
+        vector<access_stats> lines;
+    };
+
+    void add_region(const string& _name, const type_entry& _type, uintptr_t _base, size_t _count);
+
+    map<string, type_entry> types;
+    vector<region>          regions; // sorted by base address
+    access_stats            outside;
+};
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+inline void accumulate(access_stats& _stats, const mem_sample& _sample) {
+    ++_stats.samples;
+    _stats.misses  += _sample.miss;
+    _stats.latency += _sample.latency;
+}
+
+inline auto region_label(const string& _name, uintptr_t _base) -> string {
+    stringstream out;
+    out << _name << " @ 0x" << hex << _base;
+    return out.str();
+}
+
+} // namespace details
+
+inline auto parse_perf_sample(const string& _line, mem_sample& _out) -> bool {
+    auto bar = _line.find('|');
+    if (bar == string::npos) {
+        return false;
+    }
+
+    vector<string> columns;
+    stringstream   in(_line.substr(0, bar));
+    for (string column; in >> column;) {
+        columns.push_back(column);
+    }
+    if (columns.size() < 3) {
+        return false;
+    }
+
+    const auto& address = columns[columns.size() - 3];
+    const auto& weight  = columns[columns.size() - 2];
+    char* end = nullptr;
+    _out.address = static_cast<uintptr_t>(strtoull(address.c_str(), &end, 16));
+    if (end == address.c_str() || *end) {
+        return false;
+    }
+    _out.latency = strtoull(weight.c_str(), &end, 10);
+    if (end == weight.c_str() || *end) {
+        return false;
+    }
+
+    // "...|LVL L1 hit|..."; samples without a memory level ("LVL N/A" or none, e.g. stores) are not misses
+
+    auto level = _line.find("|LVL ", bar);
+    _out.miss  = level != string::npos && _line.compare(level + 5, 6, "L1 hit") != 0 && _line.compare(level + 5, 3, "N/A") != 0;
+    return true;
+}
+
+template<typename T>
+void write_region(ostream& _out, const T* _base, size_t _count) {
+    _out << hex << reinterpret_cast<uintptr_t>(_base) << dec << " " << _count << " " << get_layout<T>().name << "\n";
+}
+
+template<typename T>
+void access_profile::add_type() {
+    types[get_layout<T>().name] = type_entry{ &get_field_index<T>(), sizeof(T) };
+}
+
+template<typename T>
+void access_profile::add_region(uintptr_t _base, size_t _count) {
+    add_type<T>();
+    auto it = types.find(get_layout<T>().name);
+    add_region(it->first, it->second, _base, _count);
+}
+
+inline void access_profile::add_region(const string& _name, const type_entry& _type, uintptr_t _base, size_t _count) {
+    auto r   = region{ _base, _base + _count * _type.size, &_name, &_type, {}, {} };
+    r.leaves.resize(_type.index->leaves().size() + 1);
+    r.lines.resize((_type.size + line_bytes - 1) / line_bytes);
+    auto pos = upper_bound(regions.begin(), regions.end(), _base, [](auto _base, auto& _r) { return _base < _r.base; });
+    regions.insert(pos, move(r));
+}
+
+inline auto access_profile::load_regions(istream& _in) -> size_t {
+    auto ret = size_t{0};
+    for (string line; getline(_in, line);) {
+        stringstream in(line);
+        auto base  = uintptr_t{0};
+        auto count = size_t{0};
+        string name;
+        if (!(in >> hex >> base >> dec >> count) || !getline(in >> ws, name)) {
+            continue;
+        }
+        if (auto it = types.find(name); it != types.end()) {
+            add_region(it->first, it->second, base, count);
+            ++ret;
+        }
+    }
+    return ret;
+}
+
+inline auto access_profile::add(const mem_sample& _sample) -> bool {
+    auto it = upper_bound(regions.begin(), regions.end(), _sample.address, [](auto _addr, auto& _r) { return _addr < _r.base; });
+    if (it == regions.begin() || (--it)->end <= _sample.address) {
+        details::accumulate(outside, _sample);
+        return false;
+    }
+
+    auto& r      = *it;
+    auto  offset = (_sample.address - r.base) % r.type->size;
+    auto  hit    = r.type->index->field_at(offset * CHAR_BIT);
+    auto  leaf   = hit ? static_cast<size_t>(hit - r.type->index->leaves().data()) : r.leaves.size() - 1;
+    details::accumulate(r.leaves[leaf], _sample);
+    details::accumulate(r.lines[offset / line_bytes], _sample);
+    return true;
+}
+
+inline auto access_profile::add_perf_script(istream& _in) -> size_t {
+    auto ret = size_t{0};
+    auto sample = mem_sample{};
+    for (string line; getline(_in, line);) {
+        if (parse_perf_sample(line, sample)) {
+            ret += add(sample);
+        }
+    }
+    return ret;
+}
+
+inline auto access_profile::fields() const -> vector<field_access> {
+    vector<field_access> ret;
+    for (auto& r : regions) {
+        auto  label  = details::region_label(*r.name, r.base);
+        auto& leaves = r.type->index->leaves();
+        for (auto i = 0u; i < r.leaves.size(); ++i) {
+            if (!r.leaves[i].samples) {
+                continue;
+            }
+            if (i < leaves.size()) {
+                ret.push_back({ label, leaves[i].field + leaves[i].path, leaves[i].first_bit / CHAR_BIT, r.leaves[i] });
+            } else {
+                ret.push_back({ label, "(padding)", 0, r.leaves[i] });
+            }
+        }
+    }
+    sort(ret.begin(), ret.end(), [](auto& _a, auto& _b) { return _a.stats.latency > _b.stats.latency; });
+    return ret;
+}
+
+inline auto access_profile::lines() const -> vector<line_access> {
+    vector<line_access> ret;
+    for (auto& r : regions) {
+        auto label = details::region_label(*r.name, r.base);
+        for (auto i = 0u; i < r.lines.size(); ++i) {
+            if (!r.lines[i].samples) {
+                continue;
+            }
+            string names;
+            r.type->index->fields_in(i * line_bytes * CHAR_BIT, (i + 1) * line_bytes * CHAR_BIT, [&](const field_hit& _hit) {
+                names += (names.empty() ? "" : " ") + (_hit.field + _hit.path);
+            });
+            ret.push_back({ label, i, move(names), r.lines[i] });
+        }
+    }
+    sort(ret.begin(), ret.end(), [](auto& _a, auto& _b) { return _a.stats.latency > _b.stats.latency; });
+    return ret;
+}
+
+inline void access_profile::report(ostream& _out, size_t _top) const {
+    auto row = [&](const access_stats& _s) {
+        _out << right << setw(10) << _s.samples << setw(10) << _s.misses
+             << setw(12) << fixed << setprecision(1) << (_s.samples ? static_cast<double>(_s.latency) / static_cast<double>(_s.samples) : 0.0)
+             << setw(14) << _s.latency;
+    };
+
+    _out << left << setw(40) << "region" << setw(30) << "field" << right << setw(8) << "offset"
+         << setw(10) << "samples" << setw(10) << "misses" << setw(12) << "avg lat" << setw(14) << "total lat" << "\n";
+    auto fs = fields();
+    for (auto i = 0u; i < fs.size() && i < _top; ++i) {
+        _out << left << setw(40) << fs[i].region << setw(30) << fs[i].field << right << setw(8) << fs[i].first_byte;
+        row(fs[i].stats);
+        _out << "\n";
+    }
+
+    _out << "\n" << left << setw(40) << "region" << right << setw(6) << "line"
+         << setw(10) << "samples" << setw(10) << "misses" << setw(12) << "avg lat" << setw(14) << "total lat" << "  fields\n";
+    auto ls = lines();
+    for (auto i = 0u; i < ls.size() && i < _top; ++i) {
+        _out << left << setw(40) << ls[i].region << right << setw(6) << ls[i].line;
+        row(ls[i].stats);
+        _out << "  " << ls[i].fields << "\n";
+    }
+
+    _out << "\n" << left << setw(40) << "unattributed" << right << setw(6) << "";
+    row(outside);
+    _out << "\n";
+}
+
+} // namespace map_layout
+} // namespace qcstudio
@@ -0,0 +1,447 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "map_layout_access.h"
+#include "map_layout_aggregate.h"
+#include "map_layout_filter.h"
+#include "map_layout_parallel.h"
+#include "map_layout_projection.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Value-range profiling of record arrays
+
+    'profile_ranges<T>' scans an array of T records (or a file of them, see 'mapped_file' in
+    map_layout_projection.h) and profiles every arithmetic and bit-field leaf with the type
+    given by its encoding:
+
+        auto p = profile_ranges(ticks.data(), ticks.size());
+        for (auto& f : p.fields) {
+            // f.name, f.min.as<double>(), f.max.as<double>(), f.distinct, f.zero_fraction()
+            // f.recommended_type ("uint16_t", "float", ...) and f.recommended_bits
+        }
+        p.typed_bytes;                                     // sizeof with the recommended types
+
+    - Min and max are exact, in the domain of the field like in 'aggregate'; NaNs are only
+      counted in 'nans'. 'distinct' is a HyperLogLog estimate (about 1.6% standard error).
+    - For real fields, 'float_exact' and 'half_exact' count the values that a float and an IEEE
+      half hold exactly (NaN and the infinities included) and 'integral' the whole numbers.
+    - The recommendation is the smallest type holding every value seen: an integer of 8 to 64
+      bits, unsigned when there are no negative values ('bool' for bool fields), and its width
+      as a bit-field. Real fields holding only whole numbers that fit a 64-bit integer are
+      recommended an integer, double fields holding only floats a 'float'; otherwise they are
+      kept.
+
+    'record_bytes' is sizeof(T). 'typed_bytes' projects it with every profiled leaf changed to
+    its recommended type and 'packed_bytes' with every integer leaf made a bit-field of the
+    recommended width, both with the members sorted by alignment and assuming every member of
+    T is registered; pointers, nested classes and other leaves keep their size. The savings
+    are those sizes applied to the profiled records. Passing a 'thread_pool' splits the scan
+    among its threads; the result is the same.
+*/
+
+struct field_profile {
+    string          name;             // with the path of container elements, e.g. "pos[1]"
+    field_kind      kind = field_kind::none;
+    uint32_t        bits = 0;         // current width
+    size_t          values = 0;       // non-NaN values
+    size_t          zeros = 0;
+    size_t          nans = 0;
+    aggregate_value min, max;
+    double          distinct = 0;     // estimated number of distinct values
+    size_t          float_exact = 0;  // real fields only
+    size_t          half_exact = 0;
+    size_t          integral = 0;
+    const char*     recommended_type = "";
+    uint32_t        recommended_bits = 0;
+    uint32_t        recommended_bytes = 0;
+
+    auto zero_fraction() const -> double { return values + nans ? static_cast<double>(zeros) / static_cast<double>(values + nans) : 0.0; }
+};
+
+struct range_profile {
+    bool                  valid = false;
+    size_t                records = 0;
+    size_t                record_bytes = 0;
+    size_t                typed_bytes = 0;
+    size_t                packed_bytes = 0;
+    vector<field_profile> fields;
+
+    auto typed_savings () const -> size_t { return records * (record_bytes - min(record_bytes, typed_bytes)); }  // bytes
+    auto packed_savings() const -> size_t { return records * (record_bytes - min(record_bytes, packed_bytes)); }
+};
+
+template<typename T> auto profile_ranges(const T* _records, size_t _count) -> range_profile;
+template<typename T> auto profile_ranges(thread_pool& _pool, const T* _records, size_t _count) -> range_profile;
+
+#if !defined(_WIN32)
+template<typename T> auto profile_ranges(const mapped_file& _file, size_t _offset = 0) -> range_profile;
+template<typename T> auto profile_ranges(thread_pool& _pool, const mapped_file& _file, size_t _offset = 0) -> range_profile;
+#endif
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+// HyperLogLog with 2^12 registers of hashed values
+
+constexpr auto sketch_log2 = 12u;
+
+struct distinct_sketch {
+    array<uint8_t, size_t{1} << sketch_log2> registers{};
+
+    void add(uint64_t _value) {
+        _value ^= _value >> 30; _value *= 0xBF58476D1CE4E5B9; // splitmix64 finalizer
+        _value ^= _value >> 27; _value *= 0x94D049BB133111EB;
+        _value ^= _value >> 31;
+        const auto idx  = static_cast<size_t>(_value >> (64 - sketch_log2));
+        const auto rank = static_cast<uint8_t>(lowest_bit(_value | (uint64_t{1} << (64 - sketch_log2))) + 1); // of the first 1 in the low bits
+        registers[idx] = max(registers[idx], rank);
+    }
+
+    void merge(const distinct_sketch& _other) {
+        for (auto i = size_t{0}; i < registers.size(); ++i) {
+            registers[i] = max(registers[i], _other.registers[i]);
+        }
+    }
+
+    auto estimate() const -> double {
+        const auto m   = static_cast<double>(registers.size());
+        auto       sum = 0.0;
+        auto       empty = size_t{0};
+        for (auto r : registers) {
+            sum   += ldexp(1.0, -static_cast<int>(r));
+            empty += r == 0;
+        }
+        const auto raw = 0.7213 / (1.0 + 1.079 / m) * m * m / sum;
+        return raw <= 2.5 * m && empty ? m * log(m / static_cast<double>(empty)) : raw; // linear counting for small sets
+    }
+};
+
+// what a scan of one leaf gathers (in the domain of the field)
+
+struct leaf_scan {
+    field_ref       ref;
+    int64_t         smin = numeric_limits<int64_t>::max(), smax = numeric_limits<int64_t>::min();
+    uint64_t        umin = numeric_limits<uint64_t>::max(), umax = 0;
+    double          rmin = numeric_limits<double>::infinity(), rmax = -numeric_limits<double>::infinity();
+    size_t          values = 0, zeros = 0, nans = 0, float_exact = 0, half_exact = 0, integral = 0;
+    distinct_sketch sketch;
+
+    void merge(const leaf_scan& _other) {
+        smin = min(smin, _other.smin); smax = max(smax, _other.smax);
+        umin = min(umin, _other.umin); umax = max(umax, _other.umax);
+        rmin = min(rmin, _other.rmin); rmax = max(rmax, _other.rmax);
+        values      += _other.values;
+        zeros       += _other.zeros;
+        nans        += _other.nans;
+        float_exact += _other.float_exact;
+        half_exact  += _other.half_exact;
+        integral    += _other.integral;
+        sketch.merge(_other.sketch);
+    }
+};
+
+// whether a float value is held exactly by an IEEE half (11 significant bits, exponents -24 to 15)
+
+inline auto half_holds(float _value) -> bool {
+    auto bits = uint32_t{0};
+    memcpy(&bits, &_value, sizeof(bits));
+    const auto exponent = static_cast<int>((bits >> 23) & 0xFF) - 127;
+    const auto mantissa = bits & 0x7FFFFF;
+    if ((bits & 0x7FFFFFFF) == 0 || exponent == 128) {
+        return true; // zeros, infinities and NaN
+    }
+    if (exponent > 15 || exponent < -24) {
+        return false;
+    }
+    const auto dropped = 13 + (exponent < -14 ? -14 - exponent : 0); // subnormal halves keep fewer bits
+    return ((mantissa | 0x800000) & ((uint32_t{1} << dropped) - 1)) == 0;
+}
+
+inline void scan_leaf(const uint8_t* _base, size_t _stride, size_t _count, leaf_scan& _scan) {
+    const auto& ref = _scan.ref;
+    switch (ref.kind()) {
+        case field_kind::sint: {
+            for (auto i = size_t{0}; i < _count; ++i) {
+                const auto v = ref.read<int64_t>(_base + i * _stride);
+                _scan.smin   = min(_scan.smin, v);
+                _scan.smax   = max(_scan.smax, v);
+                _scan.zeros += v == 0;
+                _scan.sketch.add(static_cast<uint64_t>(v));
+            }
+            _scan.values += _count;
+            break;
+        }
+        case field_kind::real: {
+            for (auto i = size_t{0}; i < _count; ++i) {
+                const auto v = ref.read<double>(_base + i * _stride);
+                if (v != v) {
+                    ++_scan.nans;
+                    ++_scan.float_exact;
+                    ++_scan.half_exact;
+                    continue;
+                }
+                _scan.rmin = min(_scan.rmin, v);
+                _scan.rmax = max(_scan.rmax, v);
+                _scan.zeros       += v == 0;
+                if (std::isinf(v) || (fabs(v) <= numeric_limits<float>::max() && static_cast<double>(static_cast<float>(v)) == v)) {
+                    ++_scan.float_exact;
+                    _scan.half_exact += half_holds(static_cast<float>(v));
+                }
+                _scan.integral    += std::isfinite(v) && trunc(v) == v;
+                auto bits = uint64_t{0};
+                const auto key = v == 0 ? 0.0 : v; // -0 and 0 are the same value
+                memcpy(&bits, &key, sizeof(bits));
+                _scan.sketch.add(bits);
+                ++_scan.values;
+            }
+            break;
+        }
+        default: {
+            for (auto i = size_t{0}; i < _count; ++i) {
+                const auto v = ref.read<uint64_t>(_base + i * _stride);
+                _scan.umin   = min(_scan.umin, v);
+                _scan.umax   = max(_scan.umax, v);
+                _scan.zeros += v == 0;
+                _scan.sketch.add(v);
+            }
+            _scan.values += _count;
+            break;
+        }
+    }
+}
+
+// smallest integer type (and bit-field width) holding [-_negative, _positive], false (and
+// '_out' untouched) if it takes more than 64 bits
+
+inline auto recommend_integer(uint64_t _negative, uint64_t _positive, field_profile& _out) -> bool {
+    const auto width = [](uint64_t _v) { auto n = 0u; for (; _v; _v >>= 1) { ++n; } return n; };
+    const auto bits  = _negative ? 1 + max(width(_positive), width(_negative - 1)) : max(1u, width(_positive));
+    if (bits > 64) {
+        return false;
+    }
+    const auto bytes = bits <= 8 ? 1u : bits <= 16 ? 2u : bits <= 32 ? 4u : 8u;
+    static const char* const names[2][4] = { { "uint8_t", "uint16_t", "uint32_t", "uint64_t" }, { "int8_t", "int16_t", "int32_t", "int64_t" } };
+    _out.recommended_type  = names[_negative ? 1 : 0][bytes == 1 ? 0 : bytes == 2 ? 1 : bytes == 4 ? 2 : 3];
+    _out.recommended_bits  = bits;
+    _out.recommended_bytes = bytes;
+    return true;
+}
+
+inline void recommend(field_profile& _out) {
+    switch (_out.kind) {
+        case field_kind::boolean: {
+            _out.recommended_type  = "bool";
+            _out.recommended_bits  = 1;
+            _out.recommended_bytes = 1;
+            break;
+        }
+        case field_kind::sint: {
+            const auto lo = _out.values ? _out.min.sint : 0, hi = _out.values ? _out.max.sint : 0;
+            recommend_integer(lo < 0 ? ~static_cast<uint64_t>(lo) + 1 : 0, hi < 0 ? 0 : static_cast<uint64_t>(hi), _out);
+            break;
+        }
+        case field_kind::uint: {
+            recommend_integer(0, _out.values ? _out.max.uint : 0, _out);
+            break;
+        }
+        default: {
+            const auto lo = _out.values ? _out.min.real : 0.0, hi = _out.values ? _out.max.real : 0.0;
+            const auto fits = lo >= -9223372036854775808.0 && hi < (lo < 0 ? 9223372036854775808.0 : 18446744073709551616.0); // int64_t or uint64_t
+            if (!_out.nans && _out.integral == _out.values && fits &&
+                recommend_integer(lo < 0 ? static_cast<uint64_t>(-lo) : 0, hi < 0 ? 0 : static_cast<uint64_t>(hi), _out)) {
+                break;
+            }
+            if (_out.bits == 32 || _out.float_exact == _out.values + _out.nans) {
+                _out.recommended_type  = "float";
+                _out.recommended_bits  = 32;
+                _out.recommended_bytes = 4;
+            } else {
+                _out.recommended_type  = "double";
+                _out.recommended_bits  = 64;
+                _out.recommended_bytes = 8;
+            }
+            break;
+        }
+    }
+}
+
+template<typename T>
+auto profile_ranges(thread_pool* _pool, const uint8_t* _base, size_t _count) -> range_profile {
+    auto ret = range_profile{};
+    ret.records      = _count;
+    ret.record_bytes = sizeof(T);
+
+    // leaves: profiled ones get a scan, the rest keep their size in the projections
+
+    auto scans = vector<leaf_scan>{};
+    auto kept  = vector<size_t>{}; // bytes of leaves that are not profiled
+    for (auto& hit : get_field_index<T>().leaves()) {
+        const auto name = string{hit.field} + hit.path;
+        auto ref = make_field_ref<T>(name.c_str());
+        if (ref.valid()) {
+            auto& scan = scans.emplace_back();
+            scan.ref = ref;
+            ret.fields.push_back({});
+            ret.fields.back().name = name;
+        } else {
+            kept.push_back((hit.last_bit - hit.first_bit + CHAR_BIT) / CHAR_BIT);
+        }
+    }
+
+    // each task scans a contiguous range of records; the partial scans are merged in order
+
+    const auto tasks = _pool ? max(size_t{1}, min(_pool->size(), _count)) : size_t{1};
+    auto partial = vector<vector<leaf_scan>>(tasks, scans);
+    auto work = [&](size_t _task) {
+        const auto first = _count * _task / tasks, last = _count * (_task + 1) / tasks;
+        for (auto& scan : partial[_task]) {
+            scan_leaf(_base + first * sizeof(T), sizeof(T), last - first, scan);
+        }
+    };
+    if (_pool && tasks > 1) {
+        _pool->run(tasks, work);
+    } else {
+        work(0);
+    }
+    for (auto t = size_t{1}; t < tasks; ++t) {
+        for (auto i = size_t{0}; i < scans.size(); ++i) {
+            partial[0][i].merge(partial[t][i]);
+        }
+    }
+
+    auto typed_bytes = size_t{0}, packed_bits = size_t{0}, typed_align = size_t{1}, packed_align = size_t{1};
+    for (auto i = size_t{0}; i < scans.size(); ++i) {
+        const auto& scan = partial[0][i];
+        auto&       out  = ret.fields[i];
+        out.kind        = scan.ref.kind();
+        out.bits        = scan.ref.bits();
+        out.values      = scan.values;
+        out.zeros       = scan.zeros;
+        out.nans        = scan.nans;
+        out.float_exact = scan.float_exact;
+        out.half_exact  = scan.half_exact;
+        out.integral    = scan.integral;
+        out.distinct    = min(scan.sketch.estimate(), static_cast<double>(scan.values + (scan.nans ? 1 : 0)));
+        switch (out.kind) {
+            case field_kind::sint: {
+                out.min.type = out.max.type = aggregate_value::kind::sint;
+                out.min.sint = scan.values ? scan.smin : 0;
+                out.max.sint = scan.values ? scan.smax : 0;
+                break;
+            }
+            case field_kind::real: {
+                out.min.type = out.max.type = aggregate_value::kind::real;
+                out.min.real = scan.values ? scan.rmin : 0.0;
+                out.max.real = scan.values ? scan.rmax : 0.0;
+                break;
+            }
+            default: {
+                out.min.type = out.max.type = aggregate_value::kind::uint;
+                out.min.uint = scan.values ? scan.umin : 0;
+                out.max.uint = scan.values ? scan.umax : 0;
+                break;
+            }
+        }
+        recommend(out);
+
+        typed_bytes += out.recommended_bytes;
+        typed_align  = max<size_t>(typed_align, out.recommended_bytes);
+        if (out.kind == field_kind::real && (!strcmp(out.recommended_type, "float") || !strcmp(out.recommended_type, "double"))) {
+            packed_bits += out.recommended_bytes * CHAR_BIT; // reals stay whole
+            packed_align = max<size_t>(packed_align, out.recommended_bytes);
+        } else {
+            packed_bits += out.recommended_bits;
+        }
+    }
+    for (auto bytes : kept) {
+        const auto align = min(size_t{8}, bytes & (~bytes + 1)); // largest power of two dividing the size
+        typed_bytes += bytes;
+        packed_bits += bytes * CHAR_BIT;
+        typed_align  = max(typed_align, align);
+        packed_align = max(packed_align, align);
+    }
+    const auto round_up = [](size_t _bytes, size_t _align) { return max(_align, (_bytes + _align - 1) / _align * _align); };
+    ret.typed_bytes  = round_up(typed_bytes, typed_align);
+    ret.packed_bytes = round_up((packed_bits + CHAR_BIT - 1) / CHAR_BIT, packed_align);
+    ret.valid        = true;
+    return ret;
+}
+
+} // namespace details
+
+template<typename T>
+auto profile_ranges(const T* _records, size_t _count) -> range_profile {
+    return details::profile_ranges<T>(nullptr, reinterpret_cast<const uint8_t*>(_records), _count);
+}
+
+template<typename T>
+auto profile_ranges(thread_pool& _pool, const T* _records, size_t _count) -> range_profile {
+    return details::profile_ranges<T>(&_pool, reinterpret_cast<const uint8_t*>(_records), _count);
+}
+
+#if !defined(_WIN32)
+
+template<typename T>
+auto profile_ranges(const mapped_file& _file, size_t _offset) -> range_profile {
+    if (!_file.valid() || _offset > _file.size()) {
+        return {};
+    }
+    _file.advise(_file.data(), _file.size(), MADV_SEQUENTIAL);
+    return details::profile_ranges<T>(nullptr, _file.data() + _offset, (_file.size() - _offset) / sizeof(T));
+}
+
+template<typename T>
+auto profile_ranges(thread_pool& _pool, const mapped_file& _file, size_t _offset) -> range_profile {
+    if (!_file.valid() || _offset > _file.size()) {
+        return {};
+    }
+    _file.advise(_file.data(), _file.size(), MADV_SEQUENTIAL);
+    return details::profile_ranges<T>(&_pool, _file.data() + _offset, (_file.size() - _offset) / sizeof(T));
+}
+
+#endif
+
+} // namespace map_layout
+} // namespace qcstudio
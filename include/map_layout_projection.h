@@ -0,0 +1,369 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#if !defined(_WIN32)
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define ML_PROJECTION_AVX2 1
+#endif
+
+#include "map_layout.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Field projection over arrays of raw records (POSIX only)
+
+    'mapped_file' maps a file read-only. 'project<T>' selects some registered fields of the T
+    records it holds (or of an in-memory array) by name and returns a 'projection':
+
+    - 'columns()' are strided views over every selected field (no copy).
+    - 'gather(first, count, out)' copies the selected fields of a range of records into dense
+      arrays, one per column ('out[c]' must hold 'count * columns()[c].bytes' bytes). It works
+      in blocks so that every page is visited once, with 4 and 8-byte fields gathered with AVX2
+      when the CPU supports it.
+
+    When records are wider than two pages, some pages hold only fields that are not selected:
+    the mapping is then advised as MADV_RANDOM (no read-ahead of whole records) and 'gather'
+    asks for the pages holding the selected fields of the next block with MADV_WILLNEED.
+    Narrower records are read sequentially (MADV_SEQUENTIAL).
+
+    Fields must be registered and fixed-size (not bit-fields nor variable-length/tagged); any
+    unknown or unsupported name leaves the projection invalid.
+*/
+
+class mapped_file {
+public:
+    mapped_file() = default;
+    explicit mapped_file(const char* _path);
+    mapped_file(mapped_file&& _other) noexcept { swap(_other); }
+    auto operator=(mapped_file&& _other) noexcept -> mapped_file& { swap(_other); return *this; }
+    ~mapped_file();
+
+    auto valid() const -> bool           { return base != nullptr; }
+    auto data () const -> const uint8_t* { return base; }
+    auto size () const -> size_t         { return bytes; }
+
+    void advise(const uint8_t* _from, size_t _bytes, int _advice) const; // page-aligns the range
+
+private:
+    void swap(mapped_file& _other) noexcept;
+
+    uint8_t* base  = nullptr;
+    size_t   bytes = 0;
+};
+
+struct column_view {
+    const char*    name;
+    const uint8_t* base;   // field of the first record
+    size_t         stride; // sizeof(T)
+    size_t         bytes;  // size of the field
+    size_t         count;
+
+    auto operator[](size_t _idx) const -> const uint8_t* { return base + _idx * stride; }
+    template<typename V> auto get(size_t _idx) const -> V; // sizeof(V) must match 'bytes'
+};
+
+class projection;
+
+template<typename T> auto project(const mapped_file& _file, const vector<const char*>& _fields, size_t _offset = 0) -> projection;
+template<typename T> auto project(const T* _records, size_t _count, const vector<const char*>& _fields) -> projection;
+
+class projection {
+public:
+    auto valid  () const -> bool                        { return ok; }
+    auto size   () const -> size_t                      { return count; }
+    auto columns() const -> const vector<column_view>&  { return views; }
+    auto column (const char* _name) const -> const column_view*;
+
+    void gather(size_t _first, size_t _count, uint8_t* const* _out) const;
+
+private:
+    template<typename T> friend auto project(const mapped_file&, const vector<const char*>&, size_t) -> projection;
+    template<typename T> friend auto project(const T*, size_t, const vector<const char*>&) -> projection;
+
+    template<typename T> auto select(const uint8_t* _base, size_t _count, const vector<const char*>& _fields) -> bool;
+    void prefetch(size_t _first, size_t _count) const;
+
+    vector<column_view> views;
+    vector<size_t>      by_offset;       // indices of 'views' in ascending field offset (prefetch)
+    size_t              count = 0;
+    size_t              block = 0;       // records per gather block
+    const mapped_file*  file  = nullptr; // for advice, null for in-memory arrays
+    bool                wide  = false;
+    bool                ok    = false;
+};
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+constexpr auto projection_block_bytes = size_t{256 * 1024}; // of source records per gather block
+
+inline auto page_size() -> size_t {
+    static const auto ret = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return ret;
+}
+
+template<size_t N>
+void gather_fixed(const uint8_t* _src, size_t _stride, size_t _count, uint8_t* _out) {
+    for (auto i = size_t{0}; i < _count; ++i) {
+        memcpy(_out + i * N, _src + i * _stride, N); // constant size: a single load/store
+    }
+}
+
+inline void gather_scalar(const uint8_t* _src, size_t _stride, size_t _count, size_t _bytes, uint8_t* _out) {
+    switch (_bytes) {
+        case 1:  gather_fixed<1> (_src, _stride, _count, _out); break;
+        case 2:  gather_fixed<2> (_src, _stride, _count, _out); break;
+        case 4:  gather_fixed<4> (_src, _stride, _count, _out); break;
+        case 8:  gather_fixed<8> (_src, _stride, _count, _out); break;
+        case 16: gather_fixed<16>(_src, _stride, _count, _out); break;
+        default: {
+            for (auto i = size_t{0}; i < _count; ++i) {
+                memcpy(_out + i * _bytes, _src + i * _stride, _bytes);
+            }
+            break;
+        }
+    }
+}
+
+#if ML_PROJECTION_AVX2
+
+// eight 4-byte or four 8-byte fields per gather instruction
+
+__attribute__((target("avx2")))
+inline void gather4_avx2(const uint8_t* _src, size_t _stride, size_t _count, uint8_t* _out) {
+    const auto s    = static_cast<int>(_stride);
+    const auto idx  = _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s);
+    auto i = size_t{0};
+    for (; i + 8 <= _count; i += 8) {
+        const auto values = _mm256_i32gather_epi32(reinterpret_cast<const int*>(_src + i * _stride), idx, 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(_out + i * 4), values);
+    }
+    gather_fixed<4>(_src + i * _stride, _stride, _count - i, _out + i * 4);
+}
+
+__attribute__((target("avx2")))
+inline void gather8_avx2(const uint8_t* _src, size_t _stride, size_t _count, uint8_t* _out) {
+    const auto s   = static_cast<long long>(_stride);
+    const auto idx = _mm256_setr_epi64x(0, s, 2 * s, 3 * s);
+    auto i = size_t{0};
+    for (; i + 4 <= _count; i += 4) {
+        const auto values = _mm256_i64gather_epi64(reinterpret_cast<const long long*>(_src + i * _stride), idx, 1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(_out + i * 8), values);
+    }
+    gather_fixed<8>(_src + i * _stride, _stride, _count - i, _out + i * 8);
+}
+
+#endif
+
+inline void gather_column(const uint8_t* _src, size_t _stride, size_t _count, size_t _bytes, uint8_t* _out) {
+#if ML_PROJECTION_AVX2
+    static const auto has_avx2 = __builtin_cpu_supports("avx2") != 0;
+    if (has_avx2 && _bytes == 4 && _stride <= INT_MAX / 8) {
+        gather4_avx2(_src, _stride, _count, _out);
+        return;
+    }
+    if (has_avx2 && _bytes == 8) {
+        gather8_avx2(_src, _stride, _count, _out);
+        return;
+    }
+#endif
+    gather_scalar(_src, _stride, _count, _bytes, _out);
+}
+
+} // namespace details
+
+inline mapped_file::mapped_file(const char* _path) {
+    auto fd = ::open(_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        auto mem = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        if (mem != MAP_FAILED) {
+            base  = static_cast<uint8_t*>(mem);
+            bytes = static_cast<size_t>(st.st_size);
+        }
+    }
+    close(fd); // the mapping keeps the file alive
+}
+
+inline mapped_file::~mapped_file() {
+    if (base) {
+        munmap(base, bytes);
+    }
+}
+
+inline void mapped_file::swap(mapped_file& _other) noexcept {
+    std::swap(base,  _other.base);
+    std::swap(bytes, _other.bytes);
+}
+
+inline void mapped_file::advise(const uint8_t* _from, size_t _bytes, int _advice) const {
+    const auto page  = details::page_size();
+    const auto first = max(reinterpret_cast<uintptr_t>(_from), reinterpret_cast<uintptr_t>(base)) / page * page;
+    const auto last  = min(reinterpret_cast<uintptr_t>(_from) + _bytes, reinterpret_cast<uintptr_t>(base) + bytes);
+    if (base && last > first) {
+        madvise(reinterpret_cast<void*>(first), last - first, _advice);
+    }
+}
+
+template<typename V>
+auto column_view::get(size_t _idx) const -> V {
+    V ret;
+    memcpy(&ret, base + _idx * stride, sizeof(V));
+    return ret;
+}
+
+inline auto projection::column(const char* _name) const -> const column_view* {
+    for (auto& view : views) {
+        if (!strcmp(view.name, _name)) {
+            return &view;
+        }
+    }
+    return nullptr;
+}
+
+template<typename T>
+auto projection::select(const uint8_t* _base, size_t _count, const vector<const char*>& _fields) -> bool {
+    count = _count;
+    block = max(size_t{1}, details::projection_block_bytes / sizeof(T));
+    for (auto field : _fields) {
+        auto& fields = get_layout<T>().fields;
+        auto  it     = find_if(fields.begin(), fields.end(), [&](auto& _f) { return !strcmp(_f.first, field); });
+        if (it == fields.end()) {
+            return false;
+        }
+        auto& item = it->second.item;
+        switch (item.category) {
+            case item_category::arithmetic:
+            case item_category::pointer:
+            case item_category::klass:
+            case item_category::container: {
+                const auto first = item.ranges.front() / CHAR_BIT;
+                const auto end   = item.ranges.back() / CHAR_BIT + 1;
+                views.push_back({ it->first, _base + first, sizeof(T), end - first, _count });
+                break;
+            }
+            default: {
+                return false;
+            }
+        }
+    }
+    by_offset.resize(views.size());
+    for (auto i = size_t{0}; i < views.size(); ++i) {
+        by_offset[i] = i;
+    }
+    sort(by_offset.begin(), by_offset.end(), [&](size_t _a, size_t _b) { return views[_a].base < views[_b].base; });
+    return true;
+}
+
+// ask for the pages of the next block holding selected fields, merging consecutive ranges
+// (fields are visited in offset order so that the addresses only grow)
+
+inline void projection::prefetch(size_t _first, size_t _count) const {
+    const auto page = details::page_size();
+    auto from = uintptr_t{0}, to = uintptr_t{0};
+    for (auto i = _first; i < _first + _count; ++i) {
+        for (auto v : by_offset) {
+            auto& view = views[v];
+            const auto begin = reinterpret_cast<uintptr_t>(view[i]) / page * page;
+            const auto end   = reinterpret_cast<uintptr_t>(view[i] + view.bytes);
+            if (begin > to) {
+                if (to > from) {
+                    file->advise(reinterpret_cast<const uint8_t*>(from), to - from, MADV_WILLNEED);
+                }
+                from = begin;
+            }
+            to = max(to, end);
+        }
+    }
+    if (to > from) {
+        file->advise(reinterpret_cast<const uint8_t*>(from), to - from, MADV_WILLNEED);
+    }
+}
+
+inline void projection::gather(size_t _first, size_t _count, uint8_t* const* _out) const {
+    const auto last = min(_first + _count, count);
+    for (auto begin = _first; begin < last; begin += block) {
+        const auto n = min(block, last - begin);
+        if (file && wide && begin + n < last) {
+            prefetch(begin + n, min(block, last - begin - n));
+        }
+        for (auto c = 0u; c < views.size(); ++c) {
+            auto& view = views[c];
+            details::gather_column(view[begin], view.stride, n, view.bytes, _out[c] + (begin - _first) * view.bytes);
+        }
+    }
+}
+
+template<typename T>
+auto project(const mapped_file& _file, const vector<const char*>& _fields, size_t _offset) -> projection {
+    auto ret = projection{};
+    if (!_file.valid() || _offset > _file.size()) {
+        return ret;
+    }
+    ret.file = &_file;
+    ret.wide = sizeof(T) >= 2 * details::page_size();
+    ret.ok   = ret.template select<T>(_file.data() + _offset, (_file.size() - _offset) / sizeof(T), _fields);
+    if (ret.ok) {
+        _file.advise(_file.data(), _file.size(), ret.wide ? MADV_RANDOM : MADV_SEQUENTIAL);
+    }
+    return ret;
+}
+
+template<typename T>
+auto project(const T* _records, size_t _count, const vector<const char*>& _fields) -> projection {
+    auto ret = projection{};
+    ret.ok   = ret.template select<T>(reinterpret_cast<const uint8_t*>(_records), _count, _fields);
+    return ret;
+}
+
+} // namespace map_layout
+} // namespace qcstudio
+
+#endif
@@ -0,0 +1,558 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#if !defined(_WIN32)
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "map_layout.h"
+#include "map_layout_index.h"
+#include "map_layout_serializer.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Shared-memory ring buffer of T records (POSIX only)
+
+    'shm_ring<T>::create' maps a new ring of '_capacity' (rounded up to a power of two) records,
+    either named ('shm_open', other processes use 'attach') or anonymous ('memfd_create' on Linux,
+    hand 'fd()' to the other process, e.g. over a unix socket, and use 'attach_fd'). The header
+    of the mapping carries the layout fingerprint, sizeof/alignof T and a binary description of
+    the layout (leaf names, kinds, bit ranges and the fingerprints of nested classes).
+
+    - Attaching processes with the same fingerprint exchange records in place: 'try_produce'
+      and 'try_consume' hand out the slot itself and 'try_push'/'try_pop' are a single copy.
+    - With a different fingerprint, records are converted field by field (matched by name and
+      container path, same kind and width, nested classes with the same fingerprint); fields missing on one side are zero-initialized.
+      'zero_copy()' tells which path is in use; an incompatible ring is still usable.
+
+    'ring_mode::spsc' supports one producer and one consumer, 'ring_mode::mpmc' any number of
+    both (bounded queue with a sequence number per slot). All operations are lock-free and
+    non-blocking: they return false when the ring is full/empty.
+
+    T must be trivially copyable. Failures (missing segment, bad or truncated header) leave the
+    object invalid, check 'valid()'.
+*/
+
+enum class ring_mode : uint32_t {
+    spsc = 1,
+    mpmc = 2,
+};
+
+template<typename T>
+class shm_ring {
+    static_assert(is_trivially_copyable_v<T>, "shm_ring records must be trivially copyable");
+
+public:
+    static auto create   (const char* _name, size_t _capacity, ring_mode _mode = ring_mode::spsc) -> shm_ring; // nullptr name: anonymous memfd
+    static auto attach   (const char* _name) -> shm_ring;
+    static auto attach_fd(int _fd) -> shm_ring;  // the descriptor is duplicated
+    static auto unlink   (const char* _name) -> bool;
+
+    shm_ring() = default;
+    shm_ring(shm_ring&& _other) noexcept { swap(_other); }
+    auto operator=(shm_ring&& _other) noexcept -> shm_ring& { swap(_other); return *this; }
+    ~shm_ring();
+
+    auto valid    () const -> bool      { return base != nullptr; }
+    auto zero_copy() const -> bool      { return same_layout; }
+    auto capacity () const -> size_t    { return mask + 1; }
+    auto mode     () const -> ring_mode { return header()->mode; }
+    auto fd       () const -> int       { return handle; }
+
+    auto try_push(const T& _record) -> bool;
+    auto try_pop (T& _record) -> bool;
+
+    template<typename F> auto try_produce(F&& _fill) -> bool;    // _fill(T&): writes the record in place
+    template<typename F> auto try_consume(F&& _use) -> bool;     // _use(const T&): reads the record in place
+
+private:
+    struct ring_header;
+
+    auto open(int _fd, bool _create, size_t _capacity, ring_mode _mode) -> bool;
+    auto header() const -> ring_header*;
+    auto slot  (uint64_t _pos) const -> uint8_t*;
+
+    template<typename F> auto reserve(F&& _write) -> bool;
+    template<typename F> auto release(F&& _read) -> bool;
+
+    void swap(shm_ring& _other) noexcept;
+
+    uint8_t*                 base        = nullptr;
+    size_t                   bytes       = 0;
+    int                      handle      = -1;
+    uint64_t                 mask        = 0;
+    bool                     same_layout = false;
+    uint64_t                 cached_tail = 0; // last seen indices of the other side (spsc)
+    uint64_t                 cached_head = 0;
+    vector<array<size_t, 3>> to_local;        // conversion plans: { remote bit, local bit, bits }
+    vector<array<size_t, 3>> to_remote;       // { local bit, remote bit, bits }
+};
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+constexpr auto ring_magic   = uint32_t{0x524C4D4C}; // "LMLR"
+constexpr auto ring_version = uint32_t{2};
+
+static_assert(atomic<uint64_t>::is_always_lock_free, "shm_ring needs lock-free 64-bit atomics");
+
+// binary layout: leaf count, then for every leaf (sorted by name): name length, name, kind,
+// arithmetic encoding, nested class fingerprint, first bit and last bit
+
+struct ring_leaf {
+    string   name;
+    uint8_t  category;
+    uint8_t  encoding;
+    uint64_t fingerprint; // of the nested class layout, 0 for other kinds
+    uint64_t first_bit;
+    uint64_t last_bit;
+};
+
+inline auto ring_leaves(const field_index& _index) -> vector<ring_leaf> {
+    vector<ring_leaf> ret;
+    for (auto& leaf : _index.leaves()) {
+        auto encoding    = leaf.item->category == item_category::arithmetic ? leaf.item->data.encoded_arithmetic : uint8_t{0};
+        auto fingerprint = leaf.item->category == item_category::klass ? layout_fingerprint(leaf.item->data.klass.layout()) : uint64_t{0};
+        ret.push_back({ leaf.field + leaf.path, static_cast<uint8_t>(leaf.item->category), encoding, fingerprint, leaf.first_bit, leaf.last_bit });
+    }
+    sort(ret.begin(), ret.end(), [](auto& _a, auto& _b) { return _a.name < _b.name; });
+    return ret;
+}
+
+inline auto encode_ring_layout(const vector<ring_leaf>& _leaves) -> vector<uint8_t> {
+    vector<uint8_t> ret;
+    write_scalar(static_cast<uint32_t>(_leaves.size()), ret);
+    for (auto& leaf : _leaves) {
+        write_scalar(static_cast<uint32_t>(leaf.name.size()), ret);
+        ret.insert(ret.end(), leaf.name.begin(), leaf.name.end());
+        write_scalar(leaf.category, ret);
+        write_scalar(leaf.encoding, ret);
+        write_scalar(leaf.fingerprint, ret);
+        write_scalar(leaf.first_bit, ret);
+        write_scalar(leaf.last_bit, ret);
+    }
+    return ret;
+}
+
+inline auto decode_ring_layout(const uint8_t* _data, size_t _size, vector<ring_leaf>& _out) -> bool {
+    auto in    = reader{ _data, _size, 0 };
+    auto count = uint32_t{0};
+    if (!in.read(&count, sizeof(count))) {
+        return false;
+    }
+    for (auto i = 0u; i < count; ++i) {
+        auto leaf = ring_leaf{};
+        auto len  = uint32_t{0};
+        if (!in.read(&len, sizeof(len)) || in.remaining() < len) {
+            return false;
+        }
+        leaf.name.assign(reinterpret_cast<const char*>(_data + in.pos), len);
+        in.pos += len;
+        if (!in.read(&leaf.category, 1) || !in.read(&leaf.encoding, 1) || !in.read(&leaf.fingerprint, 8) || !in.read(&leaf.first_bit, 8) || !in.read(&leaf.last_bit, 8)) {
+            return false;
+        }
+        _out.push_back(move(leaf));
+    }
+    return true;
+}
+
+// plan of { source bit, destination bit, bits } copies for the leaves present on both sides
+
+inline auto ring_plan(const vector<ring_leaf>& _src, const vector<ring_leaf>& _dst) -> vector<array<size_t, 3>> {
+    vector<array<size_t, 3>> ret;
+    auto s = _src.begin();
+    for (auto& d : _dst) {
+        while (s != _src.end() && s->name < d.name) {
+            ++s;
+        }
+        if (s == _src.end() || s->name != d.name) {
+            continue;
+        }
+        if (s->category == d.category && s->encoding == d.encoding && s->fingerprint == d.fingerprint && s->last_bit - s->first_bit == d.last_bit - d.first_bit) {
+            ret.push_back({ s->first_bit, d.first_bit, d.last_bit + 1 - d.first_bit });
+        }
+    }
+    return ret;
+}
+
+inline void copy_bits(const uint8_t* _src, size_t _src_bit, uint8_t* _dst, size_t _dst_bit, size_t _bits) {
+    if (_src_bit % CHAR_BIT == 0 && _dst_bit % CHAR_BIT == 0 && _bits % CHAR_BIT == 0) {
+        memcpy(_dst + _dst_bit / CHAR_BIT, _src + _src_bit / CHAR_BIT, _bits / CHAR_BIT);
+        return;
+    }
+    for (auto i = size_t{0}; i < _bits; ++i) { // bit-fields
+        auto s   = _src_bit + i;
+        auto d   = _dst_bit + i;
+        auto bit = (_src[s / CHAR_BIT] >> (s % CHAR_BIT)) & 1;
+        _dst[d / CHAR_BIT] = static_cast<uint8_t>((_dst[d / CHAR_BIT] & ~(1u << (d % CHAR_BIT))) | (bit << (d % CHAR_BIT)));
+    }
+}
+
+inline void convert_record(const vector<array<size_t, 3>>& _plan, const uint8_t* _src, uint8_t* _dst, size_t _dst_size) {
+    memset(_dst, 0, _dst_size);
+    for (auto& [ src_bit, dst_bit, bits ] : _plan) {
+        copy_bits(_src, src_bit, _dst, dst_bit, bits);
+    }
+}
+
+constexpr auto round_up(size_t _value, size_t _align) -> size_t {
+    return (_value + _align - 1) / _align * _align;
+}
+
+} // namespace details
+
+/*
+    Mapping: header (own cache lines for the producer and consumer indices), binary layout and
+    slots. Every slot holds a sequence number followed by the record.
+*/
+
+template<typename T>
+struct shm_ring<T>::ring_header {
+    atomic<uint32_t> magic;         // written last by the creator
+    uint32_t         version;
+    ring_mode        mode;
+    uint32_t         layout_bytes;
+    uint64_t         fingerprint;
+    uint64_t         record_size;
+    uint64_t         record_offset; // inside the slot
+    uint64_t         slot_stride;
+    uint64_t         slots_offset;  // from the start of the mapping
+    uint64_t         capacity;
+    alignas(64) atomic<uint64_t> head;
+    alignas(64) atomic<uint64_t> tail;
+    alignas(64) uint8_t          layout[1];
+};
+
+template<typename T>
+auto shm_ring<T>::create(const char* _name, size_t _capacity, ring_mode _mode) -> shm_ring {
+    auto ret = shm_ring{};
+    auto fd  = -1;
+    if (_name) {
+        fd = shm_open(_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    } else {
+#if defined(__linux__)
+        fd = memfd_create("map_layout_ring", MFD_CLOEXEC);
+#endif
+    }
+    if (fd >= 0 && !ret.open(fd, true, _capacity, _mode)) {
+        ret = shm_ring{};
+        if (_name) {
+            shm_unlink(_name);
+        }
+    }
+    return ret;
+}
+
+template<typename T>
+auto shm_ring<T>::attach(const char* _name) -> shm_ring {
+    auto ret = shm_ring{};
+    auto fd  = shm_open(_name, O_RDWR, 0600);
+    if (fd >= 0 && !ret.open(fd, false, 0, ring_mode::spsc)) {
+        ret = shm_ring{};
+    }
+    return ret;
+}
+
+template<typename T>
+auto shm_ring<T>::attach_fd(int _fd) -> shm_ring {
+    auto ret = shm_ring{};
+    auto fd  = dup(_fd);
+    if (fd >= 0 && !ret.open(fd, false, 0, ring_mode::spsc)) {
+        ret = shm_ring{};
+    }
+    return ret;
+}
+
+template<typename T>
+auto shm_ring<T>::unlink(const char* _name) -> bool {
+    return shm_unlink(_name) == 0;
+}
+
+template<typename T>
+shm_ring<T>::~shm_ring() {
+    if (base) {
+        munmap(base, bytes);
+    }
+    if (handle >= 0) {
+        close(handle);
+    }
+}
+
+template<typename T>
+void shm_ring<T>::swap(shm_ring& _other) noexcept {
+    std::swap(base,        _other.base);
+    std::swap(bytes,       _other.bytes);
+    std::swap(handle,      _other.handle);
+    std::swap(mask,        _other.mask);
+    std::swap(same_layout, _other.same_layout);
+    std::swap(cached_tail, _other.cached_tail);
+    std::swap(cached_head, _other.cached_head);
+    std::swap(to_local,    _other.to_local);
+    std::swap(to_remote,   _other.to_remote);
+}
+
+template<typename T>
+auto shm_ring<T>::open(int _fd, bool _create, size_t _capacity, ring_mode _mode) -> bool {
+    handle = _fd; // owned from now on, released by the destructor on failure too
+
+    const auto local = details::ring_leaves(get_field_index<T>());
+    if (_create) {
+        auto capacity = size_t{1};
+        while (capacity < max(_capacity, size_t{1})) {
+            capacity <<= 1;
+        }
+        const auto layout        = details::encode_ring_layout(local);
+        const auto record_offset = details::round_up(sizeof(atomic<uint64_t>), alignof(T));
+        const auto slot_stride   = details::round_up(record_offset + sizeof(T), max(alignof(T), alignof(atomic<uint64_t>)));
+        const auto slots_offset  = details::round_up(offsetof(ring_header, layout) + layout.size(), max(alignof(T), size_t{64}));
+        bytes = slots_offset + capacity * slot_stride;
+        if (ftruncate(_fd, static_cast<off_t>(bytes)) != 0) {
+            return false;
+        }
+        auto mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (mem == MAP_FAILED) {
+            return false;
+        }
+        base = static_cast<uint8_t*>(mem);
+
+        auto h = new (base) ring_header{};
+        h->version       = details::ring_version;
+        h->mode          = _mode;
+        h->layout_bytes  = static_cast<uint32_t>(layout.size());
+        h->fingerprint   = layout_fingerprint<T>();
+        h->record_size   = sizeof(T);
+        h->record_offset = record_offset;
+        h->slot_stride   = slot_stride;
+        h->slots_offset  = slots_offset;
+        h->capacity      = capacity;
+        memcpy(base + offsetof(ring_header, layout), layout.data(), layout.size());
+        for (auto i = uint64_t{0}; i < capacity; ++i) {
+            new (base + slots_offset + i * slot_stride) atomic<uint64_t>{ i };
+        }
+        h->magic.store(details::ring_magic, memory_order_release);
+    } else {
+        struct stat st;
+        if (fstat(_fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ring_header)) {
+            return false;
+        }
+        bytes = static_cast<size_t>(st.st_size);
+        auto mem = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (mem == MAP_FAILED) {
+            return false;
+        }
+        base = static_cast<uint8_t*>(mem);
+
+        auto h = header();
+        if (h->magic.load(memory_order_acquire) != details::ring_magic || h->version != details::ring_version ||
+            (h->mode != ring_mode::spsc && h->mode != ring_mode::mpmc) || !h->capacity || (h->capacity & (h->capacity - 1)) ||
+            offsetof(ring_header, layout) + h->layout_bytes > h->slots_offset ||
+            h->record_offset + h->record_size > h->slot_stride || h->slots_offset + h->capacity * h->slot_stride > bytes) {
+            munmap(base, bytes);
+            base = nullptr;
+            return false;
+        }
+    }
+
+    // compatibility is decided once; different layouts get conversion plans
+
+    auto h = header();
+    mask        = h->capacity - 1;
+    same_layout = h->fingerprint == layout_fingerprint<T>() && h->record_size == sizeof(T) && h->record_offset % alignof(T) == 0;
+    if (!same_layout) {
+        vector<details::ring_leaf> remote;
+        const auto in_record = [&](const details::ring_leaf& _leaf) { return _leaf.first_bit <= _leaf.last_bit && _leaf.last_bit < h->record_size * CHAR_BIT; };
+        if (!details::decode_ring_layout(base + offsetof(ring_header, layout), h->layout_bytes, remote) || !all_of(remote.begin(), remote.end(), in_record)) {
+            munmap(base, bytes);
+            base = nullptr;
+            return false;
+        }
+        to_local  = details::ring_plan(remote, local);
+        to_remote = details::ring_plan(local, remote);
+    }
+    return true;
+}
+
+template<typename T>
+auto shm_ring<T>::header() const -> ring_header* {
+    return reinterpret_cast<ring_header*>(base);
+}
+
+template<typename T>
+auto shm_ring<T>::slot(uint64_t _pos) const -> uint8_t* {
+    return base + header()->slots_offset + (_pos & mask) * header()->slot_stride;
+}
+
+// producer side: claims a slot, '_write(record)' fills it and publishes it
+
+template<typename T>
+template<typename F>
+auto shm_ring<T>::reserve(F&& _write) -> bool {
+    auto h = header();
+    if (h->mode == ring_mode::spsc) {
+        auto pos = h->head.load(memory_order_relaxed);
+        if (pos - cached_tail > mask) {
+            cached_tail = h->tail.load(memory_order_acquire);
+            if (pos - cached_tail > mask) {
+                return false;
+            }
+        }
+        _write(slot(pos) + h->record_offset);
+        h->head.store(pos + 1, memory_order_release);
+        return true;
+    }
+
+    auto pos = h->head.load(memory_order_relaxed);
+    for (;;) {
+        auto seq  = reinterpret_cast<atomic<uint64_t>*>(slot(pos))->load(memory_order_acquire);
+        auto diff = static_cast<int64_t>(seq - pos);
+        if (diff == 0) {
+            if (h->head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = h->head.load(memory_order_relaxed);
+        }
+    }
+    _write(slot(pos) + h->record_offset);
+    reinterpret_cast<atomic<uint64_t>*>(slot(pos))->store(pos + 1, memory_order_release);
+    return true;
+}
+
+// consumer side: claims a published slot, '_read(record)' reads it and hands it back
+
+template<typename T>
+template<typename F>
+auto shm_ring<T>::release(F&& _read) -> bool {
+    auto h = header();
+    if (h->mode == ring_mode::spsc) {
+        auto pos = h->tail.load(memory_order_relaxed);
+        if (static_cast<int64_t>(cached_head - pos) <= 0) {
+            cached_head = h->head.load(memory_order_acquire);
+            if (cached_head == pos) {
+                return false;
+            }
+        }
+        _read(static_cast<const uint8_t*>(slot(pos) + h->record_offset));
+        h->tail.store(pos + 1, memory_order_release);
+        return true;
+    }
+
+    auto pos = h->tail.load(memory_order_relaxed);
+    for (;;) {
+        auto seq  = reinterpret_cast<atomic<uint64_t>*>(slot(pos))->load(memory_order_acquire);
+        auto diff = static_cast<int64_t>(seq - (pos + 1));
+        if (diff == 0) {
+            if (h->tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        } else {
+            pos = h->tail.load(memory_order_relaxed);
+        }
+    }
+    _read(static_cast<const uint8_t*>(slot(pos) + h->record_offset));
+    reinterpret_cast<atomic<uint64_t>*>(slot(pos))->store(pos + mask + 1, memory_order_release);
+    return true;
+}
+
+template<typename T>
+auto shm_ring<T>::try_push(const T& _record) -> bool {
+    return reserve([&](uint8_t* _slot) {
+        if (same_layout) {
+            memcpy(_slot, &_record, sizeof(T));
+        } else {
+            details::convert_record(to_remote, reinterpret_cast<const uint8_t*>(&_record), _slot, header()->record_size);
+        }
+    });
+}
+
+template<typename T>
+auto shm_ring<T>::try_pop(T& _record) -> bool {
+    return release([&](const uint8_t* _slot) {
+        if (same_layout) {
+            memcpy(&_record, _slot, sizeof(T));
+        } else {
+            details::convert_record(to_local, _slot, reinterpret_cast<uint8_t*>(&_record), sizeof(T));
+        }
+    });
+}
+
+template<typename T>
+template<typename F>
+auto shm_ring<T>::try_produce(F&& _fill) -> bool {
+    return reserve([&](uint8_t* _slot) {
+        if (same_layout) {
+            _fill(*reinterpret_cast<T*>(_slot));
+        } else {
+            T record{};
+            _fill(record);
+            details::convert_record(to_remote, reinterpret_cast<const uint8_t*>(&record), _slot, header()->record_size);
+        }
+    });
+}
+
+template<typename T>
+template<typename F>
+auto shm_ring<T>::try_consume(F&& _use) -> bool {
+    return release([&](const uint8_t* _slot) {
+        if (same_layout) {
+            _use(*reinterpret_cast<const T*>(_slot));
+        } else {
+            T record;
+            details::convert_record(to_local, _slot, reinterpret_cast<uint8_t*>(&record), sizeof(T));
+            _use(static_cast<const T&>(record));
+        }
+    });
+}
+
+} // namespace map_layout
+} // namespace qcstudio
+
+#endif
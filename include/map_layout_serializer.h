@@ -0,0 +1,328 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include "map_layout.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Layout-driven memcpy serialization
+
+    An object is written as its fixed part (sizeof(T) raw bytes, in native byte order, with the
+    bytes of variable-length and tagged members zeroed) followed by the payloads of those
+    members in offset order:
+
+    - dynamic: uint64_t element count followed by every element (fixed part + payloads)
+    - tagged:  uint32_t alternative index (0xFFFFFFFF when empty) followed by the active
+               alternative (fixed part + payloads)
+
+    The registered members of nested classes ('klass' items) are followed like those of T, so
+    their variable-length and tagged members are written as payloads too; everything else is
+    copied bitwise. Hence T, its nested classes and the elements of its variable-length members
+    must be trivially copyable or have registered the members that make them not so (e.g. a
+    std::string member): otherwise 'serialize' returns false without writing anything and
+    'deserialize' returns 0.
+
+    'deserialize' expects an already constructed object, returns the number of bytes consumed
+    or 0 if the input is truncated or malformed.
+*/
+
+template<typename T> auto serialize  (const T& _obj, vector<uint8_t>& _out) -> bool;
+template<typename T> auto deserialize(const uint8_t* _data, size_t _size, T& _obj) -> size_t;
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+// items carrying out-of-line payloads, in offset order, with the byte offset of the (nested)
+// class whose layout they belong to
+
+struct serial_entry {
+    const item_t* item;
+    size_t        offset;
+};
+
+struct serial_plan {
+    vector<serial_entry> items;
+    bool                 safe = true; // false if some non-trivially copyable part would be copied bitwise
+};
+
+inline auto get_plan(const item_t& _item) -> const serial_plan&;
+
+inline void collect_payload_items(const item_t& _item, size_t _offset, serial_plan& _plan) {
+    switch (_item.category) {
+        case item_category::container: {
+            for (auto i = 0u; i < _item.data.container.count; ++i) {
+                collect_payload_items(_item.data.container.items[i], _offset, _plan);
+            }
+            break;
+        }
+        case item_category::klass: {
+
+            // the members of nested classes are part of the plan; a class that is not trivially
+            // copyable must have registered the members that make it so
+
+            auto& nested = _item.data.klass.layout();
+            auto  before = _plan.items.size();
+            for (auto& [ name, info ] : nested.fields) {
+                collect_payload_items(info.item, _offset + _item.ranges.front() / CHAR_BIT, _plan);
+            }
+            _plan.safe = _plan.safe && (nested.trivially_copyable || _plan.items.size() > before);
+            break;
+        }
+        case item_category::dynamic: {
+            _plan.items.push_back({ &_item, _offset });
+            _plan.safe = _plan.safe && get_plan(*_item.data.dynamic.elem).safe;
+            break;
+        }
+        case item_category::tagged: {
+            _plan.items.push_back({ &_item, _offset });
+            for (auto i = 0u; i < _item.data.tagged.ops->count; ++i) {
+                _plan.safe = _plan.safe && get_plan(_item.data.tagged.items[i]).safe;
+            }
+            break;
+        }
+        default: {
+            break;
+        }
+    }
+}
+
+inline auto first_byte(const serial_entry& _entry) -> size_t { return _entry.offset + _entry.item->ranges.front() / CHAR_BIT;     }
+inline auto end_byte  (const serial_entry& _entry) -> size_t { return _entry.offset + _entry.item->ranges.back()  / CHAR_BIT + 1; }
+
+inline void sort_plan(serial_plan& _plan) {
+    sort(_plan.items.begin(), _plan.items.end(), [](auto& _a, auto& _b) { return first_byte(_a) < first_byte(_b); });
+}
+
+inline auto make_plan(const item_t& _item) -> serial_plan {
+    serial_plan ret;
+    collect_payload_items(_item, 0, ret);
+    sort_plan(ret); // container elements are not always registered in offset order (e.g. tuples)
+    return ret;
+}
+
+inline auto make_plan(const class_layout& _layout) -> serial_plan {
+    serial_plan ret;
+    for (auto& [ name, info ] : _layout.fields) {
+        collect_payload_items(info.item, 0, ret);
+    }
+    sort_plan(ret);
+    ret.safe = ret.safe && (_layout.trivially_copyable || !ret.items.empty());
+    return ret;
+}
+
+template<typename T>
+auto get_plan() -> const serial_plan& {
+    static const auto ret = make_plan(get_layout<T>());
+    return ret;
+}
+
+// plans of elements and alternatives, built once per item (items live as long as their layouts)
+// and cached per thread so that parallel serialization takes no lock
+
+inline auto get_plan(const item_t& _item) -> const serial_plan& {
+    thread_local auto plans = unordered_map<const item_t*, serial_plan>{};
+    auto it = plans.find(&_item);
+    if (it == plans.end()) {
+        auto plan = make_plan(_item);
+        it = plans.emplace(&_item, move(plan)).first;
+    }
+    return it->second;
+}
+
+// writing
+
+inline void write_object(const serial_plan& _plan, const uint8_t* _base, size_t _size, vector<uint8_t>& _out);
+
+template<typename U>
+void write_scalar(U _value, vector<uint8_t>& _out) {
+    auto bytes = reinterpret_cast<const uint8_t*>(&_value);
+    _out.insert(_out.end(), bytes, bytes + sizeof(U));
+}
+
+inline void write_payload(const serial_entry& _entry, const uint8_t* _base, vector<uint8_t>& _out) {
+    auto& _item = *_entry.item;
+    auto  field = _base + first_byte(_entry);
+    if (_item.category == item_category::dynamic) {
+        auto& ops          = *_item.data.dynamic.ops;
+        auto [data, count] = ops.view(field);
+        auto elems         = static_cast<const uint8_t*>(data);
+        write_scalar(static_cast<uint64_t>(count), _out);
+
+        const auto& plan = get_plan(*_item.data.dynamic.elem);
+        if (plan.items.empty()) {
+            _out.insert(_out.end(), elems, elems + count * ops.elem_size);
+        } else {
+            for (auto i = 0u; i < count; ++i) {
+                write_object(plan, elems + i * ops.elem_size, ops.elem_size, _out);
+            }
+        }
+    } else {
+        auto& ops = *_item.data.tagged.ops;
+        auto  idx = ops.index(field);
+        write_scalar(idx == tagged_npos ? numeric_limits<uint32_t>::max() : static_cast<uint32_t>(idx), _out);
+        if (idx != tagged_npos) {
+            auto alt = static_cast<const uint8_t*>(ops.get[idx](field));
+            write_object(get_plan(_item.data.tagged.items[idx]), alt, ops.sizes[idx], _out);
+        }
+    }
+}
+
+inline void write_object(const serial_plan& _plan, const uint8_t* _base, size_t _size, vector<uint8_t>& _out) {
+    const auto fixed = _out.size();
+    _out.insert(_out.end(), _base, _base + _size);
+    for (auto& entry : _plan.items) {
+        memset(_out.data() + fixed + first_byte(entry), 0, end_byte(entry) - first_byte(entry));
+    }
+    for (auto& entry : _plan.items) {
+        write_payload(entry, _base, _out);
+    }
+}
+
+// reading
+
+struct reader {
+    const uint8_t* data;
+    size_t         size;
+    size_t         pos;
+
+    auto remaining() const -> size_t {
+        return size - pos;
+    }
+
+    auto read(void* _dst, size_t _bytes) -> bool {
+        if (remaining() < _bytes) {
+            return false;
+        }
+        memcpy(_dst, data + pos, _bytes);
+        pos += _bytes;
+        return true;
+    }
+};
+
+inline auto read_object(const serial_plan& _plan, uint8_t* _base, size_t _size, reader& _in) -> bool;
+
+inline auto read_payload(const serial_entry& _entry, uint8_t* _base, reader& _in) -> bool {
+    auto& _item = *_entry.item;
+    auto  field = _base + first_byte(_entry);
+    if (_item.category == item_category::dynamic) {
+        auto& ops   = *_item.data.dynamic.ops;
+        auto  count = uint64_t{0};
+        if (!_in.read(&count, sizeof(count)) || count > _in.remaining() / ops.elem_size) {
+            return false;
+        }
+
+        auto elems = static_cast<uint8_t*>(ops.resize(field, static_cast<size_t>(count)));
+        const auto& plan = get_plan(*_item.data.dynamic.elem);
+        if (plan.items.empty()) {
+            return _in.read(elems, static_cast<size_t>(count) * ops.elem_size);
+        }
+        for (auto i = 0u; i < count; ++i) {
+            if (!read_object(plan, elems + i * ops.elem_size, ops.elem_size, _in)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    auto& ops = *_item.data.tagged.ops;
+    auto  idx = uint32_t{0};
+    if (!_in.read(&idx, sizeof(idx))) {
+        return false;
+    }
+    if (idx == numeric_limits<uint32_t>::max()) {
+        ops.reset(field);
+        return true;
+    }
+    if (idx >= ops.count) {
+        return false;
+    }
+    auto alt = static_cast<uint8_t*>(ops.emplace[idx](field));
+    return read_object(get_plan(_item.data.tagged.items[idx]), alt, ops.sizes[idx], _in);
+}
+
+inline auto read_object(const serial_plan& _plan, uint8_t* _base, size_t _size, reader& _in) -> bool {
+    if (_in.remaining() < _size) {
+        return false;
+    }
+
+    // copy the fixed part around the live variable-length/tagged members
+
+    auto src    = _in.data + _in.pos;
+    auto cursor = size_t{0};
+    for (auto& entry : _plan.items) {
+        if (first_byte(entry) > cursor) {
+            memcpy(_base + cursor, src + cursor, first_byte(entry) - cursor);
+        }
+        cursor = max(cursor, end_byte(entry));
+    }
+    if (_size > cursor) {
+        memcpy(_base + cursor, src + cursor, _size - cursor);
+    }
+    _in.pos += _size;
+
+    for (auto& entry : _plan.items) {
+        if (!read_payload(entry, _base, _in)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace details
+
+template<typename T>
+auto serialize(const T& _obj, vector<uint8_t>& _out) -> bool {
+    auto& plan = details::get_plan<T>();
+    if (!plan.safe) {
+        return false;
+    }
+    details::write_object(plan, reinterpret_cast<const uint8_t*>(&_obj), sizeof(T), _out);
+    return true;
+}
+
+template<typename T>
+auto deserialize(const uint8_t* _data, size_t _size, T& _obj) -> size_t {
+    auto& plan = details::get_plan<T>();
+    auto  in   = details::reader{ _data, _size, 0 };
+    return plan.safe && details::read_object(plan, reinterpret_cast<uint8_t*>(&_obj), sizeof(T), in) ? in.pos : 0;
+}
+
+} // namespace map_layout
+} // namespace qcstudio
@@ -0,0 +1,313 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "map_layout_index.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Radix sort of record arrays by registered fields
+
+    'sort_by<T>' sorts an array of T records by a list of arithmetic or bit-field leaves (the
+    first one is the most significant, container elements are named with their path, e.g.
+    "pos[1]"). 'sort_order<T>' computes the sorted order as indices and leaves the records
+    untouched, which is the cheapest option for wide records that are only visited in order.
+
+        sort_by(ticks, { "venue", "price" });
+
+    Every field is mapped to an order-preserving unsigned key of its own width: the sign bit of
+    signed values is flipped, negative reals have all their bits flipped and positive ones only
+    the sign bit (so -0 sorts before +0 and NaNs go first or last depending on their sign), and
+    bit-fields are extracted from their ranges. Consecutive fields are packed into 64-bit keys,
+    each sorted with a stable LSD radix sort of 8-bit digits that skips the digits shared by all
+    the records.
+
+    The sort is stable. 'sort_by' sorts indices and then moves every record to its place through
+    a temporary array. Both return false, leaving the records untouched, when a field is unknown,
+    not arithmetic or a long double.
+*/
+
+template<typename T> auto sort_by   (T* _records, size_t _count, const vector<const char*>& _fields) -> bool;
+template<typename T> auto sort_by   (vector<T>& _records, const vector<const char*>& _fields) -> bool;
+template<typename T> auto sort_order(const T* _records, size_t _count, const vector<const char*>& _fields, vector<size_t>& _order) -> bool;
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+enum class key_kind : uint8_t { unsigned_int, signed_int, real };
+
+struct sort_key {
+    key_kind kind;
+    size_t   byte;  // first byte of the field
+    uint32_t shift; // first bit inside that byte (bit-fields)
+    uint32_t bits;  // width of the value and of its key
+    uint32_t bytes; // bytes spanned by the value
+};
+
+struct key_group {
+    vector<sort_key> keys; // most significant first
+    uint32_t         bits = 0;
+};
+
+inline auto make_sort_key(const field_index& _index, const string& _name, sort_key& _key) -> bool {
+    auto it = _index.leaf(_name);
+    if (!it || (it->item->category != item_category::arithmetic && it->item->category != item_category::bitfield)) {
+        return false;
+    }
+    const auto encoding = it->item->data.encoded_arithmetic;
+    const auto real     = it->item->category == item_category::arithmetic && (encoding & 0b11) == 0b11;
+    _key.kind  = real ? key_kind::real : (encoding & 0b100) == 0 ? key_kind::signed_int : key_kind::unsigned_int;
+    _key.byte  = it->first_bit / CHAR_BIT;
+    _key.shift = static_cast<uint32_t>(it->first_bit % CHAR_BIT);
+    _key.bits  = static_cast<uint32_t>(it->last_bit - it->first_bit + 1);
+    _key.bytes = (_key.shift + _key.bits + CHAR_BIT - 1) / CHAR_BIT;
+    return _key.bits <= 64 && (!real || _key.bits == 32 || _key.bits == 64);
+}
+
+// fields are packed into groups from the least significant one, so only the most
+// significant group may be partially filled
+
+inline auto make_key_groups(const field_index& _index, const vector<const char*>& _fields, vector<key_group>& _groups) -> bool {
+    for (auto it = _fields.rbegin(); it != _fields.rend(); ++it) {
+        auto key = sort_key{};
+        if (!make_sort_key(_index, *it, key)) {
+            return false;
+        }
+        if (_groups.empty() || _groups.back().bits + key.bits > 64) {
+            _groups.emplace_back();
+        }
+        auto& group = _groups.back();
+        group.keys.insert(group.keys.begin(), key);
+        group.bits += key.bits;
+    }
+    return true;
+}
+
+inline auto read_sort_key(const uint8_t* _record, const sort_key& _key) -> uint64_t {
+    const auto src = _record + _key.byte;
+    auto raw = uint64_t{0};
+    if (_key.shift == 0 && _key.bits == 8) {
+        raw = *src;
+    } else if (_key.shift == 0 && _key.bits == 16) {
+        uint16_t v; memcpy(&v, src, 2); raw = v;
+    } else if (_key.shift == 0 && _key.bits == 32) {
+        uint32_t v; memcpy(&v, src, 4); raw = v;
+    } else if (_key.shift == 0 && _key.bits == 64) {
+        memcpy(&raw, src, 8);
+    } else {
+        for (auto i = 0u; i < _key.bytes && i < 8; ++i) {
+            raw |= static_cast<uint64_t>(src[i]) << (i * CHAR_BIT);
+        }
+        raw >>= _key.shift;
+        if (_key.bytes > 8) {
+            raw |= static_cast<uint64_t>(src[8]) << (64 - _key.shift);
+        }
+        raw &= _key.bits == 64 ? ~uint64_t{0} : (uint64_t{1} << _key.bits) - 1;
+    }
+
+    const auto top  = uint64_t{1} << (_key.bits - 1);
+    const auto mask = _key.bits == 64 ? ~uint64_t{0} : (uint64_t{1} << _key.bits) - 1;
+    switch (_key.kind) {
+        case key_kind::signed_int: return raw ^ top;
+        case key_kind::real:       return raw & top ? ~raw & mask : raw | top;
+        default:                   return raw;
+    }
+}
+
+inline auto read_group_key(const uint8_t* _record, const key_group& _group) -> uint64_t {
+    auto ret = uint64_t{0};
+    for (auto& key : _group.keys) {
+        ret = (key.bits == 64 ? 0 : ret << key.bits) | read_sort_key(_record, key);
+    }
+    return ret;
+}
+
+// stable LSD radix sort of (key, index) pairs on the low '_bits' of the keys; the buffers are
+// swapped after every pass so the result may end up in either of them
+
+template<typename K, typename I>
+void radix_sort(K*& _keys, I*& _idx, K*& _tmp_keys, I*& _tmp_idx, size_t _count, uint32_t _bits) {
+    const auto passes = (_bits + 7) / 8;
+
+    size_t histogram[sizeof(K)][256] = {};
+    for (auto i = size_t{0}; i < _count; ++i) {
+        for (auto p = 0u; p < passes; ++p) {
+            ++histogram[p][(_keys[i] >> (p * 8)) & 0xFF];
+        }
+    }
+
+    for (auto p = 0u; p < passes; ++p) {
+        auto bucket = histogram[p];
+        if (bucket[(_keys[0] >> (p * 8)) & 0xFF] == _count) {
+            continue; // every record has the same digit
+        }
+        auto sum = size_t{0};
+        for (auto d = 0u; d < 256; ++d) {
+            const auto n = bucket[d];
+            bucket[d] = sum;
+            sum += n;
+        }
+        const auto keys = _keys, tmp_keys = _tmp_keys;
+        const auto idx  = _idx,  tmp_idx  = _tmp_idx;
+        for (auto i = size_t{0}; i < _count; ++i) {
+            const auto pos = bucket[(keys[i] >> (p * 8)) & 0xFF]++;
+            tmp_keys[pos] = keys[i];
+            tmp_idx[pos]  = idx[i];
+        }
+        swap(_keys, _tmp_keys);
+        swap(_idx, _tmp_idx);
+    }
+}
+
+// keys are as narrow as the group allows and the buffers are left uninitialized: at these sizes
+// zeroing and faulting in memory costs as much as a sorting pass
+
+template<typename K, typename I>
+void sort_group(const uint8_t* _records, size_t _count, size_t _stride, const key_group& _group, bool _first, I*& _idx, I*& _tmp_idx) {
+    unique_ptr<K[]> a(new K[_count]), b(new K[_count]);
+    auto keys = a.get(), tmp_keys = b.get();
+    if (_first) {
+        for (auto i = size_t{0}; i < _count; ++i) {
+            keys[i] = static_cast<K>(read_group_key(_records + i * _stride, _group));
+        }
+    } else {
+
+        // read the keys sequentially, then gather them in the current order (cheaper than
+        // visiting the records in random order)
+
+        for (auto i = size_t{0}; i < _count; ++i) {
+            tmp_keys[i] = static_cast<K>(read_group_key(_records + i * _stride, _group));
+        }
+        for (auto i = size_t{0}; i < _count; ++i) {
+            keys[i] = tmp_keys[_idx[i]];
+        }
+    }
+    radix_sort(keys, _idx, tmp_keys, _tmp_idx, _count, _group.bits);
+}
+
+// sorted order in '_idx' ('_tmp_idx' is scratch space), both holding '_count' indices
+
+template<typename I>
+void sort_indices(const uint8_t* _records, size_t _count, size_t _stride, const vector<key_group>& _groups, I* _idx, I* _tmp_idx) {
+    const auto idx = _idx;
+    for (auto i = size_t{0}; i < _count; ++i) {
+        _idx[i] = static_cast<I>(i);
+    }
+    if (_count < 2) {
+        return;
+    }
+    for (auto g = size_t{0}; g < _groups.size(); ++g) {
+        if (_groups[g].bits <= 32) {
+            sort_group<uint32_t>(_records, _count, _stride, _groups[g], g == 0, _idx, _tmp_idx);
+        } else {
+            sort_group<uint64_t>(_records, _count, _stride, _groups[g], g == 0, _idx, _tmp_idx);
+        }
+    }
+    if (_idx != idx) {
+        memcpy(idx, _idx, _count * sizeof(I));
+    }
+}
+
+template<typename I>
+void sort_indices(const uint8_t* _records, size_t _count, size_t _stride, const vector<key_group>& _groups, unique_ptr<I[]>& _idx) {
+    _idx.reset(new I[_count]);
+    unique_ptr<I[]> tmp(new I[_count]);
+    sort_indices(_records, _count, _stride, _groups, _idx.get(), tmp.get());
+}
+
+// position 'i' receives record '_idx[i]'; records are gathered into a temporary array, whose
+// independent reads overlap much better than following the cycles of the permutation in place
+
+template<typename T, typename I>
+void apply_order(T* _records, size_t _count, const I* _idx) {
+    vector<T> sorted;
+    sorted.reserve(_count);
+    for (auto i = size_t{0}; i < _count; ++i) {
+        sorted.push_back(move(_records[_idx[i]]));
+    }
+    move(sorted.begin(), sorted.end(), _records);
+}
+
+} // namespace details
+
+template<typename T>
+auto sort_order(const T* _records, size_t _count, const vector<const char*>& _fields, vector<size_t>& _order) -> bool {
+    vector<details::key_group> groups;
+    if (!details::make_key_groups(get_field_index<T>(), _fields, groups)) {
+        return false;
+    }
+    if (_count <= UINT32_MAX) {
+        unique_ptr<uint32_t[]> idx;
+        details::sort_indices(reinterpret_cast<const uint8_t*>(_records), _count, sizeof(T), groups, idx);
+        _order.assign(idx.get(), idx.get() + _count);
+    } else {
+        _order.resize(_count);
+        unique_ptr<size_t[]> tmp(new size_t[_count]);
+        details::sort_indices(reinterpret_cast<const uint8_t*>(_records), _count, sizeof(T), groups, _order.data(), tmp.get());
+    }
+    return true;
+}
+
+template<typename T>
+auto sort_by(T* _records, size_t _count, const vector<const char*>& _fields) -> bool {
+    vector<details::key_group> groups;
+    if (!details::make_key_groups(get_field_index<T>(), _fields, groups)) {
+        return false;
+    }
+    if (_count <= UINT32_MAX) {
+        unique_ptr<uint32_t[]> idx;
+        details::sort_indices(reinterpret_cast<const uint8_t*>(_records), _count, sizeof(T), groups, idx);
+        details::apply_order(_records, _count, idx.get());
+    } else {
+        unique_ptr<size_t[]> idx;
+        details::sort_indices(reinterpret_cast<const uint8_t*>(_records), _count, sizeof(T), groups, idx);
+        details::apply_order(_records, _count, idx.get());
+    }
+    return true;
+}
+
+template<typename T>
+auto sort_by(vector<T>& _records, const vector<const char*>& _fields) -> bool {
+    return sort_by(_records.data(), _records.size(), _fields);
+}
+
+} // namespace map_layout
+} // namespace qcstudio
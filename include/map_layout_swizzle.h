@@ -0,0 +1,167 @@
+/*
+    MIT License
+
+    Copyright (c) 2016-2020 Raúl Ramos
+
+    Permission is hereby granted, free of charge, to any person obtaining a copy
+    of this software and associated documentation files (the "Software"), to deal
+    in the Software without restriction, including without limitation the rights
+    to use, copy, modify, merge, publish, distribute, sub-license, and/or sell
+    copies of the Software, and to permit persons to whom the Software is
+    furnished to do so, subject to the following conditions:
+
+    The above copyright notice and this permission notice shall be included in all
+    copies or substantial portions of the Software.
+
+    THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+    IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+    FITNESS FOR A PARTICULAR PURPOSE AND NON-INFRINGEMENT. IN NO EVENT SHALL THE
+    AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+    LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+    OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+    SOFTWARE.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "map_layout.h"
+
+namespace qcstudio {
+namespace map_layout {
+using namespace std;
+
+/*
+    == PUBLIC C++ interface ==========
+
+    Pointer swizzling for relocatable object graphs
+
+    A graph whose objects all live in one memory block (the "arena") becomes position
+    independent once every registered pointer field is rewritten as the signed distance from
+    the field to its target (0 stays null). The arena can then be written to a file and mapped
+    back anywhere.
+
+    - 'swizzle' rewrites the pointer fields of '_count' objects of type T. Every non-null
+      pointer must point inside [_begin, _end) and not to the field itself; otherwise nothing
+      is modified and false is returned.
+    - 'unswizzle' turns the distances back into absolute pointers (e.g. after mapping the file
+      with write access).
+    - 'relative' reads a swizzled pointer field in place, which allows using a read-only
+      mapping without touching a single page up-front.
+
+    Every registered pointer field reachable from T is swizzled: those of T, those inside
+    pair/tuple/array members and those registered on nested classes (at any depth).
+    Unregistered pointers are left alone.
+*/
+
+template<typename T> auto swizzle  (T* _objs, size_t _count, const void* _begin, const void* _end) -> bool;
+template<typename T> void unswizzle(T* _objs, size_t _count);
+template<typename U> auto relative (U* const& _field) -> U*;
+
+/*
+    == PRIVATE Implementation details ==========
+*/
+
+namespace details {
+
+// '_offset' is the byte offset of the (nested) class whose layout '_item' belongs to
+
+inline void collect_pointer_offsets(const item_t& _item, size_t _offset, vector<size_t>& _out) {
+    if (_item.category == item_category::container) {
+        for (auto i = 0u; i < _item.data.container.count; ++i) {
+            collect_pointer_offsets(_item.data.container.items[i], _offset, _out);
+        }
+    } else if (_item.category == item_category::klass) {
+        for (auto& [ name, info ] : _item.data.klass.layout().fields) {
+            collect_pointer_offsets(info.item, _offset + _item.ranges.front() / CHAR_BIT, _out);
+        }
+    } else if (_item.category == item_category::pointer) {
+        _out.push_back(_offset + _item.ranges.front() / CHAR_BIT);
+    }
+}
+
+template<typename T>
+auto pointer_offsets() -> const vector<size_t>& {
+    static const auto ret = [] {
+        vector<size_t> offsets;
+        for (auto& [ name, info ] : get_layout<T>().fields) {
+            collect_pointer_offsets(info.item, 0, offsets);
+        }
+        sort(offsets.begin(), offsets.end()); // a field registered under several names is swizzled once
+        offsets.erase(unique(offsets.begin(), offsets.end()), offsets.end());
+        return offsets;
+    }();
+    return ret;
+}
+
+inline auto load_word(const uint8_t* _addr) -> uintptr_t {
+    uintptr_t ret;
+    memcpy(&ret, _addr, sizeof(ret));
+    return ret;
+}
+
+inline void store_word(uint8_t* _addr, uintptr_t _value) {
+    memcpy(_addr, &_value, sizeof(_value));
+}
+
+} // namespace details
+
+template<typename T>
+auto swizzle(T* _objs, size_t _count, const void* _begin, const void* _end) -> bool {
+    static_assert(sizeof(void*) == sizeof(uintptr_t), "Unsupported pointer representation");
+
+    auto& offsets = details::pointer_offsets<T>();
+    auto  base    = reinterpret_cast<uint8_t*>(_objs);
+    auto  lo      = reinterpret_cast<uintptr_t>(_begin);
+    auto  hi      = reinterpret_cast<uintptr_t>(_end);
+
+    // validate everything first so that a failure leaves the objects untouched
+
+    for (auto i = 0u; i < _count; ++i) {
+        for (auto offset : offsets) {
+            auto field = base + i * sizeof(T) + offset;
+            auto value = details::load_word(field);
+            if (value && (value < lo || value >= hi || value == reinterpret_cast<uintptr_t>(field))) {
+                return false;
+            }
+        }
+    }
+
+    for (auto i = 0u; i < _count; ++i) {
+        for (auto offset : offsets) {
+            auto field = base + i * sizeof(T) + offset;
+            if (auto value = details::load_word(field)) {
+                details::store_word(field, value - reinterpret_cast<uintptr_t>(field));
+            }
+        }
+    }
+    return true;
+}
+
+template<typename T>
+void unswizzle(T* _objs, size_t _count) {
+    auto& offsets = details::pointer_offsets<T>();
+    auto  base    = reinterpret_cast<uint8_t*>(_objs);
+    for (auto i = 0u; i < _count; ++i) {
+        for (auto offset : offsets) {
+            auto field = base + i * sizeof(T) + offset;
+            if (auto distance = details::load_word(field)) {
+                details::store_word(field, reinterpret_cast<uintptr_t>(field) + distance);
+            }
+        }
+    }
+}
+
+template<typename U>
+auto relative(U* const& _field) -> U* {
+    auto field    = reinterpret_cast<const uint8_t*>(&_field);
+    auto distance = details::load_word(field);
+    return distance ? reinterpret_cast<U*>(reinterpret_cast<uintptr_t>(field) + distance) : nullptr;
+}
+
+} // namespace map_layout
+} // namespace qcstudio